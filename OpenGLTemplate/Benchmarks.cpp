@@ -0,0 +1,2 @@
+#define BENCHMARKS_IMPLEMENTATION
+#include "Benchmarks.h"
\ No newline at end of file
@@ -0,0 +1,815 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <glad/glad.h>
+
+#include "Bvh.h"
+#include "FrameUniforms.h"
+#include "FrustumCuller.h"
+#include "GeometryArena.h"
+#include "GpuCuller.h"
+#include "InstanceStream.h"
+#include "Model.h"
+#include "OcclusionCuller.h"
+#include "PrimitiveRegistry.h"
+#include "ProcessMemory.h"
+#include "ProgramCache.h"
+#include "RenderQueue.h"
+#include "Shader.h"
+#include "ShaderLibrary.h"
+#include "Square.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "TransformGraph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Small timing harnesses run from the command line (see main). They all expect a current GL context.
+
+// prints the vertex cache optimization results of an import, one line per mesh and a total
+inline void printOptimizeStats(const vector<MeshOptimizeStats>& stats)
+{
+    MeshOptimizeStats total;
+    float missesBefore = 0.0f, missesAfter = 0.0f;
+    for (size_t i = 0; i < stats.size(); i++)
+    {
+        const MeshOptimizeStats& mesh = stats[i];
+        std::cout << "  mesh " << i << ": " << mesh.triangles << " triangles, vertices " << mesh.verticesBefore << " -> " << mesh.verticesAfter
+                  << ", ACMR " << mesh.acmrBefore << " -> " << mesh.acmrAfter << ", ATVR " << mesh.atvrBefore << " -> " << mesh.atvrAfter << std::endl;
+        total.triangles += mesh.triangles;
+        total.verticesBefore += mesh.verticesBefore;
+        total.verticesAfter += mesh.verticesAfter;
+        missesBefore += mesh.acmrBefore * mesh.triangles;
+        missesAfter += mesh.acmrAfter * mesh.triangles;
+    }
+    if (total.triangles > 0)
+        std::cout << "  all meshes: vertices " << total.verticesBefore << " -> " << total.verticesAfter << ", ACMR "
+                  << missesBefore / total.triangles << " -> " << missesAfter / total.triangles << " (" << MeshOptimizer::CACHE_SIZE << " entry FIFO)" << std::endl;
+}
+
+// loads the same model serially and on the worker pools (bypassing the cooked cache), then once more from the
+// cooked cache, and prints how long each stage took
+inline void benchmarkModelLoad(const std::string& path, unsigned int runs = 3)
+{
+    ModelLoadStats serial, parallel;
+    vector<MeshOptimizeStats> optimizeStats;
+    double serialWallMs = 0.0, parallelWallMs = 0.0;
+    for (unsigned int run = 0; run < runs; run++)
+    {
+        for (bool useWorkers : { false, true })
+        {
+            double wallMs;
+            {
+                auto start = std::chrono::steady_clock::now();
+                Model model(path, false, useWorkers, false);
+                // the parallel load returns with textures still decoding, count the time until they're all resident
+                TextureLoader::instance().finish();
+                wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                ModelLoadStats& total = useWorkers ? parallel : serial;
+                total.importMs += model.loadStats.importMs / runs;
+                total.convertMs += model.loadStats.convertMs / runs;
+                total.uploadMs += model.loadStats.uploadMs / runs;
+                total.meshCount = model.loadStats.meshCount;
+                total.vertexBytes = model.loadStats.vertexBytes;
+                total.unpackedVertexBytes = model.loadStats.unpackedVertexBytes;
+                total.indexBytes = model.loadStats.indexBytes;
+                optimizeStats = model.loadStats.optimizeStats;
+            }
+            (useWorkers ? parallelWallMs : serialWallMs) += wallMs / runs;
+            // otherwise the next load would find every texture in the cache
+            TextureCache::instance().purgeUnused();
+        }
+    }
+
+    std::cout << "model load benchmark: " << path << " (" << serial.meshCount << " meshes, "
+              << ThreadPool::shared().size() << " workers, " << runs << " runs)" << std::endl;
+    std::cout << "  serial:   import " << serial.importMs << " ms, convert " << serial.convertMs << " ms, upload " << serial.uploadMs << " ms, textures resident after " << serialWallMs << " ms" << std::endl;
+    std::cout << "  parallel: import " << parallel.importMs << " ms, convert " << parallel.convertMs << " ms, upload " << parallel.uploadMs << " ms, textures resident after " << parallelWallMs << " ms" << std::endl;
+    if (parallel.convertMs > 0.0)
+        std::cout << "  convert speedup " << serial.convertMs / parallel.convertMs << "x, overall " << serialWallMs / parallelWallMs << "x" << std::endl;
+    printOptimizeStats(optimizeStats);
+    if (parallel.vertexBytes > 0)
+        std::cout << "  vertex data: " << parallel.vertexBytes / 1024 << " KiB packed vs " << parallel.unpackedVertexBytes / 1024 << " KiB as full Vertex ("
+                  << static_cast<double>(parallel.unpackedVertexBytes) / parallel.vertexBytes << "x smaller), "
+                  << parallel.indexBytes / 1024 << " KiB of 16-bit indices" << std::endl;
+
+    // a warm load through the cooked cache (the first one writes it)
+    {
+        Model cold(path);
+    }
+    auto start = std::chrono::steady_clock::now();
+    Model warm(path);
+    TextureLoader::instance().finish();
+    double warmMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  cached:   " << (warm.loadStats.fromCache ? "map " : "import (cache unavailable) ") << warm.loadStats.importMs << " ms, upload "
+              << warm.loadStats.uploadMs << " ms, textures resident after " << warmMs << " ms" << std::endl;
+    TextureCache::instance().printStats();
+    // every model above gave its meshes back, so this also shows how well freed space was reused
+    GeometryArena::instance().printStats();
+}
+
+// loads a model once (bypassing the cooked cache) and reports resident memory. The peak is process-wide, so compare
+// keepGeometry on and off in separate runs of the program.
+inline void benchmarkModelMemory(const std::string& path, bool keepGeometry)
+{
+    const double MiB = 1024.0 * 1024.0;
+    size_t before = ProcessMemory::currentResident();
+    size_t loaded, cpuGeometry = 0;
+    {
+        Model model(path, false, true, false, keepGeometry);
+        TextureLoader::instance().finish();
+        loaded = ProcessMemory::currentResident();
+        for (const Mesh& mesh : model.meshes)
+            cpuGeometry += mesh.vertexData.capacity() + mesh.indices.capacity() * sizeof(unsigned short);
+    }
+    size_t after = ProcessMemory::currentResident();
+
+    std::cout << "model memory benchmark: " << path << (keepGeometry ? " (CPU geometry kept)" : " (CPU geometry dropped)") << std::endl;
+    std::cout << "  resident before " << before / MiB << " MiB, after load " << loaded / MiB << " MiB, after unload " << after / MiB
+              << " MiB, peak " << ProcessMemory::peakResident() / MiB << " MiB" << std::endl;
+    std::cout << "  CPU-side geometry held by the meshes: " << cpuGeometry / MiB << " MiB" << std::endl;
+}
+
+// times the uniform setters of a linked shader with a "model" mat4: the old per-call glGetUniformLocation with a
+// std::string, the hashed name looked up in the reflected table, and a location fetched once up front. Then the same
+// matrix (plus its normal matrix) pushed through the FrameUniforms ring for perDrawShader, which has a PerDraw block.
+inline void benchmarkUniformSetters(Shader& shader, Shader& perDrawShader, unsigned int iterations = 200000)
+{
+    shader.use();
+    glm::mat4 matrix(1.0f);
+    auto time = [&](auto&& body) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < iterations; i++)
+            body();
+        glFinish();
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+    };
+
+    double stringNs = time([&] {
+        std::string name = "model";
+        glUniformMatrix4fv(glGetUniformLocation(shader.ID.get(), name.c_str()), 1, GL_FALSE, &matrix[0][0]);
+    });
+    double hashedNs = time([&] { shader.setMat4("model", matrix); });
+    UniformLocation model = shader.location("model");
+    double locationNs = time([&] { shader.setMat4(model, matrix); });
+
+    perDrawShader.use();
+    FrameUniforms::instance().beginFrame(PerFrameData());
+    double ringNs = time([&] { perDrawShader.setModel(matrix); });
+
+    std::cout << "uniform setter benchmark (" << iterations << " setMat4 calls):" << std::endl;
+    std::cout << "  string + glGetUniformLocation: " << stringNs << " ns/call" << std::endl;
+    std::cout << "  hashed name, reflected table:  " << hashedNs << " ns/call" << std::endl;
+    std::cout << "  cached location:               " << locationNs << " ns/call" << std::endl;
+    std::cout << "  PerDraw ring range:            " << ringNs << " ns/call" << std::endl;
+}
+
+// draws a scene of objects scattered in front of the camera, alternating between the square and the model, first
+// immediately in scene order and then through a RenderQueue, and compares CPU time and state changes per frame.
+// Every frame re-uploads frameUniforms.
+inline void benchmarkRenderQueue(Shader& shader, Square& square, const std::string& modelPath, const PerFrameData& frameUniforms,
+                                 unsigned int objects = 4000, unsigned int frames = 20)
+{
+    Model model(modelPath);
+    TextureLoader::instance().finish();
+
+    struct Object {
+        glm::vec3 position;
+        bool isModel;
+    };
+    std::vector<Object> scene(objects);
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> spread(-20.0f, 20.0f), distance(-60.0f, -2.0f);
+    for (unsigned int i = 0; i < objects; i++)
+        scene[i] = { glm::vec3(spread(random), spread(random), distance(random)), i % 2 == 1 };
+
+    auto time = [&](auto&& drawScene) {
+        GLState::instance().beginFrame();
+        FrameUniforms::instance().beginFrame(frameUniforms);
+        drawScene();
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < frames; frame++)
+        {
+            GLState::instance().beginFrame();
+            FrameUniforms::instance().beginFrame(frameUniforms);
+            drawScene();
+            glFinish();
+        }
+        GLState::instance().beginFrame();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    };
+
+    double immediateMs = time([&] {
+        shader.use();
+        for (const Object& object : scene)
+        {
+            if (object.isModel)
+                model.Draw(shader, Square::modelMatrix(object.position, 1.0f));
+            else
+                square.drawShape(object.position, 1.0f, shader);
+        }
+    });
+    GLStateStats immediate = GLState::instance().stats();
+
+    RenderQueue queue;
+    size_t packets = 0;
+    double sortMs = 0.0;
+    double queuedMs = time([&] {
+        queue.begin(frameUniforms.cameraPosition, 0.1f, 100.0f);
+        for (const Object& object : scene)
+        {
+            if (object.isModel)
+                model.Submit(queue, shader, Square::modelMatrix(object.position, 1.0f));
+            else
+                square.submitShape(queue, object.position, 1.0f, shader);
+        }
+        packets = queue.size();
+        auto start = std::chrono::steady_clock::now();
+        queue.execute();
+        sortMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    });
+    GLStateStats queued = GLState::instance().stats();
+
+    std::cout << "render queue benchmark: " << objects << " objects (" << packets << " draw packets), " << frames << " frames" << std::endl;
+    std::cout << "  immediate: " << immediateMs << " ms/frame, " << immediate.issued << " state changes issued, " << immediate.elided << " elided" << std::endl;
+    std::cout << "  queued:    " << queuedMs << " ms/frame (sort + execute " << sortMs / (frames + 1) << " ms), " << queued.issued
+              << " state changes issued, " << queued.elided << " elided" << std::endl;
+}
+
+// draws the same field of cubes once per cube through Square::drawShape (a PerDraw upload and a draw call each) and once
+// through Square::drawInstanced, and reports how many cubes each path fits into a 60 Hz frame. The CPU submission and
+// the GPU work are both in the time (glFinish per frame). The square needs its instanced VAO set up.
+inline void benchmarkInstancing(Square& square, Shader& shader, Shader& instancedShader, InstanceStream& stream, const PerFrameData& frameUniforms,
+                                unsigned int cubes = 20000, unsigned int frames = 20)
+{
+    std::vector<glm::vec3> positions(cubes);
+    std::vector<float> scales(cubes);
+    std::vector<glm::vec4> colors(cubes);
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> spread(-20.0f, 20.0f), distance(-60.0f, -2.0f), unit(0.0f, 1.0f);
+    for (unsigned int i = 0; i < cubes; i++)
+    {
+        positions[i] = glm::vec3(spread(random), spread(random), distance(random));
+        scales[i] = 0.1f + 0.3f * unit(random);
+        colors[i] = glm::vec4(unit(random), unit(random), unit(random), 1.0f);
+    }
+
+    auto time = [&](auto&& drawScene) {
+        GLState::instance().beginFrame();
+        FrameUniforms::instance().beginFrame(frameUniforms);
+        drawScene();
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < frames; frame++)
+        {
+            GLState::instance().beginFrame();
+            FrameUniforms::instance().beginFrame(frameUniforms);
+            drawScene();
+            glFinish();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    };
+
+    double immediateMs = time([&] {
+        shader.use();
+        for (unsigned int i = 0; i < cubes; i++)
+            square.drawShape(positions[i], scales[i], shader);
+    });
+    stream.takeStats();
+    double instancedMs = time([&] {
+        instancedShader.use();
+        square.drawInstanced(positions, scales, colors);
+    });
+    InstanceStreamStats streamed = stream.takeStats();
+
+    const double frameMs = 1000.0 / 60.0;
+    std::cout << "instancing benchmark: " << cubes << " cubes, " << frames << " frames" << std::endl;
+    PrimitiveRegistry::instance().printStats();
+    std::cout << "  immediate: " << immediateMs << " ms/frame, ~" << static_cast<size_t>(cubes * frameMs / immediateMs) << " cubes per 60 Hz frame" << std::endl;
+    std::cout << "  instanced: " << instancedMs << " ms/frame, ~" << static_cast<size_t>(cubes * frameMs / instancedMs) << " cubes per 60 Hz frame ("
+              << streamed.writes / (frames + 1) << " batches/frame, " << streamed.orphans << " orphans)" << std::endl;
+}
+
+// culls a field of random bounds around the camera with every kernel this build has, and checks they agree. The field
+// surrounds the camera, so most of it is culled; which kernel runs depends on the build (/arch:AVX2 for AVX2).
+// count boxes of 0.5 to 4 units scattered through a 200 unit cube around the origin, the same scene for the same seed
+inline std::vector<Bounds> randomBoxes(unsigned int count, unsigned int seed = 1234)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> spread(-100.0f, 100.0f), size(0.25f, 2.0f);
+    std::vector<Bounds> scene(count);
+    for (Bounds& bounds : scene)
+    {
+        glm::vec3 center(spread(random), spread(random), spread(random));
+        glm::vec3 extents(size(random), size(random), size(random));
+        bounds.min = center - extents;
+        bounds.max = center + extents;
+        bounds.center = center;
+        bounds.radius = glm::length(extents);
+        bounds.valid = true;
+    }
+    return scene;
+}
+
+// the benchmarks' camera: at the origin looking down -z, like the default view
+inline PerFrameData benchmarkCamera()
+{
+    PerFrameData camera;
+    camera.projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    camera.view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    camera.viewProjection = camera.projection * camera.view;
+    camera.cameraPosition = glm::vec3(0.0f);
+    camera.time = 0.0f;
+    return camera;
+}
+
+inline Frustum benchmarkFrustum()
+{
+    return Frustum::fromMatrix(benchmarkCamera().viewProjection);
+}
+
+inline void benchmarkFrustumCulling(unsigned int count = 20000, unsigned int frames = 200)
+{
+    std::vector<Bounds> scene = randomBoxes(count);
+    Frustum frustum = benchmarkFrustum();
+
+    FrustumCuller culler;
+    culler.reserve(count);
+    for (const Bounds& bounds : scene)
+        culler.add(bounds);
+
+    std::cout << "frustum culling benchmark: " << count << " bounds, " << frames << " frames" << std::endl;
+    size_t expected = culler.cull(frustum, CullKernel::Scalar).size();
+    for (CullKernel kernel : { CullKernel::Scalar, CullKernel::SSE, CullKernel::AVX2 })
+    {
+        if (!FrustumCuller::supported(kernel))
+        {
+            std::cout << "  " << cullKernelName(kernel) << ": not in this build" << std::endl;
+            continue;
+        }
+        double totalMs = 0.0;
+        for (unsigned int frame = 0; frame < frames; frame++)
+        {
+            culler.cull(frustum, kernel);
+            totalMs += culler.stats().ms;
+        }
+        const CullStats& stats = culler.stats();
+        double frameUs = totalMs * 1000.0 / frames;
+        std::cout << "  " << cullKernelName(kernel) << ": " << frameUs << " us/frame, " << frameUs * 1000.0 / count << " ns/bound, "
+                  << stats.culledFraction() * 100.0f << "% culled" << (stats.visible == expected ? "" : " (MISMATCH with scalar)") << std::endl;
+    }
+}
+
+// the object BVH on a scene of count random boxes: build time and shape, refit against rebuild after a tenth of the
+// objects moved, frustum culling against the linear SIMD culler, and picking rays against a linear scan of every box
+inline void benchmarkBvh(unsigned int count = 10000, unsigned int frames = 200, unsigned int rays = 4096)
+{
+    auto millisecondsSince = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    std::vector<Bounds> scene = randomBoxes(count);
+    Frustum frustum = benchmarkFrustum();
+    std::cout << "BVH benchmark: " << count << " objects" << std::endl;
+
+    Bvh tree;
+    double buildMs = 0.0;
+    for (unsigned int run = 0; run < 10; run++)
+    {
+        tree.build(scene);
+        buildMs += tree.stats().buildMs;
+    }
+    const BvhStats& shape = tree.stats();
+    std::cout << "  build: " << buildMs / 10 << " ms (" << shape.nodes << " nodes, " << shape.leaves << " leaves, depth " << shape.depth << ")" << std::endl;
+
+    // dynamic objects: every tenth one drifts a little each frame
+    std::mt19937 random(99);
+    std::uniform_real_distribution<float> drift(-0.5f, 0.5f);
+    double refitMs = 0.0;
+    for (unsigned int frame = 0; frame < frames; frame++)
+    {
+        for (size_t i = 0; i < scene.size(); i += 10)
+        {
+            glm::vec3 offset(drift(random), drift(random), drift(random));
+            scene[i].min = scene[i].min + offset;
+            scene[i].max = scene[i].max + offset;
+            scene[i].center = scene[i].center + offset;
+        }
+        auto start = std::chrono::steady_clock::now();
+        tree.refit(scene);
+        refitMs += millisecondsSince(start);
+    }
+    std::cout << "  refit: " << refitMs * 1000.0 / frames << " us/frame with " << (count + 9) / 10 << " objects moving, rebuild "
+              << buildMs / 10 << " ms" << std::endl;
+
+    // culling, on the refitted tree and again on a fresh one to see what the drift cost
+    FrustumCuller culler;
+    culler.reserve(count);
+    for (const Bounds& bounds : scene)
+        culler.add(bounds);
+    size_t expected = culler.cull(frustum).size();
+    double linearMs = 0.0;
+    for (unsigned int frame = 0; frame < frames; frame++)
+    {
+        culler.cull(frustum);
+        linearMs += culler.stats().ms;
+    }
+    std::cout << "  cull, linear " << cullKernelName(FrustumCuller::best()) << ": " << linearMs * 1000.0 / frames << " us/frame, "
+              << expected << " visible" << std::endl;
+    std::vector<uint32_t> visible;
+    for (bool rebuilt : { false, true })
+    {
+        if (rebuilt)
+            tree.build(scene);
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < frames; frame++)
+            tree.cull(frustum, visible);
+        std::cout << "  cull, BVH " << (rebuilt ? "rebuilt" : "refitted") << ": " << millisecondsSince(start) * 1000.0 / frames << " us/frame, " << visible.size()
+                  << " visible" << (visible.size() == expected ? "" : " (MISMATCH with linear)") << std::endl;
+    }
+
+    // picking: rays from the middle of the scene in random directions, closest box hit
+    std::vector<Ray> pickRays(rays - rays % 4);
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    for (Ray& ray : pickRays)
+        ray.direction = glm::normalize(glm::vec3(direction(random), direction(random), direction(random)) + glm::vec3(0.0f, 0.0f, 0.001f));
+    std::vector<RayHit> linearHits(pickRays.size()), singleHits(pickRays.size()), packetHits(pickRays.size());
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < pickRays.size(); r++)
+    {
+        const Ray& ray = pickRays[r];
+        glm::vec3 inverse = glm::vec3(1.0f) / ray.direction;
+        for (uint32_t i = 0; i < scene.size(); i++)
+        {
+            glm::vec3 t0 = (scene[i].min - ray.origin) * inverse, t1 = (scene[i].max - ray.origin) * inverse;
+            glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+            float entry = std::max({ near.x, near.y, near.z, 0.0f }), exit = std::min({ far.x, far.y, far.z, ray.tMax });
+            if (entry <= exit && entry < linearHits[r].t)
+                linearHits[r] = { i, entry };
+        }
+    }
+    double linearPickMs = millisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < pickRays.size(); r++)
+        singleHits[r] = tree.intersect(pickRays[r]);
+    double singlePickMs = millisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < pickRays.size(); r += 4)
+        tree.intersect4(&pickRays[r], &packetHits[r], [](uint32_t, float entry, int) { return entry; });
+    double packetPickMs = millisecondsSince(start);
+
+    size_t hits = 0, mismatches = 0;
+    for (size_t r = 0; r < pickRays.size(); r++)
+    {
+        hits += linearHits[r].hit();
+        mismatches += singleHits[r].primitive != linearHits[r].primitive || packetHits[r].primitive != linearHits[r].primitive;
+    }
+    std::cout << "  pick, " << pickRays.size() << " rays (" << hits << " hits): linear " << linearPickMs * 1e6 / pickRays.size()
+              << " ns/ray, BVH " << singlePickMs * 1e6 / pickRays.size() << " ns/ray, BVH 4-ray packets "
+              << packetPickMs * 1e6 / pickRays.size() << " ns/ray" << (mismatches == 0 ? "" : " (MISMATCH with linear)") << std::endl;
+}
+
+// a random hierarchy of count nodes, added depth first: each node goes under the last one or up to three levels above
+// it, which keeps the tree shallow and bushy, like a scene of many multi-part objects
+inline TransformGraph randomHierarchy(unsigned int count, unsigned int seed = 1234)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> climb(0, 3);
+    TransformGraph graph;
+    graph.reserve(count);
+    std::vector<uint32_t> path;   // the last node added and its ancestors
+    for (unsigned int i = 0; i < count; i++)
+    {
+        path.resize(path.size() - std::min<size_t>(path.size(), climb(random)));
+        uint32_t parent = path.empty() ? TransformGraph::NONE : path.back();
+        path.push_back(graph.add(parent, glm::translate(glm::mat4(1.0f), glm::vec3(offset(random), offset(random), offset(random)))));
+    }
+    return graph;
+}
+
+// world matrix updates of a TransformGraph on the calling thread and on the worker pool: everything moving (every
+// root flagged) and a few parts moving (1% of the nodes flagged at random each frame). Both graphs get the same
+// changes and have to end up with identical world matrices.
+inline void benchmarkTransforms(unsigned int count = 100000, unsigned int frames = 100)
+{
+    TransformGraph serial = randomHierarchy(count);
+    TransformGraph parallel = serial;
+    serial.update(nullptr);
+    parallel.update();
+    size_t roots = 0;
+    for (uint32_t node = 0; node < serial.size(); node = serial.subtreeEnd(node))
+        roots++;
+    std::cout << "transform graph benchmark: " << count << " nodes, " << roots << " roots, " << ThreadPool::shared().size() << " workers" << std::endl;
+
+    auto run = [&](const char* label, auto&& move) {
+        double serialMs = 0.0, parallelMs = 0.0;
+        size_t updated = 0, subtrees = 0;
+        for (unsigned int frame = 0; frame < frames; frame++)
+        {
+            move(serial, frame);
+            move(parallel, frame);
+            serial.update(nullptr);
+            parallel.update();
+            serialMs += serial.stats().ms;
+            parallelMs += parallel.stats().ms;
+            updated += parallel.stats().updated;
+            subtrees += parallel.stats().subtrees;
+        }
+        size_t mismatches = 0;
+        for (uint32_t node = 0; node < serial.size(); node++)
+            mismatches += serial.world(node) != parallel.world(node);
+        std::cout << "  " << label << ": " << updated / frames << " nodes updated, serial " << serialMs / frames << " ms, parallel "
+                  << parallelMs / frames << " ms over " << subtrees / frames << " subtrees"
+                  << (mismatches == 0 ? "" : " (MISMATCH with serial)") << std::endl;
+    };
+
+    run("everything moving", [](TransformGraph& graph, unsigned int) {
+        for (uint32_t node = 0; node < graph.size(); node = graph.subtreeEnd(node))
+            graph.setLocal(node, glm::translate(graph.local(node), glm::vec3(0.01f, 0.0f, 0.0f)));
+    });
+    run("1% of the nodes moving", [count](TransformGraph& graph, unsigned int frame) {
+        std::mt19937 random(frame);
+        std::uniform_int_distribution<uint32_t> pick(0, count - 1);
+        for (unsigned int i = 0; i < count / 100; i++)
+        {
+            uint32_t node = pick(random);
+            graph.setLocal(node, glm::translate(graph.local(node), glm::vec3(0.0f, 0.01f, 0.0f)));
+        }
+    });
+}
+
+// an interior scene seen from benchmarkCamera: a row of rooms separated by walls with a door in each, and objects
+// cubes scattered through the rooms. Draws it with plain frustum culling and with the walls rasterized as occluders
+// first, and reports the cubes drawn and the frame times (CPU culling plus GPU, glFinish per frame). With a model path
+// the same is done for a model loaded with its CPU geometry, viewed from its center with its larger meshes as occluders.
+inline void benchmarkOcclusion(Shader& shader, Square& square, const std::string& modelPath = "", unsigned int objects = 10000, unsigned int frames = 20)
+{
+    PerFrameData camera = benchmarkCamera();
+    Frustum frustum = Frustum::fromMatrix(camera.viewProjection);
+    PrimitiveRegistry& registry = PrimitiveRegistry::instance();
+    const auto& cubeVertices = primitive_tables::CUBE_VERTICES;
+    const auto& cubeIndices = primitive_tables::CUBE_INDICES;
+    Bounds cubeBounds = Bounds::fromPositions(cubeVertices.data(), cubeVertices.size(), sizeof(PrimitiveVertex));
+
+    // rooms 10 units deep, 20 wide and 10 high; each wall has a 2 unit door somewhere
+    std::vector<glm::mat4> walls;
+    for (int room = 1; room <= 10; room++)
+    {
+        float z = -10.0f * room, door = static_cast<float>((room * 37) % 15 - 7);
+        walls.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3((door - 1.0f - 10.0f) * 0.5f, 0.0f, z)), glm::vec3(door - 1.0f + 10.0f, 10.0f, 0.25f)));
+        walls.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3((door + 1.0f + 10.0f) * 0.5f, 0.0f, z)), glm::vec3(10.0f - door - 1.0f, 10.0f, 0.25f)));
+    }
+    std::vector<glm::vec3> positions(objects);
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> across(-9.0f, 9.0f), up(-4.5f, 4.5f), along(-100.0f, -1.0f);
+    for (glm::vec3& position : positions)
+        position = glm::vec3(across(random), up(random), along(random));
+    const float scale = 0.5f;
+
+    auto time = [&](auto&& drawScene) {
+        auto frame = [&] {
+            GLState::instance().beginFrame();
+            FrameUniforms::instance().beginFrame(camera);
+            drawScene();
+            glFinish();
+        };
+        frame();
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < frames; i++)
+            frame();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    };
+    auto drawWalls = [&] {
+        for (const glm::mat4& wall : walls)
+        {
+            shader.setModel(wall);
+            registry.draw(registry.get(PrimitiveShape::Cube));
+        }
+    };
+
+    OcclusionCuller occlusion;
+    size_t frustumDrawn = 0, occlusionDrawn = 0;
+    double cullMs = 0.0;
+    double frustumMs = time([&] {
+        shader.use();
+        drawWalls();
+        frustumDrawn = 0;
+        for (const glm::vec3& position : positions)
+        {
+            if (!frustum.intersects(cubeBounds.transformed(Square::modelMatrix(position, scale))))
+                continue;
+            square.drawShape(position, scale, shader);
+            frustumDrawn++;
+        }
+    });
+    double occlusionMs = time([&] {
+        auto start = std::chrono::steady_clock::now();
+        occlusion.beginFrame(camera.viewProjection);
+        for (const glm::mat4& wall : walls)
+            occlusion.addOccluder(cubeVertices.data(), sizeof(PrimitiveVertex), cubeIndices.data(), cubeIndices.size(), wall);
+        occlusion.rasterize();
+        cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        shader.use();
+        drawWalls();
+        occlusionDrawn = 0;
+        for (const glm::vec3& position : positions)
+        {
+            glm::mat4 model = Square::modelMatrix(position, scale);
+            if (!frustum.intersects(cubeBounds.transformed(model)) || !occlusion.visible(cubeBounds, model))
+                continue;
+            square.drawShape(position, scale, shader);
+            occlusionDrawn++;
+        }
+    });
+    std::cout << "occlusion culling benchmark: " << objects << " cubes in " << walls.size() / 2 << " rooms, " << occlusion.width() << "x"
+              << occlusion.height() << " depth buffer, " << frames << " frames" << std::endl;
+    std::cout << "  frustum:             " << frustumDrawn << " cubes drawn, " << frustumMs << " ms/frame" << std::endl;
+    std::cout << "  frustum + occlusion: " << occlusionDrawn << " cubes drawn, " << occlusionMs << " ms/frame (occluders "
+              << cullMs / (frames + 1) << " ms)" << std::endl;
+    occlusion.stats().print("  last frame");
+
+    if (modelPath.empty())
+        return;
+    Model model(modelPath, false, true, true, true);
+    TextureLoader::instance().finish();
+    glm::mat4 placement = glm::translate(glm::mat4(1.0f), -model.bounds.center);
+    float minRadius = 0.1f * model.bounds.radius;
+    size_t occluders = 0;
+    frustumMs = time([&] {
+        shader.use();
+        model.Draw(shader, frustum, placement);
+        frustumDrawn = model.cullStats().visible;
+    });
+    cullMs = 0.0;
+    occlusionMs = time([&] {
+        auto start = std::chrono::steady_clock::now();
+        occlusion.beginFrame(camera.viewProjection);
+        occluders = model.addOccluders(occlusion, placement, minRadius);
+        occlusion.rasterize();
+        cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        shader.use();
+        model.Draw(shader, frustum, placement, occlusion);
+        occlusionDrawn = model.cullStats().visible - occlusion.stats().occluded;
+    });
+    std::cout << modelPath << ": " << model.meshes.size() << " meshes, " << occluders << " used as occluders" << std::endl;
+    std::cout << "  frustum:             " << frustumDrawn << " meshes drawn, " << frustumMs << " ms/frame" << std::endl;
+    std::cout << "  frustum + occlusion: " << occlusionDrawn << " meshes drawn, " << occlusionMs << " ms/frame (occluders "
+              << cullMs / (frames + 1) << " ms)" << std::endl;
+}
+
+// a field of objects mixed registry primitives in front of benchmarkCamera, drawn through GpuCuller on the CPU path
+// (a draw call per visible object) and, where the context has it, the GPU path (compute culling + one multi-draw),
+// each with plain frustum culling and with a wall across the view as a Hi-Z occluder. The GPU path's frustum count is
+// checked against the same box test done here on the CPU; the CPU path also culls by bounding sphere (FrustumCuller
+// keeps whichever reaches less far), so it can find fewer. With Hi-Z the GPU can only keep more (its pyramid is coarser
+// than the per pixel test).
+inline void benchmarkGpuCulling(Shader& fallbackShader, unsigned int objects = 20000, unsigned int frames = 20)
+{
+    PerFrameData camera = benchmarkCamera();
+    PrimitiveRegistry& registry = PrimitiveRegistry::instance();
+    const PrimitiveShape shapes[] = { PrimitiveShape::Cube, PrimitiveShape::Sphere, PrimitiveShape::Cylinder, PrimitiveShape::Capsule };
+    std::vector<GpuObject> scene(objects);
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> spread(-40.0f, 40.0f), distance(-90.0f, -2.0f), unit(0.0f, 1.0f);
+    for (unsigned int i = 0; i < objects; i++)
+    {
+        // translation and scale only, so the CPU's world boxes are exactly the boxes the GPU tests
+        scene[i].model = Square::modelMatrix(glm::vec3(spread(random), spread(random), distance(random)), 0.25f + 0.5f * unit(random));
+        scene[i].color = glm::vec4(unit(random), unit(random), unit(random), 1.0f);
+        scene[i].primitive = registry.get(shapes[i % 4]);
+    }
+    GpuCuller culler;
+    culler.setObjects(scene);
+
+    const auto& cubeVertices = primitive_tables::CUBE_VERTICES;
+    const auto& cubeIndices = primitive_tables::CUBE_INDICES;
+    glm::mat4 wall = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -12.0f)), glm::vec3(8.0f, 6.0f, 0.25f));
+    OcclusionCuller occlusion;
+
+    auto time = [&](auto&& drawScene) {
+        auto frame = [&] {
+            GLState::instance().beginFrame();
+            FrameUniforms::instance().beginFrame(camera);
+            drawScene();
+            glFinish();
+        };
+        frame();
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < frames; i++)
+            frame();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    };
+
+    std::cout << "GPU culling benchmark: " << objects << " objects, " << frames << " frames, GPU path "
+              << (GpuCuller::supported() ? "supported" : "not supported by this context") << std::endl;
+    // cull.comp's test: culled when the whole box is beyond one plane. Boxes just touching a plane can go either way,
+    // the GPU tests in clip space and this with normalized planes, so up to one in a thousand may differ.
+    Frustum frustum = Frustum::fromMatrix(camera.viewProjection);
+    size_t boxVisible = 0;
+    for (const GpuObject& object : scene)
+    {
+        Bounds world = object.primitive.bounds.transformed(object.model);
+        bool inside = true;
+        for (const glm::vec4& plane : frustum.planes)
+            if (glm::dot(glm::vec3(plane), world.center) + plane.w + glm::dot(glm::abs(glm::vec3(plane)), world.extents()) < 0.0f)
+                inside = false;
+        if (inside)
+            boxVisible++;
+    }
+    size_t tolerance = objects / 1000;
+    std::cout << "  box test on the CPU: " << boxVisible << " visible" << std::endl;
+    for (bool gpu : { false, true })
+    {
+        if (gpu && !GpuCuller::supported())
+            break;
+        culler.setForceCpu(!gpu);
+        for (bool hiZ : { false, true })
+        {
+            culler.setOcclusion(hiZ ? &occlusion : nullptr);
+            double cpuMs = 0.0;
+            double frameMs = time([&] {
+                if (hiZ)
+                {
+                    occlusion.beginFrame(camera.viewProjection);
+                    occlusion.addOccluder(cubeVertices.data(), sizeof(PrimitiveVertex), cubeIndices.data(), cubeIndices.size(), wall);
+                    occlusion.rasterize();
+                    fallbackShader.use();
+                    fallbackShader.setModel(wall);
+                    registry.draw(registry.get(PrimitiveShape::Cube));
+                }
+                culler.draw(camera.viewProjection, fallbackShader);
+                cpuMs += culler.stats().cpuMs;
+            });
+            size_t visible = culler.readVisibleCount();
+            bool mismatch = gpu && !hiZ && (visible > boxVisible + tolerance || visible + tolerance < boxVisible);
+            std::cout << "  " << (gpu ? "GPU" : "CPU") << (hiZ ? " + Hi-Z: " : ":        ") << visible << " visible, " << culler.stats().drawCalls
+                      << " draw calls, " << frameMs << " ms/frame (" << cpuMs / (frames + 1) << " ms CPU)"
+                      << (mismatch ? " (MISMATCH with the box test)" : "") << std::endl;
+        }
+    }
+    culler.clear();
+}
+
+// builds every program in shaders twice: first with the program binary cache emptied (cold start, everything compiled
+// from source), then again loading the binaries just written (warm start). Drivers keep shader caches of their own,
+// so the cold numbers can still be better than a true first run.
+inline void benchmarkShaderStartup(const std::vector<std::pair<std::string, std::string>>& shaders)
+{
+    ProgramCache& cache = ProgramCache::instance();
+    std::cout << "shader startup benchmark: " << shaders.size() << " programs, binary cache "
+              << (cache.supported() ? "supported" : "not supported by this driver") << std::endl;
+    cache.purge();
+    for (const char* run : { "cold", "warm" })
+    {
+        cache.resetStats();
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& shader : shaders)
+            Shader program(shader.first.c_str(), shader.second.c_str());
+        double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        ProgramCacheStats stats = cache.stats();
+        std::cout << "  " << run << ": " << wallMs << " ms total (" << stats.compiled << " compiled in " << stats.compileMs << " ms, "
+                  << stats.loaded << " loaded in " << stats.loadMs << " ms, " << stats.rejected << " rejected)" << std::endl;
+    }
+}
+
+// builds the permutations of multiple_lights.fs (point light counts x specular map x normal map) through the shader
+// library, once one at a time as draws would ask for them and once warmed together, both with the binary cache empty
+inline void benchmarkShaderVariants()
+{
+    std::vector<ShaderVariant> variants;
+    for (int lights : { 0, 1, 2, 4 })
+        for (int specular : { 0, 1 })
+            for (int normal : { 0, 1 })
+                variants.push_back({ "material2.vs", "multiple_lights.fs",
+                                     ShaderDefines().set("NR_POINT_LIGHTS", lights).set("HAS_SPECULAR_MAP", specular).set("HAS_NORMAL_MAP", normal) });
+
+    ShaderLibrary& library = ShaderLibrary::instance();
+    ProgramCache& cache = ProgramCache::instance();
+    std::cout << "shader variant benchmark: " << variants.size() << " permutations of multiple_lights.fs, parallel compile "
+              << (ProgramBuild::enableParallelCompile() ? "available" : "not available") << std::endl;
+    for (bool warm : { false, true })
+    {
+        library.clear();
+        cache.purge();
+        cache.resetStats();
+        auto start = std::chrono::steady_clock::now();
+        if (warm)
+            library.warm(variants);
+        else
+            for (const ShaderVariant& variant : variants)
+                library.get(variant);
+        double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << (warm ? "warmed together: " : "one at a time:   ") << wallMs << " ms (" << cache.stats().compiled << " compiled)" << std::endl;
+    }
+    library.clear();
+}
+
+#endif
@@ -0,0 +1,2 @@
+#define BOUNDS_IMPLEMENTATION
+#include "Bounds.h"
\ No newline at end of file
@@ -0,0 +1,102 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+// Axis-aligned box plus a bounding sphere around its center. The sphere is built from the actual points, so it is
+// usually tighter than the box's half diagonal; culling can use whichever of the two rejects more.
+struct Bounds {
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+    bool valid = false;   // false until a point was added
+
+    glm::vec3 extents() const { return (max - min) * 0.5f; }
+
+    // bounds of count positions, each three floats at the start of a stride byte record (every packed vertex format)
+    static Bounds fromPositions(const void* data, size_t count, size_t stride)
+    {
+        Bounds bounds;
+        if (count == 0)
+            return bounds;
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        glm::vec3 low(INFINITY), high(-INFINITY);
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 p = position(bytes + i * stride);
+            low = glm::min(low, p);
+            high = glm::max(high, p);
+        }
+        bounds.min = low;
+        bounds.max = high;
+        bounds.center = (low + high) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 offset = position(bytes + i * stride) - bounds.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        bounds.radius = std::sqrt(radiusSquared);
+        bounds.valid = true;
+        return bounds;
+    }
+
+    // grows to hold other as well; the sphere becomes the one around the merged box's center holding both spheres
+    void merge(const Bounds& other)
+    {
+        if (!other.valid)
+            return;
+        if (!valid)
+        {
+            *this = other;
+            return;
+        }
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+        glm::vec3 merged = (min + max) * 0.5f;
+        radius = std::max(glm::length(center - merged) + radius, glm::length(other.center - merged) + other.radius);
+        center = merged;
+    }
+
+    // the bounds after transform: the box is the one around the transformed box (Arvo's method), the sphere moves with
+    // its center and grows by the largest axis scale
+    Bounds transformed(const glm::mat4& transform) const
+    {
+        if (!valid)
+            return *this;
+        Bounds result;
+        glm::vec3 translation(transform[3]);
+        result.min = result.max = translation;
+        for (int column = 0; column < 3; column++)
+        {
+            for (int row = 0; row < 3; row++)
+            {
+                float a = transform[column][row] * min[column];
+                float b = transform[column][row] * max[column];
+                result.min[row] += std::min(a, b);
+                result.max[row] += std::max(a, b);
+            }
+        }
+        result.center = glm::vec3(transform * glm::vec4(center, 1.0f));
+        float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+        result.radius = radius * scale;
+        result.valid = true;
+        return result;
+    }
+
+private:
+    static glm::vec3 position(const unsigned char* record)
+    {
+        float xyz[3];
+        memcpy(xyz, record, sizeof(xyz));
+        return glm::vec3(xyz[0], xyz[1], xyz[2]);
+    }
+};
+
+#endif
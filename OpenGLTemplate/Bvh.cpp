@@ -0,0 +1,2 @@
+#define BVH_IMPLEMENTATION
+#include "Bvh.h"
\ No newline at end of file
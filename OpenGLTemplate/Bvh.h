@@ -0,0 +1,562 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+#include "FrustumCuller.h"
+#include "Mesh.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+// a ray for picking; hits count in [0, tMax)
+struct Ray {
+    glm::vec3 origin = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+    float tMax = INFINITY;
+
+    // the ray through window position (x, y), y pointing down, of a width x height view
+    static Ray fromScreen(float x, float y, float width, float height, const glm::mat4& viewProjection)
+    {
+        glm::mat4 inverse = glm::inverse(viewProjection);
+        float ndcX = 2.0f * x / width - 1.0f, ndcY = 1.0f - 2.0f * y / height;
+        glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+        glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+        Ray ray;
+        ray.origin = glm::vec3(nearPoint) / nearPoint.w;
+        ray.direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - ray.origin);
+        return ray;
+    }
+
+    // the ray in the space transform maps to, e.g. model space with the inverse model matrix. The direction isn't
+    // renormalized, so distances along the ray stay those of the original space.
+    Ray transformed(const glm::mat4& transform) const
+    {
+        Ray ray;
+        ray.origin = glm::vec3(transform * glm::vec4(origin, 1.0f));
+        ray.direction = glm::vec3(transform * glm::vec4(direction, 0.0f));
+        ray.tMax = tMax;
+        return ray;
+    }
+};
+
+struct RayHit {
+    static const uint32_t NONE = 0xffffffffu;
+    uint32_t primitive = NONE;   // index into the bounds the tree was built from
+    float t = INFINITY;
+
+    bool hit() const { return primitive != NONE; }
+};
+
+// shape and cost of the last build
+struct BvhStats {
+    size_t primitives = 0;
+    size_t nodes = 0;
+    size_t leaves = 0;
+    unsigned int depth = 0;
+    double buildMs = 0.0;
+};
+
+// Bounding volume hierarchy over boxes (objects, meshes or triangles), built top down with the surface area heuristic:
+// at every node the primitives' centroids are binned along each axis and the split with the lowest expected traversal
+// cost is taken, or none when testing the primitives directly is cheaper. Nodes are 32 bytes, children are stored next
+// to each other and after their parent, which is what lets refit() run as a single backwards pass. Queries only read
+// the tree, so several can run at once.
+class Bvh
+{
+public:
+    static const uint32_t MAX_LEAF_SIZE = 4;       // always split above this...
+    static const uint32_t MAX_SAH_LEAF_SIZE = 16;  // ...and never stop above this, whatever the heuristic says
+    static const int BINS = 16;
+
+    struct Node {
+        glm::vec3 min;
+        uint32_t  first;   // first primitive of a leaf, left child of an inner node (the right one is first + 1)
+        glm::vec3 max;
+        uint32_t  count;   // primitives of a leaf, 0 for inner nodes
+
+        bool leaf() const { return count > 0; }
+    };
+    static_assert(sizeof(Node) == 32, "Bvh::Node should stay 32 bytes");
+
+    void build(const std::vector<Bounds>& bounds)
+    {
+        auto start = std::chrono::steady_clock::now();
+        nodes.clear();
+        order.resize(bounds.size());
+        std::iota(order.begin(), order.end(), 0u);
+        buildStats = BvhStats();
+        buildStats.primitives = bounds.size();
+        if (!bounds.empty())
+        {
+            // a binary tree with at most one primitive per leaf has 2n - 1 nodes, so the node references below stay valid
+            nodes.reserve(2 * bounds.size());
+            nodes.push_back({ glm::vec3(0.0f), 0, glm::vec3(0.0f), static_cast<uint32_t>(bounds.size()) });
+            std::vector<std::pair<uint32_t, unsigned int>> stack = { { 0u, 1u } };
+            while (!stack.empty())
+            {
+                auto [index, depth] = stack.back();
+                stack.pop_back();
+                buildStats.depth = std::max(buildStats.depth, depth);
+                if (split(index, bounds))
+                {
+                    stack.push_back({ nodes[index].first, depth + 1 });
+                    stack.push_back({ nodes[index].first + 1, depth + 1 });
+                }
+                else
+                    buildStats.leaves++;
+            }
+        }
+        storeLeafBoxes(bounds);
+        buildStats.nodes = nodes.size();
+        buildStats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // refreshes every node's box for primitives that moved, keeping the topology. Much cheaper than build(), but the tree
+    // gets worse the further things move from where they were at build time; rebuild now and then. bounds has to list the
+    // same primitives as at build time (a different count rebuilds).
+    void refit(const std::vector<Bounds>& bounds)
+    {
+        if (bounds.size() != order.size())
+        {
+            build(bounds);
+            return;
+        }
+        storeLeafBoxes(bounds);
+        for (size_t n = nodes.size(); n-- > 0;)
+        {
+            Node& node = nodes[n];
+            if (node.leaf())
+            {
+                node.min = glm::vec3(INFINITY);
+                node.max = glm::vec3(-INFINITY);
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                {
+                    node.min = glm::min(node.min, leafMin[i]);
+                    node.max = glm::max(node.max, leafMax[i]);
+                }
+            }
+            else
+            {
+                node.min = glm::min(nodes[node.first].min, nodes[node.first + 1].min);
+                node.max = glm::max(nodes[node.first].max, nodes[node.first + 1].max);
+            }
+        }
+    }
+
+    bool empty() const { return nodes.empty(); }
+    size_t size() const { return order.size(); }
+    const BvhStats& stats() const { return buildStats; }
+
+    // the primitives whose boxes intersect frustum, in tree order. Subtrees completely inside a plane stop testing it,
+    // subtrees inside all of them are taken without any further test.
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+    {
+        visible.clear();
+        if (nodes.empty())
+            return;
+        const unsigned int ALL_PLANES = 0x3f;
+        std::vector<std::pair<uint32_t, unsigned int>> stack = { { 0u, ALL_PLANES } };
+        while (!stack.empty())
+        {
+            auto [index, planes] = stack.back();
+            stack.pop_back();
+            const Node& node = nodes[index];
+            int remaining = classify(frustum, node.min, node.max, planes);
+            if (remaining < 0)
+                continue;
+            if (!node.leaf())
+            {
+                stack.push_back({ node.first + 1, static_cast<unsigned int>(remaining) });
+                stack.push_back({ node.first, static_cast<unsigned int>(remaining) });
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+                if (remaining == 0 || classify(frustum, leafMin[i], leafMax[i], remaining) >= 0)
+                    visible.push_back(order[i]);
+        }
+    }
+
+    // closest hit along ray. test(primitive, tBox) is called for every primitive whose box the ray enters (at tBox)
+    // before the closest hit so far, and returns the primitive's own hit distance or INFINITY for a miss.
+    template<typename Test>
+    RayHit intersect(const Ray& ray, Test&& test) const
+    {
+        RayHit hit;
+        hit.t = ray.tMax;
+        if (nodes.empty())
+            return RayHit();
+        glm::vec3 inverse(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+        float entry;
+        if (!slab(nodes[0].min, nodes[0].max, ray.origin, inverse, hit.t, entry))
+            return RayHit();
+        // nodes with the distance the ray enters them, nearest child on top
+        std::vector<std::pair<uint32_t, float>> stack = { { 0u, entry } };
+        while (!stack.empty())
+        {
+            auto [index, nodeEntry] = stack.back();
+            stack.pop_back();
+            if (nodeEntry >= hit.t)
+                continue;
+            const Node& node = nodes[index];
+            if (node.leaf())
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                {
+                    float boxEntry;
+                    if (!slab(leafMin[i], leafMax[i], ray.origin, inverse, hit.t, boxEntry))
+                        continue;
+                    float t = test(order[i], boxEntry);
+                    if (t < hit.t)
+                    {
+                        hit.t = t;
+                        hit.primitive = order[i];
+                    }
+                }
+                continue;
+            }
+            float leftEntry, rightEntry;
+            bool left = slab(nodes[node.first].min, nodes[node.first].max, ray.origin, inverse, hit.t, leftEntry);
+            bool right = slab(nodes[node.first + 1].min, nodes[node.first + 1].max, ray.origin, inverse, hit.t, rightEntry);
+            if (left && right && leftEntry < rightEntry)
+            {
+                stack.push_back({ node.first + 1, rightEntry });
+                stack.push_back({ node.first, leftEntry });
+            }
+            else
+            {
+                if (left)
+                    stack.push_back({ node.first, leftEntry });
+                if (right)
+                    stack.push_back({ node.first + 1, rightEntry });
+            }
+        }
+        if (!hit.hit())
+            return RayHit();
+        return hit;
+    }
+
+    // closest primitive box along ray
+    RayHit intersect(const Ray& ray) const
+    {
+        return intersect(ray, [](uint32_t, float boxEntry) { return boxEntry; });
+    }
+
+    // four rays at once, e.g. neighbouring pixels or a cone of pick rays. Each node's box is tested against all four with
+    // SSE and the subtree is walked while any of them still hits it; test works as in intersect, per ray:
+    // test(primitive, tBox, rayIndex). Only pays off for coherent rays; four unrelated ones walk the union of their paths.
+    // Without SSE the rays are traced one by one.
+    template<typename Test>
+    void intersect4(const Ray* rays, RayHit* hits, Test&& test) const
+    {
+#if defined(FRUSTUMCULLER_SSE)
+        for (int r = 0; r < 4; r++)
+        {
+            hits[r] = RayHit();
+            hits[r].t = rays[r].tMax;
+        }
+        if (!nodes.empty())
+        {
+            alignas(16) float originX[4], originY[4], originZ[4], inverseX[4], inverseY[4], inverseZ[4];
+            glm::vec3 inverses[4];
+            for (int r = 0; r < 4; r++)
+            {
+                inverses[r] = glm::vec3(1.0f / rays[r].direction.x, 1.0f / rays[r].direction.y, 1.0f / rays[r].direction.z);
+                originX[r] = rays[r].origin.x;
+                originY[r] = rays[r].origin.y;
+                originZ[r] = rays[r].origin.z;
+                inverseX[r] = inverses[r].x;
+                inverseY[r] = inverses[r].y;
+                inverseZ[r] = inverses[r].z;
+            }
+            const __m128 ox = _mm_load_ps(originX), oy = _mm_load_ps(originY), oz = _mm_load_ps(originZ);
+            const __m128 ix = _mm_load_ps(inverseX), iy = _mm_load_ps(inverseY), iz = _mm_load_ps(inverseZ);
+            std::vector<uint32_t> stack = { 0u };
+            while (!stack.empty())
+            {
+                const Node& node = nodes[stack.back()];
+                stack.pop_back();
+                __m128 limit = _mm_setr_ps(hits[0].t, hits[1].t, hits[2].t, hits[3].t);
+                if (slab4(node.min, node.max, ox, oy, oz, ix, iy, iz, limit) == 0)
+                    continue;
+                if (!node.leaf())
+                {
+                    stack.push_back(node.first + 1);
+                    stack.push_back(node.first);
+                    continue;
+                }
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                {
+                    for (int r = 0; r < 4; r++)
+                    {
+                        float boxEntry;
+                        if (!slab(leafMin[i], leafMax[i], rays[r].origin, inverses[r], hits[r].t, boxEntry))
+                            continue;
+                        float t = test(order[i], boxEntry, r);
+                        if (t < hits[r].t)
+                        {
+                            hits[r].t = t;
+                            hits[r].primitive = order[i];
+                        }
+                    }
+                }
+            }
+        }
+        for (int r = 0; r < 4; r++)
+            if (!hits[r].hit())
+                hits[r] = RayHit();
+#else
+        for (int r = 0; r < 4; r++)
+            hits[r] = intersect(rays[r], [&](uint32_t primitive, float boxEntry) { return test(primitive, boxEntry, r); });
+#endif
+    }
+
+private:
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;                // primitive indices; leaves cover ranges of it
+    std::vector<glm::vec3> leafMin, leafMax;    // the primitives' boxes, parallel to order
+    BvhStats buildStats;
+
+    static glm::vec3 centroid(const Bounds& bounds) { return (bounds.min + bounds.max) * 0.5f; }
+
+    static float area(const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    void storeLeafBoxes(const std::vector<Bounds>& bounds)
+    {
+        leafMin.resize(order.size());
+        leafMax.resize(order.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            leafMin[i] = bounds[order[i]].min;
+            leafMax[i] = bounds[order[i]].max;
+        }
+    }
+
+    // sets the node's box and splits it in two children if that's worth it; false when it stays a leaf
+    bool split(uint32_t index, const std::vector<Bounds>& bounds)
+    {
+        uint32_t first = nodes[index].first, count = nodes[index].count;
+        glm::vec3 min(INFINITY), max(-INFINITY), centroidMin(INFINITY), centroidMax(-INFINITY);
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            const Bounds& primitive = bounds[order[i]];
+            min = glm::min(min, primitive.min);
+            max = glm::max(max, primitive.max);
+            centroidMin = glm::min(centroidMin, centroid(primitive));
+            centroidMax = glm::max(centroidMax, centroid(primitive));
+        }
+        nodes[index].min = min;
+        nodes[index].max = max;
+        if (count <= MAX_LEAF_SIZE)
+            return false;
+
+        // binned SAH over all three axes. Costs are in units of one primitive test, with a node visit costing the same.
+        struct Bin {
+            glm::vec3 min = glm::vec3(INFINITY), max = glm::vec3(-INFINITY);
+            uint32_t count = 0;
+        };
+        float bestCost = INFINITY;
+        int bestAxis = -1, bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f)
+                continue;
+            Bin bins[BINS];
+            float scale = BINS / extent;
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                const Bounds& primitive = bounds[order[i]];
+                Bin& bin = bins[std::min(BINS - 1, static_cast<int>((centroid(primitive)[axis] - centroidMin[axis]) * scale))];
+                bin.min = glm::min(bin.min, primitive.min);
+                bin.max = glm::max(bin.max, primitive.max);
+                bin.count++;
+            }
+            // areas and counts left of each split plane, then swept from the right
+            float leftArea[BINS - 1];
+            uint32_t leftCount[BINS - 1];
+            Bin left;
+            for (int b = 0; b < BINS - 1; b++)
+            {
+                left.min = glm::min(left.min, bins[b].min);
+                left.max = glm::max(left.max, bins[b].max);
+                left.count += bins[b].count;
+                leftArea[b] = left.count ? area(left.min, left.max) : 0.0f;
+                leftCount[b] = left.count;
+            }
+            Bin right;
+            for (int b = BINS - 1; b > 0; b--)
+            {
+                right.min = glm::min(right.min, bins[b].min);
+                right.max = glm::max(right.max, bins[b].max);
+                right.count += bins[b].count;
+                int split = b - 1;
+                if (leftCount[split] == 0 || right.count == 0)
+                    continue;
+                float cost = leftArea[split] * leftCount[split] + area(right.min, right.max) * right.count;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+        // every centroid in the same place: nothing to split by
+        if (bestAxis < 0)
+            return false;
+        float parentArea = area(min, max);
+        if (count <= MAX_SAH_LEAF_SIZE && parentArea > 0.0f && 1.0f + bestCost / parentArea >= static_cast<float>(count))
+            return false;
+
+        float scale = BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        uint32_t* middle = std::partition(order.data() + first, order.data() + first + count, [&](uint32_t primitive) {
+            return std::min(BINS - 1, static_cast<int>((centroid(bounds[primitive])[bestAxis] - centroidMin[bestAxis]) * scale)) <= bestSplit;
+        });
+        uint32_t leftCount = static_cast<uint32_t>(middle - (order.data() + first));
+
+        uint32_t left = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({ glm::vec3(0.0f), first, glm::vec3(0.0f), leftCount });
+        nodes.push_back({ glm::vec3(0.0f), first + leftCount, glm::vec3(0.0f), count - leftCount });
+        nodes[index].first = left;
+        nodes[index].count = 0;
+        return true;
+    }
+
+    // -1 if the box is behind one of the planes in the mask, otherwise the planes of the mask it still crosses
+    static int classify(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max, unsigned int planes)
+    {
+        glm::vec3 center = (min + max) * 0.5f, extents = (max - min) * 0.5f;
+        for (int p = 0; p < 6; p++)
+        {
+            unsigned int bit = 1u << p;
+            if (!(planes & bit))
+                continue;
+            const glm::vec4& plane = frustum.planes[p];
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float reach = glm::dot(glm::abs(glm::vec3(plane)), extents);
+            if (distance + reach < 0.0f)
+                return -1;
+            if (distance - reach >= 0.0f)
+                planes &= ~bit;
+        }
+        return static_cast<int>(planes);
+    }
+
+    // slab test; entry is where the ray enters the box (0 if it starts inside)
+    static bool slab(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin, const glm::vec3& inverse, float tMax, float& entry)
+    {
+        float near = 0.0f, far = tMax;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t0 = (min[axis] - origin[axis]) * inverse[axis];
+            float t1 = (max[axis] - origin[axis]) * inverse[axis];
+            near = std::max(near, std::min(t0, t1));
+            far = std::min(far, std::max(t0, t1));
+        }
+        entry = near;
+        return near <= far;
+    }
+
+#if defined(FRUSTUMCULLER_SSE)
+    // the same for four rays; bit r of the result is set when ray r hits the box before limit[r]
+    static int slab4(const glm::vec3& min, const glm::vec3& max, __m128 ox, __m128 oy, __m128 oz, __m128 ix, __m128 iy, __m128 iz, __m128 limit)
+    {
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.x), ox), ix), t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.x), ox), ix);
+        __m128 near = _mm_max_ps(_mm_setzero_ps(), _mm_min_ps(t0, t1)), far = _mm_min_ps(limit, _mm_max_ps(t0, t1));
+        t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.y), oy), iy);
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.y), oy), iy);
+        near = _mm_max_ps(near, _mm_min_ps(t0, t1));
+        far = _mm_min_ps(far, _mm_max_ps(t0, t1));
+        t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.z), oz), iz);
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.z), oz), iz);
+        near = _mm_max_ps(near, _mm_min_ps(t0, t1));
+        far = _mm_min_ps(far, _mm_max_ps(t0, t1));
+        return _mm_movemask_ps(_mm_cmple_ps(near, far));
+    }
+#endif
+};
+
+// The second level: a BVH over the triangles of one mesh, for exact picking. Needs the mesh's CPU copy of its geometry
+// (Model's keepGeometry); the triangle corners are copied out at build time so the mesh may drop it afterwards.
+class TriangleBvh
+{
+public:
+    // false if the mesh has no CPU geometry to build from
+    bool build(const Mesh& mesh)
+    {
+        corners.clear();
+        if (mesh.vertexData.empty() || mesh.indices.empty())
+            return false;
+        size_t stride = static_cast<size_t>(vertexStride(mesh.format));
+        for (const MeshRange& range : mesh.ranges)
+        {
+            for (uint32_t i = range.firstIndex; i < range.firstIndex + range.indexCount; i++)
+            {
+                float xyz[3];
+                memcpy(xyz, mesh.vertexData.data() + (range.baseVertex + mesh.indices[i]) * stride, sizeof(xyz));
+                corners.push_back(glm::vec3(xyz[0], xyz[1], xyz[2]));
+            }
+        }
+        std::vector<Bounds> boxes(corners.size() / 3);
+        for (size_t t = 0; t < boxes.size(); t++)
+        {
+            boxes[t].min = glm::min(corners[t * 3], glm::min(corners[t * 3 + 1], corners[t * 3 + 2]));
+            boxes[t].max = glm::max(corners[t * 3], glm::max(corners[t * 3 + 1], corners[t * 3 + 2]));
+            boxes[t].center = (boxes[t].min + boxes[t].max) * 0.5f;
+            boxes[t].valid = true;
+        }
+        tree.build(boxes);
+        return true;
+    }
+
+    bool empty() const { return tree.empty(); }
+    size_t triangleCount() const { return corners.size() / 3; }
+
+    // closest triangle along ray (primitive is the triangle index)
+    RayHit intersect(const Ray& ray) const
+    {
+        return tree.intersect(ray, [&](uint32_t triangle, float) { return intersectTriangle(ray, triangle); });
+    }
+
+private:
+    Bvh tree;
+    std::vector<glm::vec3> corners;   // three per triangle
+
+    // Moller-Trumbore, both sides; INFINITY for a miss
+    float intersectTriangle(const Ray& ray, uint32_t triangle) const
+    {
+        const glm::vec3& a = corners[triangle * 3];
+        glm::vec3 edge1 = corners[triangle * 3 + 1] - a, edge2 = corners[triangle * 3 + 2] - a;
+        glm::vec3 p = glm::cross(ray.direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (std::fabs(determinant) < 1e-12f)
+            return INFINITY;
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = ray.origin - a;
+        float u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return INFINITY;
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(ray.direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            return INFINITY;
+        float t = glm::dot(edge2, q) * inverse;
+        return t >= 0.0f ? t : INFINITY;
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define FILEWATCHER_IMPLEMENTATION
+#include "FileWatcher.h"
\ No newline at end of file
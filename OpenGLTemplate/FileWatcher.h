@@ -0,0 +1,145 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+// Reports files that changed on disk, without blocking. On Linux the directories of the watched files are watched with
+// inotify (editors often save by writing a new file and renaming it over the old one, so watching the file itself
+// would lose it); elsewhere, or if inotify is unavailable, the modification times are polled every POLL_INTERVAL.
+class FileWatcher
+{
+public:
+    static constexpr std::chrono::milliseconds POLL_INTERVAL{ 250 };
+
+    FileWatcher()
+    {
+#ifdef __linux__
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    }
+
+    ~FileWatcher()
+    {
+#ifdef __linux__
+        if (inotifyFd >= 0)
+            close(inotifyFd);
+#endif
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // starts watching path; changed() reports it under the normalized name returned here
+    std::string add(const std::string& path)
+    {
+        std::string name = normalize(path);
+        if (!files.insert({ name, modificationTime(name) }).second)
+            return name;
+#ifdef __linux__
+        if (inotifyFd >= 0)
+        {
+            std::string directory = std::filesystem::path(name).parent_path().string();
+            bool watched = false;
+            for (const auto& entry : directories)
+                watched = watched || entry.second == directory;
+            if (!watched)
+            {
+                int wd = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+                if (wd >= 0)
+                    directories[wd] = directory;
+            }
+        }
+#endif
+        return name;
+    }
+
+    // true if changes are noticed as they happen rather than by polling
+    bool usesNotifications() const
+    {
+#ifdef __linux__
+        return inotifyFd >= 0 && !directories.empty();
+#else
+        return false;
+#endif
+    }
+
+    // the watched files modified since the last call, each once
+    std::vector<std::string> changed()
+    {
+        std::set<std::string> result;
+#ifdef __linux__
+        if (usesNotifications())
+        {
+            alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+            ssize_t length;
+            while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* event = buffer; event < buffer + length;)
+                {
+                    const inotify_event* notification = reinterpret_cast<const inotify_event*>(event);
+                    auto directory = directories.find(notification->wd);
+                    if (directory != directories.end() && notification->len > 0)
+                    {
+                        std::string name = (std::filesystem::path(directory->second) / notification->name).string();
+                        if (files.count(name))
+                            result.insert(name);
+                    }
+                    event += sizeof(inotify_event) + notification->len;
+                }
+            }
+            return std::vector<std::string>(result.begin(), result.end());
+        }
+#endif
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastPoll < POLL_INTERVAL)
+            return {};
+        lastPoll = now;
+        for (auto& file : files)
+        {
+            std::filesystem::file_time_type time = modificationTime(file.first);
+            if (time != file.second)
+            {
+                file.second = time;
+                result.insert(file.first);
+            }
+        }
+        return std::vector<std::string>(result.begin(), result.end());
+    }
+
+    // the name add() gives path
+    static std::string normalize(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::path absolute = std::filesystem::absolute(path, error);
+        return (error ? std::filesystem::path(path) : absolute).lexically_normal().string();
+    }
+
+private:
+    std::map<std::string, std::filesystem::file_time_type> files;   // modification times, for polling
+    std::chrono::steady_clock::time_point lastPoll;
+#ifdef __linux__
+    int inotifyFd = -1;
+    std::map<int, std::string> directories;   // watch descriptor -> directory
+#endif
+
+    static std::filesystem::file_time_type modificationTime(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+        return error ? std::filesystem::file_time_type() : time;
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define FRAMEUNIFORMS_IMPLEMENTATION
+#include "FrameUniforms.h"
\ No newline at end of file
@@ -0,0 +1,190 @@
+#ifndef FRAMEUNIFORMS_H
+#define FRAMEUNIFORMS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "GLHandles.h"
+#include "GLState.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// std140 layout of the PerFrame block:
+//
+//   layout (std140) uniform PerFrame { mat4 view; mat4 projection; mat4 viewProjection; vec3 cameraPosition; float time; };
+struct PerFrameData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec3 cameraPosition;
+    float     time;   // packs into the vec3's padding
+};
+static_assert(sizeof(PerFrameData) == 208, "PerFrameData must match the std140 PerFrame block");
+
+// std140 layout of the PerDraw block (the normal matrix is a mat4 so it needs no column padding):
+//
+//   layout (std140) uniform PerDraw { mat4 model; mat4 normalMatrix; };
+struct PerDrawData {
+    glm::mat4 model;
+    glm::mat4 normalMatrix;
+};
+static_assert(sizeof(PerDrawData) == 128, "PerDrawData must match the std140 PerDraw block");
+
+// uniform buffer traffic of one frame
+struct FrameUniformStats {
+    size_t draws = 0;         // PerDraw ranges written
+    size_t uploads = 0;       // glBufferSubData calls, PerFrame included
+    size_t bytes = 0;
+    size_t wraps = 0;         // times a frame ran out of ring space and reused its own segment
+};
+
+// The uniform buffers every program shares. PerFrame is uploaded once per frame and stays bound at PER_FRAME_BINDING;
+// PerDraw data is written into a ring buffer split into one segment per frame in flight, each draw getting its own
+// aligned range that is bound at PER_DRAW_BINDING. glBufferSubData is ordered against earlier draws, so the ring isn't
+// needed for correctness: it keeps the driver from having to stall on, or copy around, ranges the GPU may still be
+// reading. Programs pick the blocks up through Shader, which binds them to these points at link time. GL thread only.
+class FrameUniforms
+{
+public:
+    static const GLuint PER_FRAME_BINDING = 0;
+    static const GLuint PER_DRAW_BINDING = 1;
+    static const size_t FRAMES_IN_FLIGHT = 3;
+    static const size_t SEGMENT_SIZE = 2 * 1024 * 1024;   // per frame: 8192 draws at the usual 256 byte alignment
+
+    static FrameUniforms& instance()
+    {
+        static FrameUniforms uniforms;
+        return uniforms;
+    }
+
+    FrameUniforms(const FrameUniforms&) = delete;
+    FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+    // uploads the frame's shared data and moves on to the next ring segment; call before any draw data is written
+    void beginFrame(const PerFrameData& data)
+    {
+        if (!perFrame)
+            create();
+        lastFrame = frame;
+        frame = FrameUniformStats();
+        segment = (segment + 1) % FRAMES_IN_FLIGHT;
+        cursor = segment * SEGMENT_SIZE;
+
+        upload(perFrame.get(), 0, &data, sizeof(data));
+        GLState::instance().bindUniformBuffer(PER_FRAME_BINDING, perFrame.get());
+    }
+
+    // writes the per-draw data of one model matrix and binds it for the next draw
+    void pushDraw(const glm::mat4& model)
+    {
+        PerDrawData data = perDraw(model);
+        bindDraw(writeDraws(&data, 1));
+    }
+
+    // writes count (at most maxDraws()) consecutive draws in one upload; draw i is at the returned offset + i * drawStride()
+    GLintptr writeDraws(const PerDrawData* draws, size_t count)
+    {
+        if (count > maxDraws())
+        {
+            std::cout << "ERROR::FRAME_UNIFORMS::TOO_MANY_DRAWS: " << count << " draws don't fit a " << SEGMENT_SIZE << " byte segment" << std::endl;
+            count = maxDraws();
+        }
+        size_t bytes = count * stride;
+        size_t segmentEnd = (segment + 1) * SEGMENT_SIZE;
+        if (cursor + bytes > segmentEnd)
+        {
+            cursor = segment * SEGMENT_SIZE;
+            frame.wraps++;
+        }
+
+        // spread the draws out to the offset alignment
+        staging.resize(bytes);
+        for (size_t i = 0; i < count; i++)
+            memcpy(staging.data() + i * stride, &draws[i], sizeof(PerDrawData));
+        GLintptr offset = static_cast<GLintptr>(cursor);
+        upload(ring.get(), offset, staging.data(), bytes);
+        cursor += bytes;
+        frame.draws += count;
+        return offset;
+    }
+
+    // binds the PerDraw range written at offset
+    void bindDraw(GLintptr offset)
+    {
+        GLState::instance().bindUniformBuffer(PER_DRAW_BINDING, ring.get(), offset, sizeof(PerDrawData));
+    }
+
+    // distance between consecutive draws written by writeDraws
+    size_t drawStride() const { return stride; }
+
+    // most draws a single writeDraws can take
+    size_t maxDraws() const { return SEGMENT_SIZE / stride; }
+
+    static PerDrawData perDraw(const glm::mat4& model)
+    {
+        return { model, glm::mat4(glm::transpose(glm::inverse(glm::mat3(model)))) };
+    }
+
+    // traffic of the last complete frame
+    FrameUniformStats stats() const { return lastFrame; }
+
+    void printStats() const
+    {
+        std::cout << "uniform buffers: " << lastFrame.draws << " per-draw ranges in " << lastFrame.uploads << " uploads, "
+                  << lastFrame.bytes / 1024 << " KiB, " << lastFrame.wraps << " ring wraps last frame" << std::endl;
+    }
+
+    // deletes the buffers; call while the context is still current
+    void clear()
+    {
+        perFrame.reset();
+        ring.reset();
+    }
+
+private:
+    GLBuffer perFrame;
+    GLBuffer ring;
+    size_t stride = 256;
+    size_t segment = 0;
+    size_t cursor = 0;
+    std::vector<unsigned char> staging;
+    FrameUniformStats frame, lastFrame;
+
+    FrameUniforms() {}
+
+    ~FrameUniforms()
+    {
+        // never touches GL here: the context is usually gone by the time statics are destroyed (see clear())
+        perFrame.release();
+        ring.release();
+    }
+
+    void create()
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (sizeof(PerDrawData) + alignment - 1) / alignment * alignment;
+
+        GLState& state = GLState::instance();
+        perFrame = GLBuffer::create();
+        state.bindBuffer(GL_UNIFORM_BUFFER, perFrame.get());
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(PerFrameData), nullptr, GL_DYNAMIC_DRAW);
+        ring = GLBuffer::create();
+        state.bindBuffer(GL_UNIFORM_BUFFER, ring.get());
+        glBufferData(GL_UNIFORM_BUFFER, FRAMES_IN_FLIGHT * SEGMENT_SIZE, nullptr, GL_STREAM_DRAW);
+    }
+
+    void upload(GLuint buffer, GLintptr offset, const void* data, size_t bytes)
+    {
+        GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, static_cast<GLsizeiptr>(bytes), data);
+        frame.uploads++;
+        frame.bytes += bytes;
+    }
+};
+
+#endif
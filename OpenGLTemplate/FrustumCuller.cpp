@@ -0,0 +1,2 @@
+#define FRUSTUMCULLER_IMPLEMENTATION
+#include "FrustumCuller.h"
\ No newline at end of file
@@ -0,0 +1,304 @@
+#ifndef FRUSTUMCULLER_H
+#define FRUSTUMCULLER_H
+
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// the SIMD kernels are picked at compile time: AVX2 when the build targets it (/arch:AVX2), SSE on any x64 build
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FRUSTUMCULLER_AVX2 1
+#endif
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define FRUSTUMCULLER_SSE 1
+#endif
+
+// the six planes of a view frustum, pointing inwards; a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+    glm::vec4 planes[6];   // left, right, bottom, top, near, far
+
+    // Gribb/Hartmann extraction from a projection * view (or projection * view * model) matrix; the planes are then
+    // in the space that matrix transforms from
+    static Frustum fromMatrix(const glm::mat4& m)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        Frustum frustum;
+        frustum.planes[0] = rows[3] + rows[0];
+        frustum.planes[1] = rows[3] - rows[0];
+        frustum.planes[2] = rows[3] + rows[1];
+        frustum.planes[3] = rows[3] - rows[1];
+        frustum.planes[4] = rows[3] + rows[2];
+        frustum.planes[5] = rows[3] - rows[2];
+        for (glm::vec4& plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    // the planes in the space transform maps from, e.g. model space for a model matrix, so model space bounds can be
+    // tested without transforming them
+    Frustum transformed(const glm::mat4& transform) const
+    {
+        Frustum frustum;
+        for (int p = 0; p < 6; p++)
+        {
+            glm::vec4 plane(glm::dot(transform[0], planes[p]), glm::dot(transform[1], planes[p]), glm::dot(transform[2], planes[p]), glm::dot(transform[3], planes[p]));
+            frustum.planes[p] = plane / glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    // single bounds test, same rule as the culling kernels
+    bool intersects(const Bounds& bounds) const
+    {
+        glm::vec3 extents = bounds.extents();
+        for (const glm::vec4& plane : planes)
+        {
+            float distance = glm::dot(glm::vec3(plane), bounds.center) + plane.w;
+            float reach = std::min(bounds.radius, glm::dot(glm::abs(glm::vec3(plane)), extents));
+            if (distance + reach < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+enum class CullKernel : uint32_t {
+    Scalar,
+    SSE,    // 4 bounds per step
+    AVX2,   // 8 bounds per step
+    Bvh     // a bounding volume hierarchy walk (see Bvh::cull), not a FrustumCuller kernel
+};
+
+inline const char* cullKernelName(CullKernel kernel)
+{
+    switch (kernel)
+    {
+    case CullKernel::SSE: return "SSE";
+    case CullKernel::AVX2: return "AVX2";
+    case CullKernel::Bvh: return "BVH";
+    default: return "scalar";
+    }
+}
+
+// the last cull() of a culler
+struct CullStats {
+    size_t tested = 0;
+    size_t visible = 0;
+    double ms = 0.0;
+    CullKernel kernel = CullKernel::Scalar;
+
+    float culledFraction() const { return tested > 0 ? 1.0f - static_cast<float>(visible) / tested : 0.0f; }
+
+    void print(const char* what) const
+    {
+        std::cout << what << ": " << visible << " / " << tested << " visible (" << culledFraction() * 100.0f << "% culled) in "
+                  << ms * 1000.0 << " us, " << cullKernelName(kernel) << std::endl;
+    }
+};
+
+// Tests many world space bounds against a frustum at once. Bounds are stored structure of arrays (center, box extents
+// and sphere radius in separate streams), so the kernels load 4 or 8 of each with one instruction and test them against
+// each plane together. A bound is culled when its box or its sphere, whichever reaches less far, is completely
+// behind any plane. Both are conservative, so taking the smaller reach stays conservative too.
+class FrustumCuller
+{
+public:
+    // the fastest kernel this build has
+    static CullKernel best()
+    {
+#if defined(FRUSTUMCULLER_AVX2)
+        return CullKernel::AVX2;
+#elif defined(FRUSTUMCULLER_SSE)
+        return CullKernel::SSE;
+#else
+        return CullKernel::Scalar;
+#endif
+    }
+
+    static bool supported(CullKernel kernel)
+    {
+        switch (kernel)
+        {
+#if defined(FRUSTUMCULLER_AVX2)
+        case CullKernel::AVX2: return true;
+#endif
+#if defined(FRUSTUMCULLER_SSE)
+        case CullKernel::SSE: return true;
+#endif
+        case CullKernel::Scalar: return true;
+        default: return false;
+        }
+    }
+
+    void clear()
+    {
+        for (std::vector<float>* stream : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius })
+            stream->clear();
+    }
+
+    void reserve(size_t count)
+    {
+        for (std::vector<float>* stream : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius })
+            stream->reserve(count);
+    }
+
+    // adds world space bounds and returns their index; invalid bounds (empty meshes) are never visible
+    uint32_t add(const Bounds& bounds)
+    {
+        glm::vec3 extents = bounds.extents();
+        centerX.push_back(bounds.center.x);
+        centerY.push_back(bounds.center.y);
+        centerZ.push_back(bounds.center.z);
+        extentX.push_back(extents.x);
+        extentY.push_back(extents.y);
+        extentZ.push_back(extents.z);
+        radius.push_back(bounds.valid ? bounds.radius : -INFINITY);
+        return static_cast<uint32_t>(radius.size() - 1);
+    }
+
+    size_t size() const { return radius.size(); }
+
+    // indices of the bounds that intersect frustum, ascending. Falls back to the best supported kernel.
+    const std::vector<uint32_t>& cull(const Frustum& frustum, CullKernel kernel = best())
+    {
+        if (!supported(kernel))
+            kernel = best();
+        auto start = std::chrono::steady_clock::now();
+        visible.clear();
+        Planes planes(frustum);
+        size_t first = 0;
+        switch (kernel)
+        {
+#if defined(FRUSTUMCULLER_AVX2)
+        case CullKernel::AVX2: first = cullAVX2(planes); break;
+#endif
+#if defined(FRUSTUMCULLER_SSE)
+        case CullKernel::SSE: first = cullSSE(planes); break;
+#endif
+        default: break;
+        }
+        cullScalar(planes, first);
+
+        last.tested = size();
+        last.visible = visible.size();
+        last.kernel = kernel;
+        last.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return visible;
+    }
+
+    const CullStats& stats() const { return last; }
+
+private:
+    std::vector<float> centerX, centerY, centerZ, extentX, extentY, extentZ, radius;
+    std::vector<uint32_t> visible;
+    CullStats last;
+
+    // the planes split into components, with the absolute normals the box extents are projected on
+    struct Planes {
+        float x[6], y[6], z[6], w[6], absX[6], absY[6], absZ[6];
+
+        explicit Planes(const Frustum& frustum)
+        {
+            for (int p = 0; p < 6; p++)
+            {
+                x[p] = frustum.planes[p].x;
+                y[p] = frustum.planes[p].y;
+                z[p] = frustum.planes[p].z;
+                w[p] = frustum.planes[p].w;
+                absX[p] = std::fabs(x[p]);
+                absY[p] = std::fabs(y[p]);
+                absZ[p] = std::fabs(z[p]);
+            }
+        }
+    };
+
+    // bounds [first, size())
+    void cullScalar(const Planes& planes, size_t first)
+    {
+        for (size_t i = first; i < radius.size(); i++)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++)
+            {
+                float distance = planes.x[p] * centerX[i] + planes.y[p] * centerY[i] + planes.z[p] * centerZ[i] + planes.w[p];
+                float reach = std::min(radius[i], planes.absX[p] * extentX[i] + planes.absY[p] * extentY[i] + planes.absZ[p] * extentZ[i]);
+                inside = distance + reach >= 0.0f;
+            }
+            if (inside)
+                visible.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+#if defined(FRUSTUMCULLER_SSE)
+    // whole groups of 4; returns where the scalar tail starts
+    size_t cullSSE(const Planes& planes)
+    {
+        size_t count = radius.size() & ~size_t(3);
+        const __m128 zero = _mm_setzero_ps();
+        for (size_t i = 0; i < count; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(&centerX[i]), y = _mm_loadu_ps(&centerY[i]), z = _mm_loadu_ps(&centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+            __m128 r = _mm_loadu_ps(&radius[i]);
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.x[p]), x), _mm_mul_ps(_mm_set1_ps(planes.y[p]), y)),
+                                             _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.z[p]), z), _mm_set1_ps(planes.w[p])));
+                __m128 projected = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.absX[p]), ex), _mm_mul_ps(_mm_set1_ps(planes.absY[p]), ey)),
+                                              _mm_mul_ps(_mm_set1_ps(planes.absZ[p]), ez));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, _mm_min_ps(r, projected)), zero));
+            }
+            appendLanes(_mm_movemask_ps(inside), 4, i);
+        }
+        return count;
+    }
+#endif
+
+#if defined(FRUSTUMCULLER_AVX2)
+    // whole groups of 8; returns where the scalar tail starts
+    size_t cullAVX2(const Planes& planes)
+    {
+        size_t count = radius.size() & ~size_t(7);
+        const __m256 zero = _mm256_setzero_ps();
+        for (size_t i = 0; i < count; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(&centerX[i]), y = _mm256_loadu_ps(&centerY[i]), z = _mm256_loadu_ps(&centerZ[i]);
+            __m256 ex = _mm256_loadu_ps(&extentX[i]), ey = _mm256_loadu_ps(&extentY[i]), ez = _mm256_loadu_ps(&extentZ[i]);
+            __m256 r = _mm256_loadu_ps(&radius[i]);
+            __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+            for (int p = 0; p < 6; p++)
+            {
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.x[p]), x), _mm256_mul_ps(_mm256_set1_ps(planes.y[p]), y)),
+                                                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.z[p]), z), _mm256_set1_ps(planes.w[p])));
+                __m256 projected = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.absX[p]), ex), _mm256_mul_ps(_mm256_set1_ps(planes.absY[p]), ey)),
+                                                 _mm256_mul_ps(_mm256_set1_ps(planes.absZ[p]), ez));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, _mm256_min_ps(r, projected)), zero, _CMP_GE_OQ));
+            }
+            appendLanes(_mm256_movemask_ps(inside), 8, i);
+        }
+        return count;
+    }
+#endif
+
+    void appendLanes(int mask, int lanes, size_t first)
+    {
+        for (int lane = 0; lane < lanes; lane++)
+            if (mask & (1 << lane))
+                visible.push_back(static_cast<uint32_t>(first + lane));
+    }
+};
+
+#endif
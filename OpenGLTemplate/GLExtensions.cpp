@@ -0,0 +1,2 @@
+#define GLEXTENSIONS_IMPLEMENTATION
+#include "GLExtensions.h"
\ No newline at end of file
@@ -0,0 +1,129 @@
+#ifndef GLEXTENSIONS_H
+#define GLEXTENSIONS_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+// The glad the project links is generated for GL 3.3 core without extensions, so everything newer is looked up here at
+// runtime instead: availability from the context's version and glfwExtensionSupported, entry points through
+// glfwGetProcAddress. Their enums and function pointer types are declared locally with the values from the Khronos
+// registry; the #ifndefs let a glad that does have them win. Drivers usually hand out their newest core profile for a
+// 3.3 request, so these are commonly there. instance() loads on first use, which needs a current context. GL thread only.
+
+// GL 4.0 / ARB_draw_indirect
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// GL 4.1 / ARB_get_program_binary
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// GL 4.3 compute shaders, shader storage buffers and GL 4.2 barriers
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS
+#define GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS 0x90D6
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+
+// KHR_parallel_shader_compile (ARB_parallel_shader_compile uses the same value)
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+class GLExtensions
+{
+public:
+    typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+    typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+    typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+    typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+    typedef void (APIENTRYP DispatchComputeProc)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+    typedef void (APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+    typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+
+    // the context's version as major * 10 + minor, e.g. 46
+    int version = 0;
+
+    // program binaries: GL 4.1 or ARB_get_program_binary (same entry point names)
+    bool hasProgramBinary = false;
+    ProgramParameteriProc programParameteri = nullptr;
+    ProgramBinaryProc programBinary = nullptr;
+    GetProgramBinaryProc getProgramBinary = nullptr;
+
+    // driver side compile threads: KHR_parallel_shader_compile or its ARB twin
+    bool hasParallelShaderCompile = false;
+    MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+
+    // GPU driven drawing: GL 4.3 compute, storage buffers and indirect multi-draw. Only checked against the version, the
+    // ARB extensions it bundles are too many to be worth it.
+    bool hasComputeIndirect = false;
+    DispatchComputeProc dispatchCompute = nullptr;
+    MemoryBarrierProc memoryBarrier = nullptr;
+    MultiDrawElementsIndirectProc multiDrawElementsIndirect = nullptr;
+
+    static GLExtensions& instance()
+    {
+        static GLExtensions extensions;
+        return extensions;
+    }
+
+    GLExtensions(const GLExtensions&) = delete;
+    GLExtensions& operator=(const GLExtensions&) = delete;
+
+private:
+    GLExtensions()
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        version = major * 10 + minor;
+
+        if (version >= 41 || glfwExtensionSupported("GL_ARB_get_program_binary"))
+        {
+            load(programParameteri, "glProgramParameteri");
+            load(programBinary, "glProgramBinary");
+            load(getProgramBinary, "glGetProgramBinary");
+            hasProgramBinary = programParameteri && programBinary && getProgramBinary;
+        }
+
+        if (version >= 43)
+        {
+            load(dispatchCompute, "glDispatchCompute");
+            load(memoryBarrier, "glMemoryBarrier");
+            load(multiDrawElementsIndirect, "glMultiDrawElementsIndirect");
+            hasComputeIndirect = dispatchCompute && memoryBarrier && multiDrawElementsIndirect;
+        }
+
+        if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+            load(maxShaderCompilerThreads, "glMaxShaderCompilerThreadsKHR");
+        else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+            load(maxShaderCompilerThreads, "glMaxShaderCompilerThreadsARB");
+        hasParallelShaderCompile = maxShaderCompilerThreads != nullptr;
+    }
+
+    template<typename Proc>
+    static void load(Proc& proc, const char* name)
+    {
+        proc = reinterpret_cast<Proc>(glfwGetProcAddress(name));
+    }
+};
+
+#endif
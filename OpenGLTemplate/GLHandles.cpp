@@ -0,0 +1,2 @@
+#define GLHANDLES_IMPLEMENTATION
+#include "GLHandles.h"
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef GLHANDLES_H
+#define GLHANDLES_H
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+
+// Move-only owners of OpenGL object names. The object is deleted when the handle is destroyed or reset, so it has to
+// happen while the context is still current: handles held by singletons must be cleared (or released) before
+// glfwTerminate, the static destructors run too late.
+template<typename Traits>
+class GLHandle
+{
+public:
+    GLHandle() {}
+
+    // takes ownership of an existing name
+    explicit GLHandle(GLuint name) : name(name) {}
+
+    // generates a new object
+    static GLHandle create()
+    {
+        return GLHandle(Traits::create());
+    }
+
+    ~GLHandle()
+    {
+        reset();
+    }
+
+    GLHandle(GLHandle&& other) noexcept : name(other.name)
+    {
+        other.name = 0;
+    }
+
+    GLHandle& operator=(GLHandle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            name = other.name;
+            other.name = 0;
+        }
+        return *this;
+    }
+
+    GLHandle(const GLHandle&) = delete;
+    GLHandle& operator=(const GLHandle&) = delete;
+
+    GLuint get() const { return name; }
+    explicit operator bool() const { return name != 0; }
+
+    // deletes the object (if any) and takes ownership of newName
+    void reset(GLuint newName = 0)
+    {
+        if (name != 0)
+            Traits::destroy(name);
+        name = newName;
+    }
+
+    // gives up ownership without deleting the object
+    GLuint release()
+    {
+        GLuint released = name;
+        name = 0;
+        return released;
+    }
+
+private:
+    GLuint name = 0;
+};
+
+struct GLBufferTraits {
+    static GLuint create() { GLuint name; glGenBuffers(1, &name); return name; }
+    static void destroy(GLuint name) { GLState::instance().forgetBuffer(name); glDeleteBuffers(1, &name); }
+};
+
+struct GLVertexArrayTraits {
+    static GLuint create() { GLuint name; glGenVertexArrays(1, &name); return name; }
+    static void destroy(GLuint name) { GLState::instance().forgetVertexArray(name); glDeleteVertexArrays(1, &name); }
+};
+
+struct GLTextureTraits {
+    static GLuint create() { GLuint name; glGenTextures(1, &name); return name; }
+    static void destroy(GLuint name) { GLState::instance().forgetTexture(name); glDeleteTextures(1, &name); }
+};
+
+struct GLProgramTraits {
+    static GLuint create() { return glCreateProgram(); }
+    static void destroy(GLuint name) { GLState::instance().forgetProgram(name); glDeleteProgram(name); }
+};
+
+using GLBuffer = GLHandle<GLBufferTraits>;
+using GLVertexArray = GLHandle<GLVertexArrayTraits>;
+using GLTexture = GLHandle<GLTextureTraits>;
+using GLProgram = GLHandle<GLProgramTraits>;
+
+#endif
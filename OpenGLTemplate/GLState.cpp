@@ -0,0 +1,2 @@
+#define GLSTATE_IMPLEMENTATION
+#include "GLState.h"
\ No newline at end of file
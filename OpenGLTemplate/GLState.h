@@ -0,0 +1,255 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+
+#include <cstdint>
+#include <iostream>
+
+// state-change calls of one frame that went to the driver vs. were skipped because the state was already set
+struct GLStateStats {
+    uint64_t issued = 0;
+    uint64_t elided = 0;
+};
+
+// Shadow copy of the GL binding state: current program, VAO, the non-VAO buffer bindings, the uniform and shader
+// storage buffer binding points, the active texture unit and the 2D/cube textures per unit. Binds that would not change
+// anything are skipped. Only calls that go through here are tracked, so any code changing these bindings directly must
+// either use GLState too or call invalidate(). The element array buffer binding belongs to the VAO and is always passed through. GL thread only.
+class GLState
+{
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 32;
+    static const unsigned int MAX_UNIFORM_BINDINGS = 16;
+    static const unsigned int MAX_STORAGE_BINDINGS = 8;
+    // shadow value for state that isn't known; never a valid name or unit, so the next bind always goes through
+    static const GLuint UNKNOWN = 0xffffffffu;
+
+    static GLState& instance()
+    {
+        static GLState state;
+        return state;
+    }
+
+    GLState(const GLState&) = delete;
+    GLState& operator=(const GLState&) = delete;
+
+    void useProgram(GLuint program)
+    {
+        if (!changed(currentProgram, program))
+            return;
+        glUseProgram(program);
+    }
+
+    GLuint program() const { return currentProgram; }
+
+    void bindVertexArray(GLuint vertexArray)
+    {
+        if (!changed(currentVertexArray, vertexArray))
+            return;
+        glBindVertexArray(vertexArray);
+    }
+
+    void bindBuffer(GLenum target, GLuint buffer)
+    {
+        GLuint* slot = bufferSlot(target);
+        if (slot && !changed(*slot, buffer))
+            return;
+        if (!slot)
+            frame.issued++;
+        glBindBuffer(target, buffer);
+    }
+
+    // glBindBufferRange on a uniform buffer binding point; like GL, this also sets the generic GL_UNIFORM_BUFFER binding.
+    // A size of 0 binds the whole buffer (glBindBufferBase).
+    void bindUniformBuffer(GLuint index, GLuint buffer, GLintptr offset = 0, GLsizeiptr size = 0)
+    {
+        bindIndexed(GL_UNIFORM_BUFFER, UNIFORM, uniformBindings, MAX_UNIFORM_BINDINGS, index, buffer, offset, size);
+    }
+
+    // the same for a shader storage buffer binding point (GL 4.3, see GLExtensions::hasComputeIndirect)
+    void bindStorageBuffer(GLuint index, GLuint buffer, GLintptr offset = 0, GLsizeiptr size = 0)
+    {
+        bindIndexed(GL_SHADER_STORAGE_BUFFER, SHADER_STORAGE, storageBindings, MAX_STORAGE_BINDINGS, index, buffer, offset, size);
+    }
+
+    void activeTexture(unsigned int unit)
+    {
+        if (!changed(currentUnit, unit))
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // binds texture to target on unit, switching the active unit only if the binding actually changes
+    void bindTexture(unsigned int unit, GLenum target, GLuint texture)
+    {
+        GLuint* slot = textureSlot(unit, target);
+        if (slot && *slot == texture)
+        {
+            frame.elided++;
+            return;
+        }
+        activeTexture(unit);
+        if (slot)
+            *slot = texture;
+        frame.issued++;
+        glBindTexture(target, texture);
+    }
+
+    // forget everything, e.g. after code that changed bindings without going through GLState
+    void invalidate()
+    {
+        currentProgram = currentVertexArray = UNKNOWN;
+        currentUnit = UNKNOWN;
+        for (GLuint& buffer : buffers)
+            buffer = UNKNOWN;
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            textures2D[unit] = texturesCube[unit] = UNKNOWN;
+        for (IndexedBinding& binding : uniformBindings)
+            binding = { UNKNOWN, 0, 0 };
+        for (IndexedBinding& binding : storageBindings)
+            binding = { UNKNOWN, 0, 0 };
+    }
+
+    // called when objects are deleted: GL unbinds them, and their names may be handed out again
+    void forgetProgram(GLuint program)
+    {
+        if (currentProgram == program)
+            currentProgram = UNKNOWN;
+    }
+
+    void forgetVertexArray(GLuint vertexArray)
+    {
+        if (currentVertexArray == vertexArray)
+            currentVertexArray = 0;
+    }
+
+    void forgetBuffer(GLuint buffer)
+    {
+        for (GLuint& bound : buffers)
+            if (bound == buffer)
+                bound = 0;
+        for (IndexedBinding& binding : uniformBindings)
+            if (binding.buffer == buffer)
+                binding = { 0, 0, 0 };
+        for (IndexedBinding& binding : storageBindings)
+            if (binding.buffer == buffer)
+                binding = { 0, 0, 0 };
+    }
+
+    void forgetTexture(GLuint texture)
+    {
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+        {
+            if (textures2D[unit] == texture)
+                textures2D[unit] = 0;
+            if (texturesCube[unit] == texture)
+                texturesCube[unit] = 0;
+        }
+    }
+
+    // starts counting a new frame; stats() then reports the frame that just ended
+    void beginFrame()
+    {
+        lastFrame = frame;
+        frame = GLStateStats();
+    }
+
+    GLStateStats stats() const { return lastFrame; }
+
+    void printStats() const
+    {
+        uint64_t total = lastFrame.issued + lastFrame.elided;
+        std::cout << "GL state: " << lastFrame.issued << " calls issued, " << lastFrame.elided << " elided ("
+                  << (total ? 100.0 * lastFrame.elided / total : 0.0) << "% redundant) last frame" << std::endl;
+    }
+
+private:
+    struct IndexedBinding {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    enum BufferTarget { ARRAY, COPY_READ, COPY_WRITE, PIXEL_PACK, PIXEL_UNPACK, UNIFORM, SHADER_STORAGE, DRAW_INDIRECT, BUFFER_TARGET_COUNT };
+
+    GLuint currentProgram = UNKNOWN;
+    GLuint currentVertexArray = UNKNOWN;
+    GLuint currentUnit = UNKNOWN;
+    GLuint buffers[BUFFER_TARGET_COUNT];
+    GLuint textures2D[MAX_TEXTURE_UNITS];
+    GLuint texturesCube[MAX_TEXTURE_UNITS];
+    IndexedBinding uniformBindings[MAX_UNIFORM_BINDINGS];
+    IndexedBinding storageBindings[MAX_STORAGE_BINDINGS];
+    GLStateStats frame, lastFrame;
+
+    GLState()
+    {
+        invalidate();
+    }
+
+    // updates a shadowed value; true if the GL call has to be made
+    bool changed(GLuint& shadow, GLuint value)
+    {
+        if (shadow == value)
+        {
+            frame.elided++;
+            return false;
+        }
+        shadow = value;
+        frame.issued++;
+        return true;
+    }
+
+    // binding points past count aren't shadowed and always go through
+    void bindIndexed(GLenum target, BufferTarget generic, IndexedBinding* bindings, unsigned int count, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        if (index < count)
+        {
+            IndexedBinding& binding = bindings[index];
+            if (binding.buffer == buffer && binding.offset == offset && binding.size == size)
+            {
+                frame.elided++;
+                return;
+            }
+            binding = { buffer, offset, size };
+        }
+        buffers[generic] = buffer;
+        frame.issued++;
+        if (size == 0)
+            glBindBufferBase(target, index, buffer);
+        else
+            glBindBufferRange(target, index, buffer, offset, size);
+    }
+
+    GLuint* bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER: return &buffers[ARRAY];
+        case GL_COPY_READ_BUFFER: return &buffers[COPY_READ];
+        case GL_COPY_WRITE_BUFFER: return &buffers[COPY_WRITE];
+        case GL_PIXEL_PACK_BUFFER: return &buffers[PIXEL_PACK];
+        case GL_PIXEL_UNPACK_BUFFER: return &buffers[PIXEL_UNPACK];
+        case GL_UNIFORM_BUFFER: return &buffers[UNIFORM];
+        case GL_SHADER_STORAGE_BUFFER: return &buffers[SHADER_STORAGE];
+        case GL_DRAW_INDIRECT_BUFFER: return &buffers[DRAW_INDIRECT];
+        default: return nullptr;
+        }
+    }
+
+    GLuint* textureSlot(unsigned int unit, GLenum target)
+    {
+        if (unit >= MAX_TEXTURE_UNITS)
+            return nullptr;
+        if (target == GL_TEXTURE_2D)
+            return &textures2D[unit];
+        if (target == GL_TEXTURE_CUBE_MAP)
+            return &texturesCube[unit];
+        return nullptr;
+    }
+};
+
+#endif
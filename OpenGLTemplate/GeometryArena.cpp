@@ -0,0 +1,2 @@
+#define GEOMETRYARENA_IMPLEMENTATION
+#include "GeometryArena.h"
\ No newline at end of file
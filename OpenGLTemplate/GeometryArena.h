@@ -0,0 +1,314 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <glad/glad.h>
+
+#include "GLHandles.h"
+#include "GLState.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <utility>
+
+// first-fit free-list allocator over [0, capacity) in abstract units. Freed blocks are merged with their neighbours.
+class RangeAllocator
+{
+public:
+    static const size_t INVALID = SIZE_MAX;
+
+    size_t capacity() const { return total; }
+    size_t used() const { return inUse; }
+    size_t freeBlockCount() const { return freeBlocks.size(); }
+
+    size_t largestFreeBlock() const
+    {
+        size_t largest = 0;
+        for (const auto& block : freeBlocks)
+            largest = std::max(largest, block.second);
+        return largest;
+    }
+
+    // returns the offset of a block of size units, or INVALID when no free block is large enough
+    size_t allocate(size_t size)
+    {
+        if (size == 0)
+            return 0;
+        for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+        {
+            if (it->second < size)
+                continue;
+            size_t offset = it->first;
+            size_t remaining = it->second - size;
+            freeBlocks.erase(it);
+            if (remaining > 0)
+                freeBlocks[offset + size] = remaining;
+            inUse += size;
+            return offset;
+        }
+        return INVALID;
+    }
+
+    void free(size_t offset, size_t size)
+    {
+        if (size == 0)
+            return;
+        inUse -= size;
+        auto next = freeBlocks.lower_bound(offset);
+        // merge with the following block
+        if (next != freeBlocks.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = freeBlocks.erase(next);
+        }
+        // and with the preceding one
+        if (next != freeBlocks.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += size;
+                return;
+            }
+        }
+        freeBlocks[offset] = size;
+    }
+
+    // adds capacity at the end (after the buffer behind it was grown)
+    void grow(size_t newCapacity)
+    {
+        if (newCapacity <= total)
+            return;
+        size_t added = newCapacity - total;
+        size_t offset = total;
+        total = newCapacity;
+        inUse += added; // free() subtracts it again
+        free(offset, added);
+    }
+
+private:
+    std::map<size_t, size_t> freeBlocks; // offset -> size
+    size_t total = 0;
+    size_t inUse = 0;
+};
+
+// Shared geometry storage: one vertex buffer, one 16-bit index buffer and one VAO per vertex format, sub-allocated by
+// every mesh. Meshes draw with glDrawElementsBaseVertex against their allocation, so consecutive meshes in the same
+// format share a VAO binding and can be merged into a single glMultiDrawElementsBaseVertex.
+class GeometryArena
+{
+public:
+    static const size_t INITIAL_VERTICES = 64 * 1024;
+    static const size_t INITIAL_INDICES = 256 * 1024;
+
+    // a mesh's piece of the arena; offsets are in vertices and indices of the allocation's format
+    struct Allocation {
+        VertexFormat format = VertexFormat::Static;
+        size_t vertexOffset = 0, vertexCount = 0;
+        size_t indexOffset = 0, indexCount = 0;
+        bool valid = false;
+        uint32_t generation = 0;   // the arena's generation when allocated; a clear() in between makes it stale
+    };
+
+    struct Stats {
+        size_t vertexBytesUsed = 0, vertexBytesCapacity = 0;
+        size_t indexBytesUsed = 0, indexBytesCapacity = 0;
+        float  utilization = 0.0f;     // used / capacity over both buffers
+        float  fragmentation = 0.0f;   // 1 - largest free block / total free, worst of the pools
+        size_t freeBlocks = 0;
+    };
+
+    static GeometryArena& instance()
+    {
+        static GeometryArena arena;
+        return arena;
+    }
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // reserves room for a mesh and uploads its vertices (packed in format) and 16-bit indices
+    Allocation allocate(VertexFormat format, const void* vertexData, size_t vertexCount, const unsigned short* indexData, size_t indexCount)
+    {
+        Pool& pool = pools[static_cast<size_t>(format)];
+        if (!pool.vao)
+            createPool(pool, format);
+
+        Allocation allocation;
+        allocation.format = format;
+        allocation.vertexCount = vertexCount;
+        allocation.indexCount = indexCount;
+        allocation.vertexOffset = pool.vertices.allocate(vertexCount);
+        while (allocation.vertexOffset == RangeAllocator::INVALID)
+        {
+            growVertices(pool, format, std::max(pool.vertices.capacity() * 2, pool.vertices.capacity() + vertexCount));
+            allocation.vertexOffset = pool.vertices.allocate(vertexCount);
+        }
+        allocation.indexOffset = pool.indices.allocate(indexCount);
+        while (allocation.indexOffset == RangeAllocator::INVALID)
+        {
+            growIndices(pool, std::max(pool.indices.capacity() * 2, pool.indices.capacity() + indexCount));
+            allocation.indexOffset = pool.indices.allocate(indexCount);
+        }
+        allocation.valid = true;
+        allocation.generation = generation;
+
+        GLsizei stride = vertexStride(format);
+        GLState& state = GLState::instance();
+        state.bindBuffer(GL_ARRAY_BUFFER, pool.vbo.get());
+        glBufferSubData(GL_ARRAY_BUFFER, allocation.vertexOffset * stride, vertexCount * stride, vertexData);
+        // the element buffer binding is VAO state, so upload through the copy target instead
+        state.bindBuffer(GL_COPY_WRITE_BUFFER, pool.ebo.get());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.indexOffset * sizeof(unsigned short), indexCount * sizeof(unsigned short), indexData);
+        return allocation;
+    }
+
+    // gives an allocation back; the space is reused by later allocations. One from before the last clear() owns nothing
+    // anymore and is only marked invalid.
+    void free(Allocation& allocation)
+    {
+        if (!allocation.valid)
+            return;
+        if (allocation.generation != generation)
+        {
+            allocation.valid = false;
+            return;
+        }
+        Pool& pool = pools[static_cast<size_t>(allocation.format)];
+        pool.vertices.free(allocation.vertexOffset, allocation.vertexCount);
+        pool.indices.free(allocation.indexOffset, allocation.indexCount);
+        allocation.valid = false;
+    }
+
+    // binds the VAO every mesh of format draws from
+    void bind(VertexFormat format) const
+    {
+        GLState::instance().bindVertexArray(vertexArray(format));
+    }
+
+    // name of that VAO, 0 until the first allocation of format
+    GLuint vertexArray(VertexFormat format) const
+    {
+        return pools[static_cast<size_t>(format)].vao.get();
+    }
+
+    // deletes every buffer and VAO; call while the context is still current. Outstanding allocations become stale, so
+    // freeing them later leaves the new pools alone.
+    void clear()
+    {
+        for (Pool& pool : pools)
+            pool = Pool();
+        generation++;
+    }
+
+    Stats stats() const
+    {
+        Stats result;
+        for (size_t f = 0; f < POOL_COUNT; f++)
+        {
+            const Pool& pool = pools[f];
+            GLsizei stride = vertexStride(static_cast<VertexFormat>(f));
+            result.vertexBytesUsed += pool.vertices.used() * stride;
+            result.vertexBytesCapacity += pool.vertices.capacity() * stride;
+            result.indexBytesUsed += pool.indices.used() * sizeof(unsigned short);
+            result.indexBytesCapacity += pool.indices.capacity() * sizeof(unsigned short);
+            result.freeBlocks += pool.vertices.freeBlockCount() + pool.indices.freeBlockCount();
+            result.fragmentation = std::max({ result.fragmentation, fragmentation(pool.vertices), fragmentation(pool.indices) });
+        }
+        size_t capacity = result.vertexBytesCapacity + result.indexBytesCapacity;
+        if (capacity > 0)
+            result.utilization = static_cast<float>(result.vertexBytesUsed + result.indexBytesUsed) / capacity;
+        return result;
+    }
+
+    void printStats() const
+    {
+        Stats s = stats();
+        std::cout << "geometry arena: vertices " << s.vertexBytesUsed / 1024 << " / " << s.vertexBytesCapacity / 1024 << " KiB, indices "
+                  << s.indexBytesUsed / 1024 << " / " << s.indexBytesCapacity / 1024 << " KiB, " << s.utilization * 100.0f << "% utilized, "
+                  << s.fragmentation * 100.0f << "% fragmented (" << s.freeBlocks << " free blocks)" << std::endl;
+    }
+
+private:
+    static const size_t POOL_COUNT = static_cast<size_t>(VertexFormat::Count);
+
+    struct Pool {
+        GLVertexArray vao;
+        GLBuffer vbo, ebo;
+        RangeAllocator vertices;
+        RangeAllocator indices;
+    };
+
+    Pool pools[POOL_COUNT];
+    uint32_t generation = 0;   // bumped by clear()
+
+    GeometryArena() {}
+
+    ~GeometryArena()
+    {
+        // never touches GL here: the context is usually gone by the time statics are destroyed (see clear())
+        for (Pool& pool : pools)
+        {
+            pool.vao.release();
+            pool.vbo.release();
+            pool.ebo.release();
+        }
+    }
+
+    static float fragmentation(const RangeAllocator& allocator)
+    {
+        size_t freeUnits = allocator.capacity() - allocator.used();
+        if (freeUnits == 0)
+            return 0.0f;
+        return 1.0f - static_cast<float>(allocator.largestFreeBlock()) / freeUnits;
+    }
+
+    void createPool(Pool& pool, VertexFormat format)
+    {
+        pool.vao = GLVertexArray::create();
+        growVertices(pool, format, INITIAL_VERTICES);
+        growIndices(pool, INITIAL_INDICES);
+    }
+
+    // replaces buffer with a larger one holding the same contents
+    static void resizeBuffer(GLBuffer& buffer, size_t oldSize, size_t newSize)
+    {
+        GLState& state = GLState::instance();
+        GLBuffer resized = GLBuffer::create();
+        state.bindBuffer(GL_COPY_WRITE_BUFFER, resized.get());
+        glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, GL_STATIC_DRAW);
+        if (buffer)
+        {
+            state.bindBuffer(GL_COPY_READ_BUFFER, buffer.get());
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+        }
+        // deletes the old buffer
+        buffer = std::move(resized);
+    }
+
+    void growVertices(Pool& pool, VertexFormat format, size_t vertexCapacity)
+    {
+        GLsizei stride = vertexStride(format);
+        resizeBuffer(pool.vbo, pool.vertices.capacity() * stride, vertexCapacity * stride);
+        pool.vertices.grow(vertexCapacity);
+        // the attribute pointers captured the old buffer
+        GLState& state = GLState::instance();
+        state.bindVertexArray(pool.vao.get());
+        state.bindBuffer(GL_ARRAY_BUFFER, pool.vbo.get());
+        setupVertexAttributes(format);
+    }
+
+    void growIndices(Pool& pool, size_t indexCapacity)
+    {
+        resizeBuffer(pool.ebo, pool.indices.capacity() * sizeof(unsigned short), indexCapacity * sizeof(unsigned short));
+        pool.indices.grow(indexCapacity);
+        GLState& state = GLState::instance();
+        state.bindVertexArray(pool.vao.get());
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ebo.get());
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define GPUCULLER_IMPLEMENTATION
+#include "GpuCuller.h"
\ No newline at end of file
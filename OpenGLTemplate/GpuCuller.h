@@ -0,0 +1,454 @@
+#ifndef GPUCULLER_H
+#define GPUCULLER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+#include "FrustumCuller.h"
+#include "GLExtensions.h"
+#include "GLHandles.h"
+#include "GLState.h"
+#include "OcclusionCuller.h"
+#include "PrimitiveRegistry.h"
+#include "ProgramBuild.h"
+#include "Shader.h"
+#include "ShaderPreprocessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// one object for GpuCuller: a registry primitive placed by model
+struct GpuObject {
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::vec4 color = glm::vec4(1.0f);
+    Primitive primitive;
+};
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand must match GL's layout");
+
+enum class GpuCullPath : uint32_t {
+    Gpu,   // compute culling + one glMultiDrawElementsIndirect
+    Cpu    // FrustumCuller (+ OcclusionCuller) and a draw call per visible object
+};
+
+struct GpuCullStats {
+    GpuCullPath path = GpuCullPath::Cpu;
+    size_t objects = 0;
+    size_t visible = 0;     // always known on the CPU path; on the GPU path only after readVisibleCount()
+    size_t drawCalls = 0;
+    bool hiZ = false;
+    double cpuMs = 0.0;     // CPU time of draw(), culling and submission (the GPU path's culling isn't in it)
+
+    void print(const char* what) const
+    {
+        std::cout << what << ": " << (path == GpuCullPath::Gpu ? "GPU" : "CPU") << " path" << (hiZ ? " with Hi-Z" : "") << ", " << visible
+                  << " / " << objects << " visible, " << drawCalls << " draw calls, " << cpuMs << " ms CPU" << std::endl;
+    }
+};
+
+// GPU driven culling and submission for many registry primitives. Every object's model matrix, color, box and draw
+// arguments live in a shader storage buffer; each frame a compute shader (cull.comp) tests the boxes against the
+// frustum, and optionally against a Hi-Z pyramid of an OcclusionCuller's occluder depth, and writes one
+// DrawElementsIndirectCommand per object (instance count 0 when culled). A single glMultiDrawElementsIndirect then draws
+// the lot with indirect.vs, which finds its object through the command's base instance.
+//
+// That needs GL 4.3 (GLExtensions::hasComputeIndirect) and storage buffers in vertex shaders. Where either is missing,
+// or the programs fail to build, the same objects are culled on the CPU (FrustumCuller, OcclusionCuller) and drawn one
+// by one with a fallback shader.
+class GpuCuller
+{
+public:
+    static const GLuint OBJECT_BINDING = 0;    // shader storage bindings, as in cull.comp and indirect.vs
+    static const GLuint COMMAND_BINDING = 1;
+    static const GLuint VISIBLE_BINDING = 2;
+    static const GLuint OBJECT_INDEX_LOCATION = 5;
+    static const GLuint WORKGROUP_SIZE = 64;   // local_size_x of cull.comp
+    static const unsigned int HIZ_UNIT = 0;
+
+    GpuCuller() {}
+
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+
+    // true if the context can run the GPU path; needs the context current
+    static bool supported()
+    {
+        static int support = -1;
+        if (support < 0)
+        {
+            GLint vertexBlocks = 0;
+            if (GLExtensions::instance().hasComputeIndirect)
+                glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexBlocks);
+            support = vertexBlocks > 0 ? 1 : 0;
+        }
+        return support == 1;
+    }
+
+    // the path the next draw() takes
+    GpuCullPath path() const
+    {
+        return !forceCpu && !gpuFailed && supported() ? GpuCullPath::Gpu : GpuCullPath::Cpu;
+    }
+
+    // takes the CPU path even where the GPU one works, for comparisons
+    void setForceCpu(bool force) { forceCpu = force; }
+
+    // replaces every object; uploaded by the next draw()
+    void setObjects(const std::vector<GpuObject>& list)
+    {
+        objects = list;
+        data.resize(objects.size());
+        for (size_t i = 0; i < objects.size(); i++)
+            data[i] = pack(objects[i]);
+        markDirty(0, objects.size());
+    }
+
+    // moves one object; only the changed range is uploaded
+    void setModel(size_t index, const glm::mat4& model)
+    {
+        objects[index].model = model;
+        data[index].model = model;
+        markDirty(index, index + 1);
+    }
+
+    size_t size() const { return objects.size(); }
+
+    // also cull against occlusion's depth buffer (as a Hi-Z pyramid on the GPU path), which has to be rasterized with
+    // the same view projection before draw(). null turns it off; the culler isn't owned.
+    void setOcclusion(OcclusionCuller* occlusion) { this->occlusion = occlusion; }
+
+    // culls and draws every object. viewProjection has to match the PerFrame block's. fallbackShader draws the CPU path
+    // (through Shader::setModel, so the object colors are the GPU path's only); the GPU path brings its own program.
+    void draw(const glm::mat4& viewProjection, Shader& fallbackShader)
+    {
+        auto start = std::chrono::steady_clock::now();
+        lastStats = GpuCullStats();
+        lastStats.objects = objects.size();
+        lastStats.hiZ = occlusion != nullptr;
+        if (path() == GpuCullPath::Gpu && prepareGpu())
+            drawGpu(viewProjection);
+        else
+            drawCpu(viewProjection, fallbackShader);
+        lastStats.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // the objects the last draw() found visible. On the GPU path this reads the counter back and so waits for the GPU;
+    // for tests and benchmarks, not every frame.
+    size_t readVisibleCount()
+    {
+        if (lastStats.path == GpuCullPath::Gpu && visibleBuffer)
+        {
+            GLuint count = 0;
+            GLState::instance().bindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer.get());
+            glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(count), &count);
+            lastStats.visible = count;
+        }
+        return lastStats.visible;
+    }
+
+    const GpuCullStats& stats() const { return lastStats; }
+
+    // deletes the GL objects; call while the context is still current. The objects stay and are uploaded again if
+    // drawn after this.
+    void clear()
+    {
+        drawShader.reset();
+        cullProgram.reset();
+        objectBuffer.reset();
+        commandBuffer.reset();
+        visibleBuffer.reset();
+        indexBuffer.reset();
+        vertexArray.reset();
+        hiZTexture.reset();
+        capacity = 0;
+        hiZWidth = hiZHeight = 0;
+        markDirty(0, objects.size());
+    }
+
+private:
+    // std430 layout of cull.comp's Object
+    struct ObjectData {
+        glm::mat4 model;
+        glm::vec4 color;
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        uint32_t  indexCount;
+        uint32_t  firstIndex;
+        int32_t   baseVertex;
+        uint32_t  unused;
+    };
+    static_assert(sizeof(ObjectData) == 128, "ObjectData must match the std430 Object struct");
+
+    std::vector<GpuObject> objects;
+    std::vector<ObjectData> data;
+    size_t dirtyFirst = 0, dirtyEnd = 0;   // objects not uploaded yet
+    bool boundsDirty = true;               // the CPU path's world space bounds
+    FrustumCuller culler;
+    OcclusionCuller* occlusion = nullptr;
+    bool forceCpu = false;
+    bool gpuFailed = false;                // the programs didn't build; stays on the CPU path
+    GpuCullStats lastStats;
+
+    // GPU path
+    GLProgram cullProgram;
+    GLint viewProjectionLocation = -1, objectCountLocation = -1, useHiZLocation = -1, hiZLocation = -1, hiZLevelsLocation = -1;
+    std::unique_ptr<Shader> drawShader;
+    GLBuffer objectBuffer, commandBuffer, visibleBuffer, indexBuffer;
+    GLVertexArray vertexArray;
+    size_t capacity = 0;   // objects the buffers are sized for
+    GLTexture hiZTexture;
+    unsigned int hiZWidth = 0, hiZHeight = 0;
+    std::vector<std::vector<float>> hiZLevels;
+
+    static ObjectData pack(const GpuObject& object)
+    {
+        ObjectData packed;
+        packed.model = object.model;
+        packed.color = object.color;
+        packed.boundsMin = glm::vec4(object.primitive.bounds.min, 0.0f);
+        packed.boundsMax = glm::vec4(object.primitive.bounds.max, 0.0f);
+        packed.indexCount = static_cast<uint32_t>(object.primitive.indexCount);
+        packed.firstIndex = static_cast<uint32_t>(object.primitive.indexOffset);
+        packed.baseVertex = object.primitive.baseVertex;
+        packed.unused = 0;
+        return packed;
+    }
+
+    void markDirty(size_t first, size_t end)
+    {
+        if (dirtyFirst >= dirtyEnd)
+        {
+            dirtyFirst = first;
+            dirtyEnd = end;
+        }
+        else
+        {
+            dirtyFirst = std::min(dirtyFirst, first);
+            dirtyEnd = std::max(dirtyEnd, end);
+        }
+        boundsDirty = true;
+    }
+
+    void drawCpu(const glm::mat4& viewProjection, Shader& shader)
+    {
+        lastStats.path = GpuCullPath::Cpu;
+        if (boundsDirty)
+        {
+            culler.clear();
+            culler.reserve(objects.size());
+            for (const GpuObject& object : objects)
+                culler.add(object.primitive.bounds.transformed(object.model));
+            boundsDirty = false;
+        }
+        PrimitiveRegistry& registry = PrimitiveRegistry::instance();
+        shader.use();
+        for (uint32_t i : culler.cull(Frustum::fromMatrix(viewProjection)))
+        {
+            if (occlusion && !occlusion->visible(objects[i].primitive.bounds, objects[i].model))
+                continue;
+            shader.setModel(objects[i].model);
+            registry.draw(objects[i].primitive);
+            lastStats.drawCalls++;
+        }
+        lastStats.visible = lastStats.drawCalls;
+    }
+
+    // builds the programs the first time and (re)sizes or updates the buffers; false if the GPU path can't run
+    bool prepareGpu()
+    {
+        GLState& state = GLState::instance();
+        if (!cullProgram)
+        {
+            cullProgram = buildCompute("cull.comp");
+            drawShader = std::make_unique<Shader>("indirect.vs", "instanced.fs");
+            GLint linked = GL_FALSE;
+            glGetProgramiv(drawShader->ID.get(), GL_LINK_STATUS, &linked);
+            if (!cullProgram || linked != GL_TRUE)
+            {
+                std::cout << "ERROR::GPUCULLER::PROGRAMS_FAILED: culling on the CPU instead" << std::endl;
+                cullProgram.reset();
+                drawShader.reset();
+                gpuFailed = true;
+                return false;
+            }
+            viewProjectionLocation = glGetUniformLocation(cullProgram.get(), "viewProjection");
+            objectCountLocation = glGetUniformLocation(cullProgram.get(), "objectCount");
+            useHiZLocation = glGetUniformLocation(cullProgram.get(), "useHiZ");
+            hiZLocation = glGetUniformLocation(cullProgram.get(), "hiZ");
+            hiZLevelsLocation = glGetUniformLocation(cullProgram.get(), "hiZLevels");
+        }
+
+        if (capacity != objects.size())
+        {
+            capacity = objects.size();
+            size_t buffers = std::max<size_t>(capacity, 1);
+            objectBuffer = GLBuffer::create();
+            state.bindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer.get());
+            glBufferData(GL_SHADER_STORAGE_BUFFER, buffers * sizeof(ObjectData), data.data(), GL_DYNAMIC_DRAW);
+            commandBuffer = GLBuffer::create();
+            state.bindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer.get());
+            glBufferData(GL_SHADER_STORAGE_BUFFER, buffers * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_COPY);
+            if (!visibleBuffer)
+            {
+                visibleBuffer = GLBuffer::create();
+                state.bindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer.get());
+                glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+            }
+
+            // 0, 1, 2, ... read per instance, so base instance i gives the vertex shader object i
+            std::vector<GLuint> indices(buffers);
+            for (size_t i = 0; i < indices.size(); i++)
+                indices[i] = static_cast<GLuint>(i);
+            indexBuffer = GLBuffer::create();
+            vertexArray = GLVertexArray::create();
+            state.bindVertexArray(vertexArray.get());
+            PrimitiveRegistry::instance().setupAttributes();
+            state.bindBuffer(GL_ARRAY_BUFFER, indexBuffer.get());
+            glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+            glEnableVertexAttribArray(OBJECT_INDEX_LOCATION);
+            glVertexAttribIPointer(OBJECT_INDEX_LOCATION, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+            glVertexAttribDivisor(OBJECT_INDEX_LOCATION, 1);
+            dirtyFirst = dirtyEnd = 0;
+        }
+        else if (dirtyFirst < dirtyEnd)
+        {
+            state.bindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer.get());
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, dirtyFirst * sizeof(ObjectData), (dirtyEnd - dirtyFirst) * sizeof(ObjectData), data.data() + dirtyFirst);
+            dirtyFirst = dirtyEnd = 0;
+        }
+        return true;
+    }
+
+    void drawGpu(const glm::mat4& viewProjection)
+    {
+        lastStats.path = GpuCullPath::Gpu;
+        if (objects.empty())
+            return;
+        GLState& state = GLState::instance();
+        GLExtensions& extensions = GLExtensions::instance();
+        GLuint zero = 0;
+        state.bindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer.get());
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+        state.bindStorageBuffer(OBJECT_BINDING, objectBuffer.get());
+        state.bindStorageBuffer(COMMAND_BINDING, commandBuffer.get());
+        state.bindStorageBuffer(VISIBLE_BINDING, visibleBuffer.get());
+
+        state.useProgram(cullProgram.get());
+        glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, &viewProjection[0][0]);
+        glUniform1ui(objectCountLocation, static_cast<GLuint>(objects.size()));
+        glUniform1i(useHiZLocation, occlusion ? 1 : 0);
+        if (occlusion)
+        {
+            uploadHiZ();
+            state.bindTexture(HIZ_UNIT, GL_TEXTURE_2D, hiZTexture.get());
+            glUniform1i(hiZLocation, static_cast<GLint>(HIZ_UNIT));
+            glUniform1i(hiZLevelsLocation, static_cast<GLint>(hiZLevels.size()));
+        }
+        extensions.dispatchCompute(static_cast<GLuint>((objects.size() + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE), 1, 1);
+        // the commands are read as draw arguments, the counter by buffer updates and readbacks
+        extensions.memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        drawShader->use();
+        state.bindVertexArray(vertexArray.get());
+        state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.get());
+        extensions.multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, static_cast<GLsizei>(objects.size()), 0);
+        lastStats.drawCalls = 1;
+    }
+
+    // the occluder depth as a max pyramid: level 0 is the OcclusionCuller's buffer, every further level keeps the
+    // farthest depth of the 2x2 texels below it (3 wide at odd edges), down to 1x1
+    void uploadHiZ()
+    {
+        unsigned int width = occlusion->width(), height = occlusion->height();
+        hiZLevels.resize(1);
+        hiZLevels[0] = occlusion->depth();
+        std::vector<std::pair<unsigned int, unsigned int>> sizes = { { width, height } };
+        while (sizes.back().first > 1 || sizes.back().second > 1)
+        {
+            auto [belowWidth, belowHeight] = sizes.back();
+            unsigned int levelWidth = std::max(1u, belowWidth / 2), levelHeight = std::max(1u, belowHeight / 2);
+            const std::vector<float>& source = hiZLevels.back();
+            std::vector<float> level(static_cast<size_t>(levelWidth) * levelHeight);
+            for (unsigned int y = 0; y < levelHeight; y++)
+            {
+                unsigned int y0 = y * 2, y1 = std::min(belowHeight - 1, y == levelHeight - 1 ? belowHeight - 1 : y * 2 + 1);
+                for (unsigned int x = 0; x < levelWidth; x++)
+                {
+                    unsigned int x0 = x * 2, x1 = std::min(belowWidth - 1, x == levelWidth - 1 ? belowWidth - 1 : x * 2 + 1);
+                    float farthest = 0.0f;
+                    for (unsigned int sy = y0; sy <= y1; sy++)
+                        for (unsigned int sx = x0; sx <= x1; sx++)
+                            farthest = std::max(farthest, source[static_cast<size_t>(sy) * belowWidth + sx]);
+                    level[static_cast<size_t>(y) * levelWidth + x] = farthest;
+                }
+            }
+            hiZLevels.push_back(std::move(level));
+            sizes.push_back({ levelWidth, levelHeight });
+        }
+
+        GLState& state = GLState::instance();
+        bool allocate = !hiZTexture || hiZWidth != width || hiZHeight != height;
+        if (allocate)
+        {
+            hiZTexture = GLTexture::create();
+            hiZWidth = width;
+            hiZHeight = height;
+        }
+        state.bindTexture(HIZ_UNIT, GL_TEXTURE_2D, hiZTexture.get());
+        for (size_t i = 0; i < hiZLevels.size(); i++)
+        {
+            GLsizei levelWidth = static_cast<GLsizei>(sizes[i].first), levelHeight = static_cast<GLsizei>(sizes[i].second);
+            if (allocate)
+                glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), GL_R32F, levelWidth, levelHeight, 0, GL_RED, GL_FLOAT, hiZLevels[i].data());
+            else
+                glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), 0, 0, levelWidth, levelHeight, GL_RED, GL_FLOAT, hiZLevels[i].data());
+        }
+        if (allocate)
+        {
+            // texelFetch only, but the texture still has to be mipmap complete
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(hiZLevels.size() - 1));
+        }
+    }
+
+    static GLProgram buildCompute(const char* path)
+    {
+        std::string code;
+        std::vector<std::string> files;
+        if (!ShaderPreprocessor::process(path, ShaderDefines(), code, files))
+            return GLProgram();
+        GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+        const char* source = code.c_str();
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        bool compiled = ProgramBuild::checkCompileErrors(shader, "COMPUTE");
+        GLProgram program = GLProgram::create();
+        glAttachShader(program.get(), shader);
+        glLinkProgram(program.get());
+        bool linked = compiled && ProgramBuild::checkCompileErrors(program.get(), "PROGRAM");
+        glDetachShader(program.get(), shader);
+        glDeleteShader(shader);
+        if (!linked)
+            return GLProgram();
+        return program;
+    }
+};
+
+#endif
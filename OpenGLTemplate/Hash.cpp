@@ -0,0 +1,2 @@
+#define HASH_IMPLEMENTATION
+#include "Hash.h"
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// 64-bit FNV-1a. constexpr so it can hash string literals at compile time, and cheap enough to fingerprint files.
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+const uint64_t FNV_PRIME = 1099511628211ull;
+
+constexpr uint64_t fnv1a(const char* str, size_t length, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= static_cast<unsigned char>(str[i]);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1a(const void* data, size_t length, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1a(const std::string& str, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    return fnv1a(str.data(), str.size(), hash);
+}
+
+// word-at-a-time hash for large buffers such as whole files. four independent lanes each take one multiply per
+// 8-byte word, so it runs many times faster than byte-wise FNV-1a. the result depends on byte order.
+inline uint64_t mixWord(uint64_t state, uint64_t word)
+{
+    state = (state ^ word) * 0x9E3779B97F4A7C15ull;
+    return state ^ (state >> 29);
+}
+
+inline uint64_t hashWords(const void* data, size_t length, uint64_t seed = FNV_OFFSET_BASIS)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t lanes[5] = { seed, seed ^ FNV_PRIME, seed + FNV_PRIME, seed - FNV_PRIME, static_cast<uint64_t>(length) };
+    uint64_t word;
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        for (int lane = 0; lane < 4; lane++)
+        {
+            memcpy(&word, bytes + i + lane * 8, sizeof(word));
+            lanes[lane] = mixWord(lanes[lane], word);
+        }
+    }
+    for (; i + 8 <= length; i += 8)
+    {
+        memcpy(&word, bytes + i, sizeof(word));
+        lanes[0] = mixWord(lanes[0], word);
+    }
+    if (i < length)
+    {
+        word = 0;
+        memcpy(&word, bytes + i, length - i);
+        lanes[1] = mixWord(lanes[1], word);
+    }
+    return fnv1a(lanes, sizeof(lanes));
+}
+
+#endif
@@ -0,0 +1,2 @@
+#define INSTANCESTREAM_IMPLEMENTATION
+#include "InstanceStream.h"
\ No newline at end of file
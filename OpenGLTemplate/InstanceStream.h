@@ -0,0 +1,99 @@
+#ifndef INSTANCESTREAM_H
+#define INSTANCESTREAM_H
+
+#include <glad/glad.h>
+
+#include "GLHandles.h"
+#include "GLState.h"
+
+#include <cstddef>
+#include <iostream>
+
+// per-frame traffic of an instance stream
+struct InstanceStreamStats {
+    size_t writes = 0;    // ranges mapped
+    size_t bytes = 0;
+    size_t orphans = 0;   // times the buffer was full and its storage replaced
+};
+
+// A vertex buffer that per-instance data is streamed through, written front to back. Each write maps a fresh range
+// unsynchronized, which is safe because nothing handed to a draw since the last orphan is ever written again; when
+// the buffer is full its storage is orphaned (glBufferData with no data), so the driver gives us new memory while
+// draws still in flight keep reading the old one. Persistent mapping would save the map calls but needs GL 4.4
+// (ARB_buffer_storage), this context is 3.3. The caller owns it and resets it while the context is current.
+class InstanceStream
+{
+public:
+    static const size_t DEFAULT_CAPACITY = 4 * 1024 * 1024;
+
+    void create(size_t bytes = DEFAULT_CAPACITY)
+    {
+        capacity = bytes;
+        cursor = 0;
+        buffer = GLBuffer::create();
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, buffer.get());
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity), nullptr, GL_STREAM_DRAW);
+    }
+
+    // maps bytes (at most size()) for writing and leaves the buffer bound to GL_ARRAY_BUFFER; offset receives where the
+    // range starts. Null if the driver couldn't map it. unmap() before drawing.
+    void* map(size_t bytes, GLintptr& offset)
+    {
+        if (bytes > capacity)
+        {
+            std::cout << "ERROR::INSTANCE_STREAM::WRITE_TOO_LARGE: " << bytes << " bytes don't fit a " << capacity << " byte buffer" << std::endl;
+            return nullptr;
+        }
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, buffer.get());
+        if (cursor + bytes > capacity)
+        {
+            glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity), nullptr, GL_STREAM_DRAW);
+            cursor = 0;
+            frame.orphans++;
+        }
+        offset = static_cast<GLintptr>(cursor);
+        void* data = glMapBufferRange(GL_ARRAY_BUFFER, offset, static_cast<GLsizeiptr>(bytes),
+                                      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!data)
+        {
+            std::cout << "ERROR::INSTANCE_STREAM::MAP_FAILED" << std::endl;
+            return nullptr;
+        }
+        // keep the next range 16 byte aligned
+        cursor += (bytes + 15) & ~size_t(15);
+        frame.writes++;
+        frame.bytes += bytes;
+        return data;
+    }
+
+    void unmap()
+    {
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, buffer.get());
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+    GLuint get() const { return buffer.get(); }
+    size_t size() const { return capacity; }
+
+    // returns the traffic since the last call and starts counting again
+    InstanceStreamStats takeStats()
+    {
+        InstanceStreamStats stats = frame;
+        frame = InstanceStreamStats();
+        return stats;
+    }
+
+    void reset()
+    {
+        buffer.reset();
+        capacity = cursor = 0;
+    }
+
+private:
+    GLBuffer buffer;
+    size_t capacity = 0;
+    size_t cursor = 0;
+    InstanceStreamStats frame;
+};
+
+#endif
@@ -5,15 +5,31 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "PrimitiveRegistry.h"
 #include "Square.h"
 #include "stb_image.h"
 #include "Shader.h"
+#include "ShaderLibrary.h"
+#include "ShaderReloader.h"
 #include "Camera.h"
 #include "Camera2.h"
 #include "Model.h"
-
+#include "StreamingModel.h"
+#include "Benchmarks.h"
+#include "FrameUniforms.h"
+#include "FrustumCuller.h"
+#include "GeometryArena.h"
+#include "GLHandles.h"
+#include "GLState.h"
+#include "ProgramCache.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 
 
 
@@ -22,11 +38,15 @@ void processInput(GLFWwindow* window);
 void checkShaderCompilation(GLuint* shader);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 unsigned int loadTexture(const char* path);
+void releaseSharedResources();
 
 
-void drawModel(Shader& shader, Model& model);
-void drawViewAndProjection(Shader& shader);
+template<typename ModelType>
+void drawModel(Shader& shader, ModelType& model, const Frustum& frustum);
+glm::mat4 modelTransform();
+PerFrameData uploadFrameUniforms();
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -37,6 +57,7 @@ Camera2 camera;
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
+bool pickRequested = false;   // left click: pick what's under the crosshair next frame
 
 // timing
 float deltaTime = 0.0f;	// time between current frame and last frame
@@ -46,7 +67,7 @@ float mixValue = 0.2f;
 
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
-int main()
+int main(int argc, char** argv)
 {
     // glfw: initialize and configure
     // ------------------------------
@@ -76,6 +97,7 @@ int main()
 
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
 
     // tell GLFW to capture our mouse
     //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -100,9 +122,73 @@ int main()
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
-    // build and compile shaders
+    // benchmarks: OpenGLTemplate --bench-load <model path>
+    //             OpenGLTemplate --bench-memory <model path> [--keep-geometry]
+    if (argc > 2 && (std::strcmp(argv[1], "--bench-load") == 0 || std::strcmp(argv[1], "--bench-memory") == 0))
+    {
+        if (std::strcmp(argv[1], "--bench-load") == 0)
+            benchmarkModelLoad(argv[2]);
+        else
+            benchmarkModelMemory(argv[2], argc > 3 && std::strcmp(argv[3], "--keep-geometry") == 0);
+        releaseSharedResources();
+        glfwTerminate();
+        return 0;
+    }
+
+    // OpenGLTemplate --bench-bvh [object count]
+    if (argc > 1 && std::strcmp(argv[1], "--bench-bvh") == 0)
+    {
+        benchmarkBvh(argc > 2 ? std::atoi(argv[2]) : 10000);
+        glfwTerminate();
+        return 0;
+    }
+
+    // OpenGLTemplate --bench-transforms [node count]
+    if (argc > 1 && std::strcmp(argv[1], "--bench-transforms") == 0)
+    {
+        benchmarkTransforms(argc > 2 ? std::atoi(argv[2]) : 100000);
+        glfwTerminate();
+        return 0;
+    }
+
+    // OpenGLTemplate --bench-culling [bounds count]
+    if (argc > 1 && std::strcmp(argv[1], "--bench-culling") == 0)
+    {
+        benchmarkFrustumCulling(argc > 2 ? std::atoi(argv[2]) : 20000);
+        glfwTerminate();
+        return 0;
+    }
+
+    // OpenGLTemplate --bench-shaders: cold vs warm program binary cache, lazy vs warmed permutations
+    if (argc > 1 && std::strcmp(argv[1], "--bench-shaders") == 0)
+    {
+        benchmarkShaderStartup({ { "model_loading.vs", "model_loading.fs" }, { "coordinate.vs", "texture.fs" },
+                                 { "lighting_object.vs", "lighting_object.fs" }, { "lighting_light.vs", "lighting_light.fs" },
+                                 { "material.vs", "material.fs" } });
+        benchmarkShaderVariants();
+        releaseSharedResources();
+        glfwTerminate();
+        return 0;
+    }
+
+    // build and compile shaders (or load them from the program binary cache)
     // -------------------------
     Shader ourShader("model_loading.vs", "model_loading.fs");
+    ProgramCache::instance().printStats();
+    // edits to the shader files are picked up while running
+    ShaderReloader::instance().watch(ourShader);
+
+    // OpenGLTemplate --bench-uniforms (on a program that still has a plain 'model' uniform)
+    if (argc > 1 && std::strcmp(argv[1], "--bench-uniforms") == 0)
+    {
+        Shader uniformShader("coordinate.vs", "texture.fs");
+        benchmarkUniformSetters(uniformShader, ourShader);
+        uniformShader.ID.reset();
+        ourShader.ID.reset();
+        releaseSharedResources();
+        glfwTerminate();
+        return 0;
+    }
 
     //std::filesystem::path path("resources/models/backpack/backpack.obj");
 
@@ -110,12 +196,68 @@ int main()
     // -----------
     //Model ourModel(path.generic_string());
 
-    //load vertex arrays and buffer
-    unsigned int VBO, cubeVAO;
+    // OpenGLTemplate --stream <model path>: stream a model in coarse-to-fine while rendering
+    std::unique_ptr<StreamingModel> streamedModel;
+    if (argc > 2 && std::strcmp(argv[1], "--stream") == 0)
+        streamedModel.reset(new StreamingModel(argv[2]));
+    bool reportedStreaming = false;
+
+    // OpenGLTemplate ... --gl-stats: print redundant state changes filtered per frame every few seconds
+    bool printGLStats = false;
+    for (int i = 1; i < argc; i++)
+        if (std::strcmp(argv[i], "--gl-stats") == 0)
+            printGLStats = true;
+    unsigned int frameCount = 0;
+
+    // the cube comes from the shared primitive buffers
     Square square;
-    square.setupVBO(VBO);
-    square.setupVAO(cubeVAO, VBO, true, true);
 
+    // OpenGLTemplate --bench-queue <model path>
+    if (argc > 2 && std::strcmp(argv[1], "--bench-queue") == 0)
+    {
+        benchmarkRenderQueue(ourShader, square, argv[2], uploadFrameUniforms());
+        ourShader.ID.reset();
+        releaseSharedResources();
+        glfwTerminate();
+        return 0;
+    }
+
+    // OpenGLTemplate --bench-occlusion [model path]
+    if (argc > 1 && std::strcmp(argv[1], "--bench-occlusion") == 0)
+    {
+        benchmarkOcclusion(ourShader, square, argc > 2 ? argv[2] : "");
+        ourShader.ID.reset();
+        releaseSharedResources();
+        glfwTerminate();
+        return 0;
+    }
+
+    // OpenGLTemplate --bench-gpu-culling [object count]
+    if (argc > 1 && std::strcmp(argv[1], "--bench-gpu-culling") == 0)
+    {
+        benchmarkGpuCulling(ourShader, argc > 2 ? std::atoi(argv[2]) : 20000);
+        ourShader.ID.reset();
+        releaseSharedResources();
+        glfwTerminate();
+        return 0;
+    }
+
+    // OpenGLTemplate --bench-instancing [cube count]
+    if (argc > 1 && std::strcmp(argv[1], "--bench-instancing") == 0)
+    {
+        Shader instancedShader("instanced.vs", "instanced.fs");
+        GLVertexArray instancedVAO;
+        InstanceStream instances;
+        square.setupInstancedVAO(instancedVAO, instances);
+        benchmarkInstancing(square, ourShader, instancedShader, instances, uploadFrameUniforms(), argc > 2 ? std::atoi(argv[2]) : 20000);
+        instancedVAO.reset();
+        instances.reset();
+        instancedShader.ID.reset();
+        ourShader.ID.reset();
+        releaseSharedResources();
+        glfwTerminate();
+        return 0;
+    }
 
     while (!glfwWindowShouldClose(window))
     {
@@ -129,22 +271,65 @@ int main()
         // -----
         processInput(window);
 
+        GLState::instance().beginFrame();
+        if (printGLStats && ++frameCount % 300 == 0)
+        {
+            GLState::instance().printStats();
+            FrameUniforms::instance().printStats();
+            if (streamedModel)
+                streamedModel->cullStats().print("frustum culling");
+        }
+
+        // upload any textures the decode workers have finished
+        TextureLoader::instance().update();
+        // swap in shaders whose edited sources finished compiling
+        ShaderReloader::instance().update();
+
         // render
         // ------
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // view/projection transformations, shared by every program through the PerFrame block; the frustum planes
+        // come from the same matrix
+        PerFrameData frameUniforms = uploadFrameUniforms();
+        Frustum frustum = Frustum::fromMatrix(frameUniforms.viewProjection);
+
         // don't forget to enable shader before setting uniforms
         ourShader.use();
 
-        // view/projection transformations
-        drawViewAndProjection(ourShader);
-
         glm::vec3 cubePosition = glm::vec3(0.0f, 0.0f, 0.0f);
         square.drawShape(cubePosition, 1, ourShader);
 
         // render the loaded model
-        //drawModel(ourShader, ourModel);
+        //drawModel(ourShader, ourModel, frustum);
+
+        // refine the streamed model within this frame's upload budget, then draw whatever is resident
+        if (streamedModel)
+        {
+            streamedModel->update();
+            drawModel(ourShader, *streamedModel, frustum);
+            if (pickRequested)
+            {
+                // the cursor is captured, so the pick ray goes through the middle of the screen
+                Ray ray = Ray::fromScreen(SCR_WIDTH / 2.0f, SCR_HEIGHT / 2.0f, SCR_WIDTH, SCR_HEIGHT, frameUniforms.viewProjection);
+                RayHit hit = streamedModel->pick(ray, modelTransform());
+                if (hit.hit())
+                    std::cout << "picked mesh " << hit.primitive << " at distance " << hit.t << std::endl;
+                else
+                    std::cout << "picked nothing" << std::endl;
+            }
+            if (streamedModel->complete() && !reportedStreaming)
+            {
+                const StreamingStats& stats = streamedModel->stats;
+                std::cout << "streamed " << argv[2] << ": first mesh after " << stats.firstDrawableMs << " ms, all meshes drawable after "
+                          << stats.coarseCompleteMs << " ms (" << stats.coarseMeshes << " coarse LODs), full detail after " << stats.completeMs
+                          << " ms, " << stats.uploadedBytes / 1024 << " KiB uploaded" << std::endl;
+                reportedStreaming = true;
+            }
+        }
+
+        pickRequested = false;
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -152,8 +337,10 @@ int main()
         glfwPollEvents();
     }
 
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteBuffers(1, &VBO);
+    // GL objects have to be deleted while the context still exists
+    streamedModel.reset();
+    ourShader.ID.reset();
+    releaseSharedResources();
 
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
@@ -162,20 +349,31 @@ int main()
     return 0;
 }
 
-void drawViewAndProjection(Shader& shader) {
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 view = camera.GetViewMatrix();
-    shader.setMat4("projection", projection);
-    shader.setMat4("view", view);
+// uploads this frame's camera data to the PerFrame uniform block once, for every program
+PerFrameData uploadFrameUniforms() {
+    PerFrameData frame;
+    frame.projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    frame.view = camera.GetViewMatrix();
+    frame.viewProjection = frame.projection * frame.view;
+    frame.cameraPosition = camera.Position;
+    frame.time = static_cast<float>(glfwGetTime());
+    FrameUniforms::instance().beginFrame(frame);
+    return frame;
+}
+
+//renders the meshes of a model (a Model or a StreamingModel) that are inside the view frustum. Each mesh is drawn with
+//its node's world matrix placed by modelTransform(); Draw sets the shader's model matrix per mesh
+template<typename ModelType>
+void drawModel(Shader& shader, ModelType& model, const Frustum& frustum) {
+    model.Draw(shader, frustum, modelTransform());
 }
 
-//renders a model 
-void drawModel(Shader& shader, Model& model) {
+// where the loaded models are placed in the world; drawing and picking have to agree on it
+glm::mat4 modelTransform() {
     glm::mat4 model4 = glm::mat4(1.0f);
     model4 = glm::translate(model4, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
     model4 = glm::scale(model4, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
-    shader.setMat4("model", model4);
-    model.Draw(shader);
+    return model4;
 }
 
 void checkShaderCompilation(GLuint* shader) {
@@ -215,6 +413,12 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+        pickRequested = true;
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
@@ -266,41 +470,23 @@ void processInput(GLFWwindow* window)
         camera.RotateRight(deltaTime);
 }
 
+// deletes the GL objects held by the process-wide caches; must run before glfwTerminate
+void releaseSharedResources()
+{
+    ShaderLibrary::instance().clear();
+    ShaderReloader::instance().clear();
+    TextureLoader::instance().finish();
+    TextureCache::instance().purgeUnused();
+    GeometryArena::instance().clear();
+    PrimitiveRegistry::instance().clear();
+    FrameUniforms::instance().clear();
+}
+
 // utility function for loading a 2D texture from file
 // ---------------------------------------------------
 unsigned int loadTexture(char const* path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    // shared with models through the texture cache; decoded in the background, the returned texture
+    // shows a placeholder until it's uploaded
+    return TextureCache::instance().acquire(path);
 }
\ No newline at end of file
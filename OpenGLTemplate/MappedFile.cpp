@@ -0,0 +1,2 @@
+#define MAPPEDFILE_IMPLEMENTATION
+#include "MappedFile.h"
\ No newline at end of file
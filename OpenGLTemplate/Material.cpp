@@ -0,0 +1,2 @@
+#define MATERIAL_IMPLEMENTATION
+#include "Material.h"
\ No newline at end of file
@@ -0,0 +1,133 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+#include "Shader.h"
+#include "TextureCache.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// the kinds of texture a material can have; each maps to a sampler name prefix in the shaders
+enum class TextureType : uint32_t {
+    Diffuse,
+    Specular,
+    Normal,
+    Height,
+    Count
+};
+
+// sampler prefix of a texture type: 'texture_diffuseN', 'texture_specularN', 'texture_normalN' and 'texture_heightN'
+inline const char* textureTypeName(TextureType type)
+{
+    switch (type)
+    {
+    case TextureType::Specular: return "texture_specular";
+    case TextureType::Normal: return "texture_normal";
+    case TextureType::Height: return "texture_height";
+    default: return "texture_diffuse";
+    }
+}
+
+inline TextureType textureTypeFromName(const string& name)
+{
+    for (uint32_t t = 0; t < static_cast<uint32_t>(TextureType::Count); t++)
+        if (name == textureTypeName(static_cast<TextureType>(t)))
+            return static_cast<TextureType>(t);
+    return TextureType::Diffuse;
+}
+
+struct Texture {
+    unsigned int id;
+    TextureType type;
+    string path;
+};
+
+// a texture reference of a material, as found in the source file (type is the sampler prefix, e.g. "texture_diffuse")
+struct TextureRef {
+    string type;
+    string path;
+};
+
+// The textures of one material, built once when a model is loaded and shared by all its meshes. Each texture's sampler
+// name ('texture_diffuse1', ...) is hashed up front; binding looks the names up in the shader's reflected sampler units
+// once per shader and caches the result, so drawing only binds textures.
+class Material
+{
+public:
+    vector<Texture> textures;
+    // unique per material, for sorting draws by material (see RenderQueue)
+    uint64_t serial = 0;
+
+    // takes a reference on each texture through the texture cache (async: see TextureLoader::load)
+    Material(const vector<TextureRef>& refs, const string& directory, bool async = true)
+    {
+        static uint64_t nextSerial = 0;
+        serial = ++nextSerial;
+        unsigned int counts[static_cast<size_t>(TextureType::Count)] = {};
+        for (const TextureRef& ref : refs)
+        {
+            TextureType type = textureTypeFromName(ref.type);
+            textures.push_back({ TextureCache::instance().acquire(directory + '/' + ref.path, async), type, ref.path });
+            // the N in texture_diffuseN counts per type, starting at 1
+            samplers.push_back(UniformId(string(textureTypeName(type)) + to_string(++counts[static_cast<size_t>(type)])));
+        }
+    }
+
+    // gives the textures back to the cache
+    ~Material()
+    {
+        for (Texture& texture : textures)
+            TextureCache::instance().release(texture.id);
+    }
+
+    // owns texture references, shared between meshes through a shared_ptr instead
+    Material(const Material&) = delete;
+    Material& operator=(const Material&) = delete;
+
+    // binds every texture to the unit the shader assigned to its sampler; textures the shader has no sampler for are skipped
+    void bind(const Shader& shader)
+    {
+        const vector<GLint>& units = unitsFor(shader);
+        TextureCache& cache = TextureCache::instance();
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            // a texture that turned out to be a copy of a resident one is swapped for it
+            cache.resolve(textures[i].id);
+            if (units[i] < 0)
+                continue;
+            // skipped if the unit already holds the texture, e.g. when consecutive meshes share it
+            GLState::instance().bindTexture(static_cast<unsigned int>(units[i]), GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+private:
+    // texture units of the samplers of one shader
+    struct Binding {
+        uint64_t shader;   // Shader::serial
+        vector<GLint> units;
+    };
+
+    vector<UniformId> samplers;   // parallel to textures
+    vector<Binding> bindings;     // one per shader this material was drawn with, usually just one
+
+    const vector<GLint>& unitsFor(const Shader& shader)
+    {
+        for (const Binding& binding : bindings)
+            if (binding.shader == shader.serial)
+                return binding.units;
+        Binding binding;
+        binding.shader = shader.serial;
+        for (UniformId sampler : samplers)
+            binding.units.push_back(shader.samplerUnit(sampler));
+        bindings.push_back(std::move(binding));
+        return bindings.back().units;
+    }
+};
+
+#endif
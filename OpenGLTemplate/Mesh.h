@@ -6,9 +6,17 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "Bounds.h"
+#include "GeometryArena.h"
+#include "Material.h"
 #include "Shader.h"
+#include "VertexFormat.h"
 
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -31,116 +39,249 @@ struct Vertex {
     float m_Weights[MAX_BONE_INFLUENCE];
 };
 
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
+// largest number of vertices a 16-bit index can address
+const size_t MAX_SHORT_INDEXED_VERTICES = 65536;
+
+// a sub-range of a mesh's index buffer; its indices are relative to baseVertex so they fit in 16 bits
+struct MeshRange {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t  baseVertex;
+};
+
+// CPU-side geometry of a mesh before it is uploaded. Import and optimization work on the full precision vertices and
+// 32-bit indices; packIndices() then splits the mesh into 16-bit addressable ranges and packVertices() converts the
+// vertices to the compact format that gets uploaded (both free the data they replace).
+struct MeshData {
+    vector<Vertex>         vertices;
+    vector<unsigned int>   indices;
+    unsigned int           materialIndex = 0;
+    uint32_t               node = 0;   // the node it hangs off in the model's TransformGraph
+    VertexFormat           format = VertexFormat::Static;
+    vector<unsigned char>  packedVertices;
+    vector<unsigned short> packedIndices;
+    vector<MeshRange>      ranges;
+
+    // converts the indices to 16 bits. Meshes with more vertices than a short can address are split into ranges of
+    // consecutive triangles, each getting its own copy of the vertices it uses (only boundary vertices are duplicated).
+    void packIndices()
+    {
+        packedIndices.clear();
+        packedIndices.reserve(indices.size());
+        ranges.clear();
+        if (vertices.size() <= MAX_SHORT_INDEXED_VERTICES)
+        {
+            for (unsigned int index : indices)
+                packedIndices.push_back(static_cast<unsigned short>(index));
+            ranges.push_back({ 0, static_cast<uint32_t>(indices.size()), 0 });
+        }
+        else
+        {
+            const unsigned int UNUSED = 0xffffffffu;
+            vector<Vertex> split;
+            split.reserve(vertices.size());
+            vector<unsigned int> local(vertices.size(), UNUSED);
+            vector<unsigned int> touched;
+            MeshRange range = { 0, 0, 0 };
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                // start a new range when this triangle's new vertices wouldn't fit anymore
+                size_t added = 0;
+                for (int k = 0; k < 3; k++)
+                    if (local[indices[t + k]] == UNUSED)
+                        added++;
+                if (split.size() - range.baseVertex + added > MAX_SHORT_INDEXED_VERTICES)
+                {
+                    ranges.push_back(range);
+                    range = { static_cast<uint32_t>(t), 0, static_cast<int32_t>(split.size()) };
+                    for (unsigned int v : touched)
+                        local[v] = UNUSED;
+                    touched.clear();
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int v = indices[t + k];
+                    if (local[v] == UNUSED)
+                    {
+                        local[v] = static_cast<unsigned int>(split.size() - range.baseVertex);
+                        touched.push_back(v);
+                        split.push_back(vertices[v]);
+                    }
+                    packedIndices.push_back(static_cast<unsigned short>(local[v]));
+                }
+                range.indexCount += 3;
+            }
+            ranges.push_back(range);
+            vertices.swap(split);
+        }
+        vector<unsigned int>().swap(indices);
+    }
+
+    size_t indexCount() const
+    {
+        return indices.empty() ? packedIndices.size() : indices.size();
+    }
+
+    size_t vertexCount() const
+    {
+        return vertices.empty() ? packedVertices.size() / vertexStride(format) : vertices.size();
+    }
+
+    void packVertices()
+    {
+        switch (format)
+        {
+        case VertexFormat::NormalMapped: packAs<NormalMappedVertex>(); break;
+        case VertexFormat::Skinned: packAs<SkinnedVertex>(); break;
+        case VertexFormat::SkinnedNormalMapped: packAs<SkinnedNormalMappedVertex>(); break;
+        default: packAs<StaticVertex>(); break;
+        }
+        vector<Vertex>().swap(vertices);
+    }
+
+private:
+    template<typename Packed>
+    void packAs()
+    {
+        packedVertices.resize(vertices.size() * sizeof(Packed));
+        Packed* out = reinterpret_cast<Packed*>(packedVertices.data());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const Vertex& vertex = vertices[i];
+            Packed packed{};
+            memcpy(packed.position, &vertex.Position, sizeof(packed.position));
+            packed.normal = packNormal(vertex.Normal);
+            packed.texCoords = packTexCoords(vertex.TexCoords);
+            if constexpr (Packed::hasTangent)
+                packed.tangent = packTangent(vertex.Normal, vertex.Tangent, vertex.Bitangent);
+            if constexpr (Packed::hasBones)
+                packBones(vertex.m_BoneIDs, vertex.m_Weights, packed.boneIDs, packed.weights);
+            out[i] = packed;
+        }
+    }
 };
 
 class Mesh {
 public:
-    // mesh Data
-    vector<Vertex>       vertices;
-    vector<unsigned int> indices;
-    vector<Texture>      textures;
-    unsigned int VAO;
+    // mesh Data, vertices are packed in format and indices are 16 bit, relative to each range's base vertex
+    // (vertexData and indices are only kept when asked for, the GPU copy in the geometry arena is what gets drawn)
+    vector<unsigned char>  vertexData;
+    vector<unsigned short> indices;
+    vector<MeshRange>      ranges;
+    shared_ptr<Material>   material;   // shared by every mesh of the model that uses it
+    VertexFormat format = VertexFormat::Static;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    // where the mesh lives in the shared geometry arena
+    GeometryArena::Allocation geometry;
+    // box and sphere around the vertices, in model space
+    Bounds bounds;
+
+    // constructor, takes over the geometry and uploads it. With keepGeometry unset the CPU copy is freed right after.
+    Mesh(vector<unsigned char>&& vertexData, VertexFormat format, vector<unsigned short>&& indices, vector<MeshRange>&& ranges, shared_ptr<Material> material,
+         bool keepGeometry = false)
+        : vertexData(std::move(vertexData)), indices(std::move(indices)), ranges(std::move(ranges)), material(std::move(material)), format(format)
+    {
+        // now that we have all the required data, copy it into the geometry arena.
+        setupMesh(this->vertexData.data(), this->vertexData.size() / vertexStride(format), this->indices.data(), this->indices.size());
+        if (!keepGeometry)
+            dropGeometry();
+    }
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor that uploads from memory owned by someone else (e.g. a mapped model cache) without keeping a copy
+    Mesh(const void* vertexData, size_t vertexCount, VertexFormat format, const unsigned short* indexData, size_t indexCount,
+         vector<MeshRange>&& ranges, shared_ptr<Material> material)
+        : ranges(std::move(ranges)), material(std::move(material)), format(format)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
+    }
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+    // gives the geometry back to the arena
+    ~Mesh()
+    {
+        release();
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // a mesh owns its arena allocation, so it can only be moved
+    Mesh(Mesh&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    Mesh& operator=(Mesh&& other) noexcept
     {
-        // bind appropriate textures
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++)
+        if (this != &other)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            release();
+            vertexData = std::move(other.vertexData);
+            indices = std::move(other.indices);
+            ranges = std::move(other.ranges);
+            material = std::move(other.material);
+            format = other.format;
+            vertexCount = other.vertexCount;
+            indexCount = other.indexCount;
+            geometry = other.geometry;
+            bounds = other.bounds;
+            other.geometry.valid = false;
         }
+        return *this;
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // frees the CPU copy of the geometry; drawing only needs the arena
+    void dropGeometry()
+    {
+        vector<unsigned char>().swap(vertexData);
+        vector<unsigned short>().swap(indices);
+    }
+
+    // render the mesh
+    void Draw(Shader& shader)
+    {
+        // bind appropriate textures, the samplers already point at their units
+        if (material)
+            material->bind(shader);
+
+        // draw mesh, one draw per 16-bit range (almost always just one)
+        GeometryArena::instance().bind(format);
+        for (const MeshRange& range : ranges)
+            glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_SHORT, indexOffset(range), baseVertex(range));
+    }
+
+    // true when other draws with the same material from the same arena VAO, so both can go into one multi-draw
+    bool sharesMaterial(const Mesh& other) const
+    {
+        return format == other.format && material == other.material;
+    }
+
+    // byte offset of a range's first index in the arena's index buffer
+    const void* indexOffset(const MeshRange& range) const
+    {
+        return (void*)((geometry.indexOffset + range.firstIndex) * sizeof(unsigned short));
+    }
+
+    // vertex the range's indices are relative to, in the arena's vertex buffer
+    GLint baseVertex(const MeshRange& range) const
+    {
+        return static_cast<GLint>(geometry.vertexOffset + range.baseVertex);
     }
 
 private:
-    // render data 
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
-    {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-        // ids
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        // weights
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+    void release()
+    {
+        GeometryArena::instance().free(geometry);
+    }
+
+    // sub-allocates the mesh in the arena of its vertex format and uploads it there. The bounds are taken from the packed
+    // positions on the way, which every load path (import, cooked cache, streaming) goes through.
+    void setupMesh(const void* vertexData, size_t vertexCount, const unsigned short* indexData, size_t indexCount)
+    {
+        this->vertexCount = static_cast<unsigned int>(vertexCount);
+        this->indexCount = static_cast<unsigned int>(indexCount);
+        bounds = Bounds::fromPositions(vertexData, vertexCount, vertexStride(format));
+        geometry = GeometryArena::instance().allocate(format, vertexData, vertexCount, indexData, indexCount);
     }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,2 @@
+#define MESHOPTIMIZER_IMPLEMENTATION
+#include "MeshOptimizer.h"
\ No newline at end of file
@@ -0,0 +1,278 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include "Hash.h"
+#include "Mesh.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// before/after numbers of one MeshOptimizer::optimize run.
+// ACMR = post-transform cache misses per triangle (lower is better, 0.5 is the practical floor),
+// ATVR = cache misses per vertex (1.0 means every vertex is shaded exactly once).
+struct MeshOptimizeStats {
+    size_t verticesBefore = 0, verticesAfter = 0;
+    size_t triangles = 0;
+    float acmrBefore = 0.0f, acmrAfter = 0.0f;
+    float atvrBefore = 0.0f, atvrAfter = 0.0f;
+};
+
+// Import-time mesh optimization: welds identical vertices, reorders triangles for post-transform cache reuse
+// (Tipsify, Sander et al. 2007) and renumbers vertices in first-use order so vertex fetch walks memory linearly.
+// Only touches CPU data, so it runs on the loader's worker threads.
+class MeshOptimizer
+{
+public:
+    // size of the simulated FIFO post-transform cache
+    static const unsigned int CACHE_SIZE = 16;
+
+    static MeshOptimizeStats optimize(MeshData& mesh)
+    {
+        MeshOptimizeStats stats;
+        stats.verticesBefore = mesh.vertices.size();
+        stats.triangles = mesh.indices.size() / 3;
+        measure(mesh.indices, mesh.vertices.size(), stats.acmrBefore, stats.atvrBefore);
+
+        if (!mesh.indices.empty())
+        {
+            weldVertices(mesh);
+            mesh.indices = tipsify(mesh.indices, mesh.vertices.size(), CACHE_SIZE);
+            reorderVertices(mesh);
+        }
+
+        stats.verticesAfter = mesh.vertices.size();
+        measure(mesh.indices, mesh.vertices.size(), stats.acmrAfter, stats.atvrAfter);
+        return stats;
+    }
+
+    // merges bit-identical vertices and rewrites the indices to match
+    static void weldVertices(MeshData& mesh)
+    {
+        vector<Vertex>& vertices = mesh.vertices;
+        const uint32_t EMPTY = 0xffffffffu;
+        size_t tableSize = 1;
+        while (tableSize < vertices.size() * 2)
+            tableSize <<= 1;
+        // open addressing table of indices into the welded vertex array
+        vector<uint32_t> table(tableSize, EMPTY);
+        vector<uint32_t> remap(vertices.size());
+        size_t unique = 0;
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            size_t slot = fnv1a(&vertices[i], sizeof(Vertex)) & (tableSize - 1);
+            while (table[slot] != EMPTY && memcmp(&vertices[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+                slot = (slot + 1) & (tableSize - 1);
+            if (table[slot] == EMPTY)
+            {
+                vertices[unique] = vertices[i];
+                table[slot] = static_cast<uint32_t>(unique++);
+            }
+            remap[i] = table[slot];
+        }
+        vertices.resize(unique);
+        for (unsigned int& index : mesh.indices)
+            index = remap[index];
+    }
+
+    // Tipsify: fans around a vertex emitting all of its remaining triangles, then picks the next fanning vertex
+    // among the ones just emitted that will still be in the cache, falling back to a dead-end stack.
+    static vector<unsigned int> tipsify(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+    {
+        size_t triangleCount = indices.size() / 3;
+
+        // vertex -> triangle adjacency
+        vector<uint32_t> liveTriangles(vertexCount, 0);
+        for (unsigned int index : indices)
+            liveTriangles[index]++;
+        vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + liveTriangles[v];
+        vector<uint32_t> adjacency(indices.size());
+        vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+        vector<uint32_t> cacheTime(vertexCount, 0);
+        uint32_t timestamp = cacheSize + 1;
+        vector<bool> emitted(triangleCount, false);
+        vector<uint32_t> deadEnd;
+        vector<uint32_t> candidates;
+        vector<unsigned int> output;
+        output.reserve(indices.size());
+        size_t cursor = 0;
+
+        int64_t fanning = 0;
+        while (fanning >= 0)
+        {
+            candidates.clear();
+            for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+            {
+                uint32_t triangle = adjacency[a];
+                if (emitted[triangle])
+                    continue;
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int v = indices[triangle * 3 + k];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (timestamp - cacheTime[v] > cacheSize)
+                        cacheTime[v] = timestamp++;
+                }
+                emitted[triangle] = true;
+            }
+
+            // best candidate: a vertex that is still cached and stays cached while its remaining triangles are emitted
+            fanning = -1;
+            int64_t bestPriority = -1;
+            for (uint32_t v : candidates)
+            {
+                if (liveTriangles[v] == 0)
+                    continue;
+                int64_t priority = 0;
+                if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                    priority = timestamp - cacheTime[v];
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    fanning = v;
+                }
+            }
+            if (fanning >= 0)
+                continue;
+
+            // dead end: go back to recently used vertices, then scan for any vertex with triangles left
+            while (!deadEnd.empty() && fanning < 0)
+            {
+                uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[v] > 0)
+                    fanning = v;
+            }
+            while (fanning < 0 && cursor < vertexCount)
+            {
+                if (liveTriangles[cursor] > 0)
+                    fanning = static_cast<int64_t>(cursor);
+                cursor++;
+            }
+        }
+        return output;
+    }
+
+    // renumbers vertices in the order the index buffer first uses them and drops unreferenced ones
+    static void reorderVertices(MeshData& mesh)
+    {
+        const unsigned int UNUSED = 0xffffffffu;
+        vector<unsigned int> remap(mesh.vertices.size(), UNUSED);
+        vector<Vertex> reordered;
+        reordered.reserve(mesh.vertices.size());
+        for (unsigned int& index : mesh.indices)
+        {
+            if (remap[index] == UNUSED)
+            {
+                remap[index] = static_cast<unsigned int>(reordered.size());
+                reordered.push_back(mesh.vertices[index]);
+            }
+            index = remap[index];
+        }
+        mesh.vertices.swap(reordered);
+    }
+
+    // coarse stand-in for mesh by vertex clustering (Rossignac & Borrel): vertices are snapped to a gridSize^3 grid over
+    // the bounding box, each occupied cell becomes one vertex at the average of its members, and triangles that collapse
+    // are dropped. Cheap enough to run before the real optimization, so streaming has something to show early.
+    static MeshData simplifyClustered(const MeshData& mesh, unsigned int gridSize = 32)
+    {
+        MeshData coarse;
+        coarse.materialIndex = mesh.materialIndex;
+        coarse.node = mesh.node;
+        coarse.format = mesh.format;
+        if (mesh.vertices.empty() || mesh.indices.empty())
+            return coarse;
+
+        glm::vec3 minimum = mesh.vertices[0].Position, maximum = minimum;
+        for (const Vertex& vertex : mesh.vertices)
+        {
+            minimum = glm::min(minimum, vertex.Position);
+            maximum = glm::max(maximum, vertex.Position);
+        }
+        glm::vec3 extent = glm::max(maximum - minimum, glm::vec3(1e-6f));
+        glm::vec3 scale = glm::vec3(static_cast<float>(gridSize) - 0.5f) / extent;
+
+        // cell -> coarse vertex, through an open addressing table keyed by the packed cell coordinate
+        const uint32_t EMPTY = 0xffffffffu;
+        size_t tableSize = 1;
+        while (tableSize < mesh.vertices.size() * 2)
+            tableSize <<= 1;
+        vector<uint64_t> cellKeys(tableSize);
+        vector<uint32_t> cellVertex(tableSize, EMPTY);
+        vector<uint32_t> remap(mesh.vertices.size());
+        vector<uint32_t> members;
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+        {
+            glm::vec3 cell = (mesh.vertices[i].Position - minimum) * scale;
+            uint64_t key = (static_cast<uint64_t>(cell.x) << 42) | (static_cast<uint64_t>(cell.y) << 21) | static_cast<uint64_t>(cell.z);
+            size_t slot = fnv1a(&key, sizeof(key)) & (tableSize - 1);
+            while (cellVertex[slot] != EMPTY && cellKeys[slot] != key)
+                slot = (slot + 1) & (tableSize - 1);
+            if (cellVertex[slot] == EMPTY)
+            {
+                cellKeys[slot] = key;
+                cellVertex[slot] = static_cast<uint32_t>(coarse.vertices.size());
+                coarse.vertices.push_back(mesh.vertices[i]);
+                coarse.vertices.back().Position = glm::vec3(0.0f);
+                coarse.vertices.back().Normal = glm::vec3(0.0f);
+                members.push_back(0);
+            }
+            uint32_t target = cellVertex[slot];
+            coarse.vertices[target].Position += mesh.vertices[i].Position;
+            coarse.vertices[target].Normal += mesh.vertices[i].Normal;
+            members[target]++;
+            remap[i] = target;
+        }
+        for (size_t v = 0; v < coarse.vertices.size(); v++)
+        {
+            coarse.vertices[v].Position /= static_cast<float>(members[v]);
+            float length = glm::length(coarse.vertices[v].Normal);
+            if (length > 0.0f)
+                coarse.vertices[v].Normal /= length;
+        }
+
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+        {
+            unsigned int a = remap[mesh.indices[t]], b = remap[mesh.indices[t + 1]], c = remap[mesh.indices[t + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            coarse.indices.push_back(a);
+            coarse.indices.push_back(b);
+            coarse.indices.push_back(c);
+        }
+        return coarse;
+    }
+
+    // simulates a FIFO post-transform cache of CACHE_SIZE entries over the index buffer
+    static void measure(const vector<unsigned int>& indices, size_t vertexCount, float& acmr, float& atvr)
+    {
+        acmr = atvr = 0.0f;
+        if (indices.size() < 3 || vertexCount == 0)
+            return;
+        // a vertex is cached if fewer than CACHE_SIZE misses happened since it was inserted
+        vector<uint64_t> insertedAt(vertexCount, 0);
+        uint64_t misses = 0;
+        for (unsigned int index : indices)
+        {
+            if (insertedAt[index] == 0 || misses - insertedAt[index] >= CACHE_SIZE)
+            {
+                misses++;
+                insertedAt[index] = misses; // 1-based, so 0 means never cached
+            }
+        }
+        acmr = static_cast<float>(misses) / (indices.size() / 3);
+        atvr = static_cast<float>(misses) / vertexCount;
+    }
+};
+
+#endif
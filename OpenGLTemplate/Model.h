@@ -8,93 +8,474 @@
 #include "stb_image.h"
 
 #include <assimp/Importer.hpp>
+#include <assimp/config.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "Bounds.h"
+#include "Bvh.h"
+#include "FrustumCuller.h"
+#include "Material.h"
 #include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "ModelCache.h"
+#include "OcclusionCuller.h"
+#include "RenderQueue.h"
 #include "Shader.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+#include "TransformGraph.h"
 
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <utility>
 #include <vector>
 using namespace std;
 
+// timings of the last load, in milliseconds
+struct ModelLoadStats {
+    double importMs = 0.0;   // Assimp ReadFile + post-processing, or mapping the cooked cache
+    double convertMs = 0.0;  // aiMesh -> Vertex/index conversion (on the worker pool when parallelLoad is set)
+    double uploadMs = 0.0;   // textures + copying the meshes into the geometry arena on the GL thread
+    unsigned int meshCount = 0;
+    size_t vertexBytes = 0;           // uploaded vertex data in the packed formats
+    size_t unpackedVertexBytes = 0;   // what the same vertices take as full precision Vertex
+    size_t indexBytes = 0;            // uploaded 16-bit indices
+    bool fromCache = false;   // meshes were uploaded from a cooked cache instead of ASSIMP
+    vector<MeshOptimizeStats> optimizeStats;  // per mesh, in node order (empty for cached loads, those were optimized when cooked)
+};
+
 class Model
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    vector<shared_ptr<Material>> materials;   // by ASSIMP material index; null for materials no mesh uses
     string directory;
     bool gammaCorrection;
+    bool parallelLoad;
+    bool useCache;
+    bool keepGeometry;
+    ModelLoadStats loadStats;
+    // the file's node hierarchy, and the node each mesh hangs off. Meshes are placed by their node's world matrix;
+    // moving a part is nodes.setLocal() on its node, the next draw picks it up.
+    TransformGraph nodes;
+    vector<uint32_t> meshNodes;
+    // union of the meshes' bounds as placed by their nodes, in model space
+    Bounds bounds;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    // with parallelLoad the CPU side of every mesh is converted on the shared worker pool; GL uploads always stay on this thread.
+    // with useCache a cooked cache next to the model is read (or written) so warm loads skip ASSIMP.
+    // with keepGeometry the meshes keep a CPU copy of their vertices and indices after upload (otherwise only the GPU has them).
+    Model(string const& path, bool gamma = false, bool parallel = true, bool cache = true, bool keepGeometry = false)
+        : gammaCorrection(gamma), parallelLoad(parallel), useCache(cache), keepGeometry(keepGeometry)
     {
         loadModel(path);
+        nodes.update();
+        placeMeshes();
+        meshTree.build(placedBounds);
+        // the second level, for exact picking; only possible while the meshes still have their CPU geometry. These stay
+        // in mesh space, so moving nodes doesn't touch them.
+        if (keepGeometry)
+        {
+            triangleTrees.resize(meshes.size());
+            for (size_t i = 0; i < meshes.size(); i++)
+                triangleTrees[i].build(meshes[i]);
+        }
+    }
+
+    // meshes own references into the texture cache and the geometry arena, so a model can be moved but not copied
+    Model(Model&&) = default;
+    Model& operator=(Model&&) = default;
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    // draws the model, and thus all its meshes, placed by model. The shader's model matrix is set per mesh, to model
+    // times the mesh's node transform. Runs of consecutive meshes sharing a material and a node transform are merged
+    // into a single glMultiDrawElementsBaseVertex, since they all live in the same arena VAO.
+    void Draw(Shader& shader, const glm::mat4& model = glm::mat4(1.0f))
+    {
+        updateTransforms();
+        if (allMeshes.size() != meshes.size())
+        {
+            allMeshes.resize(meshes.size());
+            for (size_t i = 0; i < meshes.size(); i++)
+                allMeshes[i] = static_cast<uint32_t>(i);
+        }
+        drawMeshes(shader, allMeshes, model);
+    }
+
+    // draws only the meshes whose bounds, placed by model, intersect frustum (world space, see Frustum::fromMatrix).
+    // See cullStats() for what was left out.
+    void Draw(Shader& shader, const Frustum& frustum, const glm::mat4& model)
+    {
+        updateTransforms();
+        drawMeshes(shader, cullMeshes(frustum, model), model);
+    }
+
+    // the same, also leaving out meshes occlusion finds hidden behind this frame's occluders; occlusion has to be
+    // rasterized already. See OcclusionCuller::stats() for what it removed.
+    void Draw(Shader& shader, const Frustum& frustum, const glm::mat4& model, OcclusionCuller& occlusion)
+    {
+        updateTransforms();
+        drawMeshes(shader, occlusionCull(cullMeshes(frustum, model), occlusion, model), model);
+    }
+
+    // queues every mesh for RenderQueue::execute instead of drawing now
+    void Submit(RenderQueue& queue, Shader& shader, const glm::mat4& model, RenderPass pass = RenderPass::Opaque)
+    {
+        updateTransforms();
+        for (size_t i = 0; i < meshes.size(); i++)
+            queue.submit(shader, meshes[i], model * meshTransform(i), pass);
+    }
+
+    // queues only the meshes inside frustum
+    void Submit(RenderQueue& queue, Shader& shader, const glm::mat4& model, const Frustum& frustum, RenderPass pass = RenderPass::Opaque)
+    {
+        updateTransforms();
+        for (uint32_t i : cullMeshes(frustum, model))
+            queue.submit(shader, meshes[i], model * meshTransform(i), pass);
+    }
+
+    // queues only the meshes inside frustum that occlusion doesn't find hidden
+    void Submit(RenderQueue& queue, Shader& shader, const glm::mat4& model, const Frustum& frustum, OcclusionCuller& occlusion, RenderPass pass = RenderPass::Opaque)
+    {
+        updateTransforms();
+        for (uint32_t i : occlusionCull(cullMeshes(frustum, model), occlusion, model))
+            queue.submit(shader, meshes[i], model * meshTransform(i), pass);
+    }
+
+    // hands the meshes whose placed bounds have at least minRadius (walls, floors, big props) to occlusion as this
+    // frame's occluders. Needs the CPU geometry, so only does anything for models loaded with keepGeometry. Returns how
+    // many meshes were added.
+    size_t addOccluders(OcclusionCuller& occlusion, const glm::mat4& model, float minRadius = 0.0f)
+    {
+        updateTransforms();
+        size_t added = 0;
+        for (size_t i = 0; i < meshes.size(); i++)
+            if (placedBounds[i].radius >= minRadius && occlusion.addOccluder(meshes[i], model * meshTransform(i)))
+                added++;
+        return added;
+    }
+
+    // where mesh sits in the model: its node's world matrix as of the last updateTransforms()
+    const glm::mat4& meshTransform(size_t mesh) const { return nodes.world(meshNodes[mesh]); }
+
+    // recomputes the world matrices of nodes moved since the last call (only their subtrees, see TransformGraph::update)
+    // and refits the mesh tree and bounds to where their meshes went. Drawing, submitting, picking and addOccluders
+    // call it; it's cheap when nothing moved.
+    void updateTransforms()
+    {
+        if (!nodes.update())
+            return;
+        placeMeshes();
+        meshTree.refit(placedBounds);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader& shader)
+    // the last frustum test of Draw or Submit
+    const CullStats& cullStats() const { return lastCull; }
+
+    // the closest mesh hit by worldRay with the model placed by model (primitive is the mesh index, t the distance along
+    // worldRay). Hits are exact triangles when the model was loaded with keepGeometry, mesh bounds otherwise.
+    RayHit pick(const Ray& worldRay, const glm::mat4& model)
     {
-        for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        updateTransforms();
+        Ray ray = worldRay.transformed(glm::inverse(model));
+        if (triangleTrees.empty())
+            return meshTree.intersect(ray);
+        return meshTree.intersect(ray, [&](uint32_t mesh, float) {
+            return triangleTrees[mesh].intersect(ray.transformed(glm::inverse(meshTransform(mesh)))).t;
+        });
     }
 
+    // the mesh level tree, e.g. for its build stats
+    const Bvh& meshHierarchy() const { return meshTree; }
+
 private:
+    // per-draw arrays of the last batch, kept around so drawing doesn't allocate
+    vector<GLsizei> batchCounts;
+    vector<const void*> batchOffsets;
+    vector<GLint> batchBaseVertices;
+    // 0..meshes.size() - 1, the draw list when nothing is culled
+    vector<uint32_t> allMeshes;
+    FrustumCuller culler;
+    // the meshes' bounds placed by their nodes, in model space
+    vector<Bounds> placedBounds;
+    // BVH over placedBounds, and one over the triangles of each mesh in mesh space (keepGeometry only)
+    Bvh meshTree;
+    vector<TriangleBvh> triangleTrees;
+    vector<uint32_t> treeVisible;
+    vector<uint32_t> unoccluded;
+    CullStats lastCull;
+
+    // below this many meshes testing all of them with the SIMD culler beats walking the tree
+    static const size_t BVH_CULL_THRESHOLD = 32;
+
+    // recomputes placedBounds and bounds from the node transforms
+    void placeMeshes()
+    {
+        placedBounds.resize(meshes.size());
+        bounds = Bounds();
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            placedBounds[i] = meshes[i].bounds.transformed(meshTransform(i));
+            bounds.merge(placedBounds[i]);
+        }
+    }
+
+    // indices of the meshes inside frustum, ascending (so material runs still merge). Small models test the world space
+    // bounds of every mesh in one go; larger ones walk the mesh tree with the frustum moved into model space instead.
+    const vector<uint32_t>& cullMeshes(const Frustum& frustum, const glm::mat4& model)
+    {
+        if (meshes.size() < BVH_CULL_THRESHOLD || meshTree.empty())
+        {
+            culler.clear();
+            culler.reserve(meshes.size());
+            for (size_t i = 0; i < meshes.size(); i++)
+                culler.add(meshes[i].bounds.transformed(model * meshTransform(i)));
+            const vector<uint32_t>& visible = culler.cull(frustum);
+            lastCull = culler.stats();
+            return visible;
+        }
+        auto start = chrono::steady_clock::now();
+        meshTree.cull(frustum.transformed(model), treeVisible);
+        sort(treeVisible.begin(), treeVisible.end());
+        lastCull.tested = meshes.size();
+        lastCull.visible = treeVisible.size();
+        lastCull.kernel = CullKernel::Bvh;
+        lastCull.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return treeVisible;
+    }
+
+    // the listed meshes that occlusion doesn't find hidden, order kept
+    const vector<uint32_t>& occlusionCull(const vector<uint32_t>& list, OcclusionCuller& occlusion, const glm::mat4& model)
+    {
+        unoccluded.clear();
+        for (uint32_t i : list)
+            if (occlusion.visible(meshes[i].bounds, model * meshTransform(i)))
+                unoccluded.push_back(i);
+        return unoccluded;
+    }
+
+    // draws the listed meshes in order, placed by model; runs of them sharing a material and a node transform go into
+    // one multi-draw. The shader's model matrix is only set when the transform changes.
+    void drawMeshes(Shader& shader, const vector<uint32_t>& list, const glm::mat4& model)
+    {
+        const glm::mat4* placed = nullptr;
+        for (size_t first = 0; first < list.size();)
+        {
+            const glm::mat4& transform = meshTransform(list[first]);
+            size_t last = first + 1;
+            while (last < list.size() && meshes[list[last]].sharesMaterial(meshes[list[first]]) && meshTransform(list[last]) == transform)
+                last++;
+            if (!placed || *placed != transform)
+            {
+                shader.setModel(model * transform);
+                placed = &transform;
+            }
+            if (last - first == 1)
+                meshes[list[first]].Draw(shader);
+            else
+                drawBatch(shader, list, first, last);
+            first = last;
+        }
+    }
+
+    // draws list[first, last), which share textures and vertex format, in one call
+    void drawBatch(Shader& shader, const vector<uint32_t>& list, size_t first, size_t last)
+    {
+        batchCounts.clear();
+        batchOffsets.clear();
+        batchBaseVertices.clear();
+        for (size_t i = first; i < last; i++)
+        {
+            const Mesh& mesh = meshes[list[i]];
+            for (const MeshRange& range : mesh.ranges)
+            {
+                batchCounts.push_back(static_cast<GLsizei>(range.indexCount));
+                batchOffsets.push_back(mesh.indexOffset(range));
+                batchBaseVertices.push_back(mesh.baseVertex(range));
+            }
+        }
+
+        const Mesh& front = meshes[list[first]];
+        if (front.material)
+            front.material->bind(shader);
+        GeometryArena::instance().bind(front.format);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, batchCounts.data(), GL_UNSIGNED_SHORT, batchOffsets.data(),
+                                      static_cast<GLsizei>(batchCounts.size()), batchBaseVertices.data());
+    }
+
+    static double millisecondsSince(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // a cooked cache next to the file is used instead of ASSIMP when it was cooked from the file's current contents.
     void loadModel(string const& path)
     {
-        // read file via ASSIMP
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        loadStats = ModelLoadStats();
+
+        auto start = chrono::steady_clock::now();
+        ModelCache::Source source(path);
+        bool cacheable = useCache && source.exists();
+        if (cacheable && loadFromCache(ModelCache::cachePath(path), source))
+            return;
+
+        // read file via ASSIMP. Points and lines are split off and dropped, only triangles are drawn.
         Assimp::Importer importer;
-        
-        const struct aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+        const struct aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_SortByPType | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices);
         // check for errors
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
-        
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        loadStats.importMs = millisecondsSince(start);
+
+        // collect ASSIMP's meshes in node order and the node hierarchy by walking the root node recursively
+        vector<const aiMesh*> order;
+        vector<uint32_t> orderNodes;
+        processNode(scene->mRootNode, scene, order, nodes, orderNodes);
+        loadStats.meshCount = static_cast<unsigned int>(order.size());
+
+        // convert every mesh to our vertex format and optimize it for the vertex cache; this is pure CPU work so it can be fanned out
+        start = chrono::steady_clock::now();
+        vector<MeshData> converted(order.size());
+        loadStats.optimizeStats.resize(order.size());
+        auto convert = [&](size_t i) {
+            converted[i] = processMesh(order[i], scene->mMaterials[order[i]->mMaterialIndex]);
+            converted[i].node = orderNodes[i];
+            loadStats.optimizeStats[i] = MeshOptimizer::optimize(converted[i]);
+            converted[i].packIndices();
+            converted[i].packVertices();
+        };
+        if (parallelLoad && order.size() > 1)
+            ThreadPool::shared().parallelFor(order.size(), convert);
+        else
+            for (size_t i = 0; i < order.size(); i++)
+                convert(i);
+
+        vector<vector<TextureRef>> materialRefs(scene->mNumMaterials);
+        for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+            materialRefs[i] = processMaterial(scene->mMaterials[i]);
+        loadStats.convertMs = millisecondsSince(start);
+
+        // cook the result so the next load can skip ASSIMP
+        if (cacheable)
+            ModelCache::write(ModelCache::cachePath(path), source, converted, materialRefs, nodes);
+
+        // textures and buffer uploads need the GL context, so they happen here, in node order, which keeps the result deterministic
+        start = chrono::steady_clock::now();
+        meshes.reserve(meshes.size() + converted.size());
+        for (MeshData& data : converted)
+        {
+            meshNodes.push_back(data.node);
+            shared_ptr<Material> material = loadMaterial(materialRefs, data.materialIndex);
+            loadStats.vertexBytes += data.packedVertices.size();
+            loadStats.unpackedVertexBytes += data.vertexCount() * sizeof(Vertex);
+            loadStats.indexBytes += data.packedIndices.size() * sizeof(unsigned short);
+            meshes.emplace_back(std::move(data.packedVertices), data.format, std::move(data.packedIndices), std::move(data.ranges), std::move(material), keepGeometry);
+        }
+        loadStats.uploadMs = millisecondsSince(start);
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // maps a cooked cache and uploads its meshes straight from the mapping. Returns false if the cache is missing or stale.
+    bool loadFromCache(const string& cachePath, ModelCache::Source& source)
     {
-        // process each mesh located at the current node
+        auto start = chrono::steady_clock::now();
+        ModelCache cache;
+        if (!cache.open(cachePath, source))
+            return false;
+        vector<vector<TextureRef>> materialRefs = cache.materials();
+        nodes = cache.nodes();
+        loadStats.fromCache = true;
+        loadStats.meshCount = static_cast<unsigned int>(cache.meshCount());
+        loadStats.importMs = millisecondsSince(start);
+
+        start = chrono::steady_clock::now();
+        meshes.reserve(meshes.size() + cache.meshCount());
+        for (size_t i = 0; i < cache.meshCount(); i++)
+        {
+            ModelCache::MeshView view = cache.mesh(i);
+            meshNodes.push_back(view.node);
+            shared_ptr<Material> material = loadMaterial(materialRefs, view.materialIndex);
+            loadStats.vertexBytes += static_cast<size_t>(view.vertexCount) * vertexStride(view.format);
+            loadStats.unpackedVertexBytes += static_cast<size_t>(view.vertexCount) * sizeof(Vertex);
+            loadStats.indexBytes += static_cast<size_t>(view.indexCount) * sizeof(unsigned short);
+            meshes.emplace_back(view.vertices, view.vertexCount, view.format, view.indices, view.indexCount,
+                                vector<MeshRange>(view.ranges, view.ranges + view.rangeCount), std::move(material));
+            // the mapping goes away with the cache, so a CPU copy has to be taken from it while it's still open
+            if (keepGeometry)
+            {
+                const unsigned char* vertexBytes = static_cast<const unsigned char*>(view.vertices);
+                meshes.back().vertexData.assign(vertexBytes, vertexBytes + static_cast<size_t>(view.vertexCount) * vertexStride(view.format));
+                meshes.back().indices.assign(view.indices, view.indices + view.indexCount);
+            }
+        }
+        loadStats.uploadMs = millisecondsSince(start);
+        return true;
+    }
+
+public:
+    // import helpers, shared with StreamingModel. None of them touch GL.
+
+    // processes a node in a recursive fashion. Adds the node and its transformation to nodes, collects each individual mesh
+    // located at the node (and which node that was in meshNodes) and repeats this process on its children nodes (if any).
+    static void processNode(aiNode* node, const aiScene* scene, vector<const aiMesh*>& order, TransformGraph& nodes, vector<uint32_t>& meshNodes,
+                            uint32_t parent = TransformGraph::NONE)
+    {
+        uint32_t index = nodes.add(parent, toMat4(node->mTransformation), node->mName.C_Str());
+        // collect each mesh located at the current node
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            order.push_back(scene->mMeshes[node->mMeshes[i]]);
+            meshNodes.push_back(index);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, order, nodes, meshNodes, index);
         }
 
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // ASSIMP matrices are row major, glm's are column major
+    static glm::mat4 toMat4(const aiMatrix4x4& m)
+    {
+        return glm::mat4(m.a1, m.b1, m.c1, m.d1,
+                         m.a2, m.b2, m.c2, m.d2,
+                         m.a3, m.b3, m.c3, m.d3,
+                         m.a4, m.b4, m.c4, m.d4);
+    }
+
+    // converts a single aiMesh into vertices and indices and picks the smallest vertex format its material needs.
+    // Runs on worker threads: must not touch GL or any Model state (reading the ASSIMP scene is fine).
+    static MeshData processMesh(const aiMesh* mesh, const aiMaterial* material)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex>& vertices = data.vertices;
+        vector<unsigned int>& indices = data.indices;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex vertex{};
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
@@ -135,15 +516,46 @@ private:
             vertices.push_back(vertex);
         }
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        // aiProcess_Triangulate leaves points and lines alone; only whole triangles are drawn (and optimized), so those are skipped.
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
             aiFace face = mesh->mFaces[i];
+            if (face.mNumIndices != 3)
+                continue;
             // retrieve all indices of the face and store them in the indices vector
             for (unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        // bone influences, keeping the strongest MAX_BONE_INFLUENCE per vertex
+        for (unsigned int b = 0; b < mesh->mNumBones; b++)
+        {
+            const aiBone* bone = mesh->mBones[b];
+            for (unsigned int w = 0; w < bone->mNumWeights; w++)
+            {
+                Vertex& vertex = vertices[bone->mWeights[w].mVertexId];
+                int weakest = 0;
+                for (int k = 1; k < MAX_BONE_INFLUENCE; k++)
+                    if (vertex.m_Weights[k] < vertex.m_Weights[weakest])
+                        weakest = k;
+                if (bone->mWeights[w].mWeight > vertex.m_Weights[weakest])
+                {
+                    vertex.m_BoneIDs[weakest] = static_cast<int>(b);
+                    vertex.m_Weights[weakest] = bone->mWeights[w].mWeight;
+                }
+            }
+        }
+
+        data.materialIndex = mesh->mMaterialIndex;
+        // tangents are only worth their bytes when there is a normal map to use them
+        bool normalMapped = mesh->mTangents && (material->GetTextureCount(aiTextureType_HEIGHT) > 0 || material->GetTextureCount(aiTextureType_NORMALS) > 0);
+        data.format = chooseVertexFormat(normalMapped, mesh->HasBones());
+        return data;
+    }
+
+    // lists the textures a material references. Plain CPU work, the textures themselves are loaded by loadMaterial.
+    static vector<TextureRef> processMaterial(const aiMaterial* material)
+    {
+        vector<TextureRef> textures;
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
         // Same applies to other texture as the following list summarizes:
@@ -152,93 +564,41 @@ private:
         // normal: texture_normalN
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
+        // 3. normal maps (.obj files list them as height maps, glTF and FBX as normal maps)
+        collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
+        collectMaterialTextures(material, aiTextureType_NORMALS, "texture_normal", textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return textures;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    static void collectMaterialTextures(const aiMaterial* mat, aiTextureType type, const string& typeName, vector<TextureRef>& textures)
     {
-        vector<Texture> textures;
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back({ typeName, str.C_Str() });
         }
-        return textures;
     }
 
-    unsigned int TextureFromFile(const char* path, const string& directory)
+private:
+    // builds a material the first time a mesh uses it; its textures load through the shared texture cache, which makes sure
+    // textures aren't loaded more than once (also across models). with parallelLoad they decode in the background and show
+    // a placeholder until TextureLoader::update() has uploaded them.
+    shared_ptr<Material> loadMaterial(const vector<vector<TextureRef>>& refs, unsigned int index)
     {
-        string filename = string(path);
-        filename = directory + '/' + filename;
-
-        unsigned int textureID;
-        glGenTextures(1, &textureID);
-
-        int width, height, nrComponents;
-        unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-        if (data)
-        {
-            GLenum format;
-            if (nrComponents == 1)
-                format = GL_RED;
-            else if (nrComponents == 3)
-                format = GL_RGB;
-            else if (nrComponents == 4)
-                format = GL_RGBA;
-
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Texture failed to load at path: " << path << std::endl;
-            stbi_image_free(data);
-        }
-
-        return textureID;
+        if (index >= refs.size())
+            return nullptr;
+        if (materials.size() < refs.size())
+            materials.resize(refs.size());
+        if (!materials[index])
+            materials[index] = make_shared<Material>(refs[index], directory, parallelLoad);
+        return materials[index];
     }
 };
 
@@ -0,0 +1,2 @@
+#define MODELCACHE_IMPLEMENTATION
+#include "ModelCache.h"
\ No newline at end of file
@@ -0,0 +1,427 @@
+#ifndef MODELCACHE_H
+#define MODELCACHE_H
+
+#include <glm/glm.hpp>
+
+#include "Hash.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "TransformGraph.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Cooked model cache. The first import of an asset writes <asset>.cache next to it; later loads map that file and
+// upload the vertex/index blobs straight from the mapping instead of running Assimp again.
+//
+// layout: CacheHeader, CacheMesh[meshCount], CacheMaterial[materialCount], CacheTexture[textureCount],
+// MeshRange[rangeCount], CacheNode[nodeCount], string table, then one vertex blob (packed in the mesh's VertexFormat) and one 16-bit index blob per mesh, each starting on a page
+// boundary and stored exactly as Mesh::setupMesh uploads them. The cache is only used when the source file still has the size and
+// modification time it was cooked from and its contents still hash to sourceHash, and only after every offset, count and index in it
+// has been checked against the mapping.
+class ModelCache
+{
+public:
+    // bump whenever the layout, the vertex formats or the import processing changes
+    static const uint32_t VERSION = 9;
+    static const size_t PAGE_SIZE = 4096;
+
+    // CPU-side mesh as stored in the cache
+    struct MeshView {
+        const void*         vertices;     // packed in format
+        uint32_t            vertexCount;
+        VertexFormat        format;
+        const unsigned short* indices;
+        uint32_t            indexCount;
+        const MeshRange*    ranges;
+        uint32_t            rangeCount;
+        uint32_t            materialIndex;
+        uint32_t            node;
+    };
+
+    static string cachePath(const string& sourcePath)
+    {
+        return sourcePath + ".cache";
+    }
+
+    // hash of the whole contents of a file, 0 if it can't be read
+    static uint64_t hashFile(const string& path)
+    {
+        MappedFile source(path);
+        if (!source.isOpen())
+            return 0;
+        uint64_t hash = hashWords(source.data(), source.size());
+        return hash != 0 ? hash : 1;
+    }
+
+    // the asset a cache is cooked from. size and modification time come from the directory entry and are compared
+    // first, so an edited asset is turned away without reading it; the content hash is only computed once they match.
+    class Source
+    {
+    public:
+        explicit Source(const string& path) : path(path)
+        {
+            error_code error;
+            uintmax_t fileSize = filesystem::file_size(path, error);
+            if (error)
+                return;
+            int64_t fileModified = filesystem::last_write_time(path, error).time_since_epoch().count();
+            if (error)
+                return;
+            size = static_cast<uint64_t>(fileSize);
+            modified = fileModified;
+        }
+
+        // false if the asset is missing or empty, in which case there is nothing to cache against
+        bool exists() const { return size != 0; }
+
+        uint64_t contentHash()
+        {
+            if (hash == 0)
+                hash = hashFile(path);
+            return hash;
+        }
+
+        string   path;
+        uint64_t size = 0;
+        int64_t  modified = 0;
+
+    private:
+        uint64_t hash = 0;
+    };
+
+    // maps the cache and checks it against the source asset. Returns false if it's missing, stale, from another version
+    // or damaged.
+    bool open(const string& path, Source& source)
+    {
+        file.reset(new MappedFile(path));
+        if (!file->isOpen() || file->size() < sizeof(CacheHeader))
+            return close();
+
+        header = reinterpret_cast<const CacheHeader*>(file->data());
+        if (memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0 || header->version != VERSION ||
+            header->formatCount != static_cast<uint32_t>(VertexFormat::Count) || header->fileSize != file->size() ||
+            header->sourceSize != source.size || header->sourceModified != source.modified || header->sourceHash != source.contentHash())
+            return close();
+
+        uint64_t tables = sizeof(CacheHeader) + static_cast<uint64_t>(header->meshCount) * sizeof(CacheMesh) +
+                          static_cast<uint64_t>(header->materialCount) * sizeof(CacheMaterial) + static_cast<uint64_t>(header->textureCount) * sizeof(CacheTexture) +
+                          static_cast<uint64_t>(header->rangeCount) * sizeof(MeshRange) + static_cast<uint64_t>(header->nodeCount) * sizeof(CacheNode);
+        if (!inFile(tables, header->stringSize))
+            return corrupt(path);
+        meshTable = reinterpret_cast<const CacheMesh*>(file->data() + sizeof(CacheHeader));
+        materialTable = reinterpret_cast<const CacheMaterial*>(meshTable + header->meshCount);
+        textureTable = reinterpret_cast<const CacheTexture*>(materialTable + header->materialCount);
+        rangeTable = reinterpret_cast<const MeshRange*>(textureTable + header->textureCount);
+        nodeTable = reinterpret_cast<const CacheNode*>(rangeTable + header->rangeCount);
+        strings = reinterpret_cast<const char*>(nodeTable + header->nodeCount);
+        if (!validate())
+            return corrupt(path);
+        return true;
+    }
+
+    size_t meshCount() const { return header ? header->meshCount : 0; }
+
+    MeshView mesh(size_t i) const
+    {
+        const CacheMesh& entry = meshTable[i];
+        MeshView view;
+        view.vertices = file->data() + entry.vertexOffset;
+        view.vertexCount = entry.vertexCount;
+        view.format = static_cast<VertexFormat>(entry.format);
+        view.indices = reinterpret_cast<const unsigned short*>(file->data() + entry.indexOffset);
+        view.indexCount = entry.indexCount;
+        view.ranges = rangeTable + entry.firstRange;
+        view.rangeCount = entry.rangeCount;
+        view.materialIndex = entry.materialIndex;
+        view.node = entry.node;
+        return view;
+    }
+
+    // the model's node hierarchy, in the depth-first order it was written in
+    TransformGraph nodes() const
+    {
+        TransformGraph graph;
+        uint32_t count = header ? header->nodeCount : 0;
+        graph.reserve(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const CacheNode& node = nodeTable[i];
+            glm::mat4 local;
+            memcpy(&local[0][0], node.local, sizeof(node.local));
+            graph.add(node.parent, local, string(strings + node.nameOffset, node.nameLength));
+        }
+        return graph;
+    }
+
+    vector<vector<TextureRef>> materials() const
+    {
+        vector<vector<TextureRef>> result(header ? header->materialCount : 0);
+        for (size_t m = 0; m < result.size(); m++)
+        {
+            for (uint32_t t = 0; t < materialTable[m].textureCount; t++)
+            {
+                const CacheTexture& texture = textureTable[materialTable[m].firstTexture + t];
+                result[m].push_back({ string(strings + texture.typeOffset, texture.typeLength),
+                                      string(strings + texture.pathOffset, texture.pathLength) });
+            }
+        }
+        return result;
+    }
+
+    // writes a cache for the converted meshes (vertices and indices already packed) and the node hierarchy they hang off. Goes through a temporary file so a crash never leaves a half-written cache behind.
+    static bool write(const string& path, Source& source, const vector<MeshData>& meshes, const vector<vector<TextureRef>>& materials, const TransformGraph& nodes)
+    {
+        uint64_t sourceHash = source.contentHash();
+        if (sourceHash == 0)
+            return false;
+
+        CacheHeader header = {};
+        memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.formatCount = static_cast<uint32_t>(VertexFormat::Count);
+        header.sourceSize = source.size;
+        header.sourceModified = source.modified;
+        header.sourceHash = sourceHash;
+        header.meshCount = static_cast<uint32_t>(meshes.size());
+        header.materialCount = static_cast<uint32_t>(materials.size());
+
+        vector<CacheMaterial> materialTable;
+        vector<CacheTexture> textureTable;
+        string stringTable;
+        for (const vector<TextureRef>& material : materials)
+        {
+            materialTable.push_back({ static_cast<uint32_t>(textureTable.size()), static_cast<uint32_t>(material.size()) });
+            for (const TextureRef& texture : material)
+            {
+                CacheTexture entry;
+                entry.typeOffset = static_cast<uint32_t>(stringTable.size());
+                entry.typeLength = static_cast<uint32_t>(texture.type.size());
+                stringTable += texture.type;
+                entry.pathOffset = static_cast<uint32_t>(stringTable.size());
+                entry.pathLength = static_cast<uint32_t>(texture.path.size());
+                stringTable += texture.path;
+                textureTable.push_back(entry);
+            }
+        }
+        header.textureCount = static_cast<uint32_t>(textureTable.size());
+
+        vector<MeshRange> rangeTable;
+        for (const MeshData& mesh : meshes)
+            rangeTable.insert(rangeTable.end(), mesh.ranges.begin(), mesh.ranges.end());
+        header.rangeCount = static_cast<uint32_t>(rangeTable.size());
+
+        vector<CacheNode> nodeTable(nodes.size());
+        for (uint32_t i = 0; i < nodes.size(); i++)
+        {
+            nodeTable[i].parent = nodes.parent(i);
+            nodeTable[i].nameOffset = static_cast<uint32_t>(stringTable.size());
+            nodeTable[i].nameLength = static_cast<uint32_t>(nodes.name(i).size());
+            stringTable += nodes.name(i);
+            memcpy(nodeTable[i].local, &nodes.local(i)[0][0], sizeof(nodeTable[i].local));
+        }
+        header.nodeCount = static_cast<uint32_t>(nodeTable.size());
+        header.stringSize = static_cast<uint32_t>(stringTable.size());
+
+        // lay out the blobs after the tables, each on its own page
+        vector<CacheMesh> meshTable(meshes.size());
+        uint64_t offset = sizeof(CacheHeader) + meshTable.size() * sizeof(CacheMesh) + materialTable.size() * sizeof(CacheMaterial) +
+                          textureTable.size() * sizeof(CacheTexture) + rangeTable.size() * sizeof(MeshRange) +
+                          nodeTable.size() * sizeof(CacheNode) + stringTable.size();
+        uint32_t firstRange = 0;
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            meshTable[i].firstRange = firstRange;
+            meshTable[i].rangeCount = static_cast<uint32_t>(meshes[i].ranges.size());
+            firstRange += meshTable[i].rangeCount;
+            meshTable[i].vertexOffset = offset = alignToPage(offset);
+            meshTable[i].vertexCount = static_cast<uint32_t>(meshes[i].vertexCount());
+            meshTable[i].format = static_cast<uint32_t>(meshes[i].format);
+            offset += meshes[i].packedVertices.size();
+            meshTable[i].indexOffset = offset = alignToPage(offset);
+            meshTable[i].indexCount = static_cast<uint32_t>(meshes[i].packedIndices.size());
+            offset += meshes[i].packedIndices.size() * sizeof(unsigned short);
+            meshTable[i].materialIndex = meshes[i].materialIndex;
+            meshTable[i].node = meshes[i].node;
+        }
+        header.fileSize = offset;
+
+        string temporary = path + ".tmp";
+        {
+            ofstream out(temporary, ios::binary | ios::trunc);
+            if (!out)
+            {
+                cout << "ERROR::MODEL_CACHE:: could not write " << temporary << endl;
+                return false;
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(meshTable.data()), meshTable.size() * sizeof(CacheMesh));
+            out.write(reinterpret_cast<const char*>(materialTable.data()), materialTable.size() * sizeof(CacheMaterial));
+            out.write(reinterpret_cast<const char*>(textureTable.data()), textureTable.size() * sizeof(CacheTexture));
+            out.write(reinterpret_cast<const char*>(rangeTable.data()), rangeTable.size() * sizeof(MeshRange));
+            out.write(reinterpret_cast<const char*>(nodeTable.data()), nodeTable.size() * sizeof(CacheNode));
+            out.write(stringTable.data(), stringTable.size());
+            for (size_t i = 0; i < meshes.size(); i++)
+            {
+                padTo(out, meshTable[i].vertexOffset);
+                out.write(reinterpret_cast<const char*>(meshes[i].packedVertices.data()), meshes[i].packedVertices.size());
+                padTo(out, meshTable[i].indexOffset);
+                out.write(reinterpret_cast<const char*>(meshes[i].packedIndices.data()), meshes[i].packedIndices.size() * sizeof(unsigned short));
+            }
+            if (!out)
+            {
+                cout << "ERROR::MODEL_CACHE:: failed writing " << temporary << endl;
+                return false;
+            }
+        }
+        remove(path.c_str());
+        if (rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            cout << "ERROR::MODEL_CACHE:: could not replace " << path << endl;
+            remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr char MAGIC[8] = { 'O', 'G', 'L', 'T', 'M', 'D', 'L', '\0' };
+
+    struct CacheHeader {
+        char     magic[8];
+        uint32_t version;
+        uint32_t formatCount;
+        uint64_t sourceSize;
+        int64_t  sourceModified;
+        uint64_t sourceHash;
+        uint64_t fileSize;
+        uint32_t meshCount;
+        uint32_t materialCount;
+        uint32_t textureCount;
+        uint32_t rangeCount;
+        uint32_t nodeCount;
+        uint32_t stringSize;
+    };
+
+    struct CacheMesh {
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t materialIndex;
+        uint32_t format;
+        uint32_t firstRange;
+        uint32_t rangeCount;
+        uint32_t node;
+    };
+
+    struct CacheMaterial {
+        uint32_t firstTexture;
+        uint32_t textureCount;
+    };
+
+    struct CacheTexture {
+        uint32_t typeOffset, typeLength;
+        uint32_t pathOffset, pathLength;
+    };
+
+    struct CacheNode {
+        uint32_t parent;   // TransformGraph::NONE for a root
+        uint32_t nameOffset, nameLength;
+        float    local[16];   // column major, as glm stores it
+    };
+
+    unique_ptr<MappedFile> file;
+    const CacheHeader* header = nullptr;
+    const CacheMesh* meshTable = nullptr;
+    const CacheMaterial* materialTable = nullptr;
+    const CacheTexture* textureTable = nullptr;
+    const MeshRange* rangeTable = nullptr;
+    const CacheNode* nodeTable = nullptr;
+    const char* strings = nullptr;
+
+    bool close()
+    {
+        file.reset();
+        header = nullptr;
+        return false;
+    }
+
+    bool corrupt(const string& path)
+    {
+        cout << "ERROR::MODEL_CACHE:: " << path << " is damaged, importing the source instead" << endl;
+        return close();
+    }
+
+    // true if [offset, offset + size) lies inside the mapping
+    bool inFile(uint64_t offset, uint64_t size) const
+    {
+        return offset <= file->size() && size <= file->size() - offset;
+    }
+
+    // true if [first, first + count) lies inside a table of size entries
+    static bool inTable(uint64_t first, uint64_t count, uint64_t size)
+    {
+        return first <= size && count <= size - first;
+    }
+
+    // checks everything the accessors follow: blobs inside the mapping, table and string references in range, and every
+    // index drawn (range base vertex included) inside its mesh's vertices, so nothing downstream reads out of bounds
+    bool validate() const
+    {
+        for (uint32_t i = 0; i < header->meshCount; i++)
+        {
+            const CacheMesh& mesh = meshTable[i];
+            if (mesh.format >= static_cast<uint32_t>(VertexFormat::Count) || mesh.node >= header->nodeCount ||
+                !inFile(mesh.vertexOffset, static_cast<uint64_t>(mesh.vertexCount) * vertexStride(static_cast<VertexFormat>(mesh.format))) ||
+                mesh.indexOffset % sizeof(unsigned short) != 0 || !inFile(mesh.indexOffset, static_cast<uint64_t>(mesh.indexCount) * sizeof(unsigned short)) ||
+                !inTable(mesh.firstRange, mesh.rangeCount, header->rangeCount))
+                return false;
+            const unsigned short* indices = reinterpret_cast<const unsigned short*>(file->data() + mesh.indexOffset);
+            for (uint32_t r = 0; r < mesh.rangeCount; r++)
+            {
+                const MeshRange& range = rangeTable[mesh.firstRange + r];
+                if (range.baseVertex < 0 || !inTable(range.firstIndex, range.indexCount, mesh.indexCount))
+                    return false;
+                for (uint32_t j = range.firstIndex; j < range.firstIndex + range.indexCount; j++)
+                    if (static_cast<uint64_t>(range.baseVertex) + indices[j] >= mesh.vertexCount)
+                        return false;
+            }
+        }
+        for (uint32_t m = 0; m < header->materialCount; m++)
+            if (!inTable(materialTable[m].firstTexture, materialTable[m].textureCount, header->textureCount))
+                return false;
+        for (uint32_t t = 0; t < header->textureCount; t++)
+            if (!inTable(textureTable[t].typeOffset, textureTable[t].typeLength, header->stringSize) ||
+                !inTable(textureTable[t].pathOffset, textureTable[t].pathLength, header->stringSize))
+                return false;
+        for (uint32_t n = 0; n < header->nodeCount; n++)
+            if ((nodeTable[n].parent != TransformGraph::NONE && nodeTable[n].parent >= n) ||
+                !inTable(nodeTable[n].nameOffset, nodeTable[n].nameLength, header->stringSize))
+                return false;
+        return true;
+    }
+
+    static uint64_t alignToPage(uint64_t offset)
+    {
+        return (offset + PAGE_SIZE - 1) & ~static_cast<uint64_t>(PAGE_SIZE - 1);
+    }
+
+    static void padTo(ofstream& out, uint64_t offset)
+    {
+        static const char zeros[PAGE_SIZE] = {};
+        uint64_t position = static_cast<uint64_t>(out.tellp());
+        if (offset > position)
+            out.write(zeros, static_cast<streamsize>(offset - position));
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define OCCLUSIONCULLER_IMPLEMENTATION
+#include "OcclusionCuller.h"
\ No newline at end of file
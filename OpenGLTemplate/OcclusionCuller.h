@@ -0,0 +1,373 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// the rasterizer steps 4 pixels at a time with SSE on any x64 build, one at a time otherwise
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define OCCLUSIONCULLER_SSE 1
+#endif
+
+// counters of the current frame, reset by beginFrame
+struct OcclusionStats {
+    size_t occluderTriangles = 0;     // handed to addOccluder
+    size_t rasterizedTriangles = 0;   // of those, the ones left after near clipping that cover at least one pixel center
+    size_t tested = 0;
+    size_t occluded = 0;
+    double setupMs = 0.0;    // transforming, clipping and projecting occluders
+    double rasterMs = 0.0;   // binning and drawing them into the depth buffer
+
+    float occludedFraction() const { return tested > 0 ? static_cast<float>(occluded) / tested : 0.0f; }
+
+    void print(const char* what) const
+    {
+        std::cout << what << ": " << occluded << " / " << tested << " occluded (" << occludedFraction() * 100.0f << "%), "
+                  << rasterizedTriangles << " / " << occluderTriangles << " occluder triangles drawn, setup " << setupMs
+                  << " ms, raster " << rasterMs << " ms" << std::endl;
+    }
+};
+
+// CPU occlusion culling in the style of Masked Occlusion Culling: a few large occluders (walls, floors, big props) are
+// rasterized into a small software depth buffer, and the screen space boxes of everything else are tested against it
+// before they are drawn. The buffer is split into 8x8 pixel tiles that keep their farthest depth, so most tests are
+// settled by a tile or two; each row of tiles is drawn by its own job on the thread pool.
+//
+// Per frame: beginFrame(viewProjection), addOccluder() for each occluder, rasterize(), then visible() per object.
+// Everything runs on the CPU, so it works without a GL context. Occluders are sampled at pixel centers and both of their
+// sides are drawn, so open geometry like single planes works too.
+class OcclusionCuller
+{
+public:
+    static const unsigned int TILE_WIDTH = 8;
+    static const unsigned int TILE_HEIGHT = 8;
+    // 4:3 like the window; occlusion doesn't need the full resolution
+    static const unsigned int DEFAULT_WIDTH = 256;
+    static const unsigned int DEFAULT_HEIGHT = 192;
+    // boxes whose nearest depth is within this of an occluder's count as in front of it, so an occluder doesn't hide itself
+    static constexpr float DEPTH_BIAS = 1e-6f;
+
+    explicit OcclusionCuller(unsigned int width = DEFAULT_WIDTH, unsigned int height = DEFAULT_HEIGHT)
+    {
+        resize(width, height);
+    }
+
+    // sizes are rounded up to whole tiles
+    void resize(unsigned int width, unsigned int height)
+    {
+        tilesX = std::max(1u, (width + TILE_WIDTH - 1) / TILE_WIDTH);
+        tilesY = std::max(1u, (height + TILE_HEIGHT - 1) / TILE_HEIGHT);
+        bufferWidth = tilesX * TILE_WIDTH;
+        bufferHeight = tilesY * TILE_HEIGHT;
+        depthBuffer.assign(static_cast<size_t>(bufferWidth) * bufferHeight, 1.0f);
+        tileMax.assign(static_cast<size_t>(tilesX) * tilesY, 1.0f);
+        bins.resize(tilesY);
+    }
+
+    unsigned int width() const { return bufferWidth; }
+    unsigned int height() const { return bufferHeight; }
+
+    // depth in [0, 1] (1 is the far plane or nothing), rows from the bottom like GL's window coordinates
+    const std::vector<float>& depth() const { return depthBuffer; }
+    float depthAt(unsigned int x, unsigned int y) const { return depthBuffer[static_cast<size_t>(y) * bufferWidth + x]; }
+
+    const OcclusionStats& stats() const { return frameStats; }
+
+    // drops last frame's occluders; viewProjection is used for both the occluders and the tests
+    void beginFrame(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        triangles.clear();
+        frameStats = OcclusionStats();
+    }
+
+    // adds the indexed triangles (indexCount / 3 of them) of a mesh as occluders. positions are three floats at the start
+    // of every stride byte vertex, indices are relative to baseVertex.
+    void addOccluder(const void* positions, size_t stride, const unsigned short* indices, size_t indexCount, const glm::mat4& model, int32_t baseVertex = 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        glm::mat4 transform = viewProjection * model;
+        const unsigned char* bytes = static_cast<const unsigned char*>(positions);
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            glm::vec4 clip[3];
+            for (int k = 0; k < 3; k++)
+            {
+                float xyz[3];
+                memcpy(xyz, bytes + static_cast<size_t>(baseVertex + indices[i + k]) * stride, sizeof(xyz));
+                clip[k] = transform * glm::vec4(xyz[0], xyz[1], xyz[2], 1.0f);
+            }
+            addClipTriangle(clip);
+        }
+        frameStats.occluderTriangles += indexCount / 3;
+        frameStats.setupMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // every range of mesh; false (and nothing added) if the mesh has no CPU copy of its geometry (see Model's keepGeometry)
+    bool addOccluder(const Mesh& mesh, const glm::mat4& model)
+    {
+        if (mesh.vertexData.empty() || mesh.indices.empty())
+            return false;
+        size_t stride = static_cast<size_t>(vertexStride(mesh.format));
+        for (const MeshRange& range : mesh.ranges)
+            addOccluder(mesh.vertexData.data(), stride, mesh.indices.data() + range.firstIndex, range.indexCount, model, range.baseVertex);
+        return true;
+    }
+
+    // draws this frame's occluders into the depth buffer, one row of tiles per job on pool (or all on this thread if
+    // pool is null). visible() answers from the result until the next rasterize().
+    void rasterize(ThreadPool* pool = &ThreadPool::shared())
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (std::vector<uint32_t>& bin : bins)
+            bin.clear();
+        for (uint32_t t = 0; t < triangles.size(); t++)
+            for (int row = triangles[t].y0 / static_cast<int>(TILE_HEIGHT); row <= triangles[t].y1 / static_cast<int>(TILE_HEIGHT); row++)
+                bins[row].push_back(t);
+
+        if (pool && pool->size() > 1)
+            pool->parallelFor(tilesY, [this](size_t row) { rasterizeTileRow(static_cast<unsigned int>(row)); });
+        else
+            for (unsigned int row = 0; row < tilesY; row++)
+                rasterizeTileRow(row);
+        frameStats.rasterMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // false if bounds, placed by model, are completely behind the occluders (or off screen). Boxes crossing the near
+    // plane are always visible. Not thread safe: it counts into stats().
+    bool visible(const Bounds& bounds, const glm::mat4& model)
+    {
+        frameStats.tested++;
+        if (!bounds.valid)
+            return true;
+        glm::mat4 transform = viewProjection * model;
+        glm::vec2 low(INFINITY), high(-INFINITY);
+        float nearest = INFINITY;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 clip = transform * glm::vec4(corner & 1 ? bounds.max.x : bounds.min.x, corner & 2 ? bounds.max.y : bounds.min.y,
+                                                   corner & 4 ? bounds.max.z : bounds.min.z, 1.0f);
+            if (clip.z + clip.w <= 0.0f)
+                return true;
+            glm::vec2 screen = toScreen(clip);
+            low = glm::min(low, screen);
+            high = glm::max(high, screen);
+            nearest = std::min(nearest, (clip.z / clip.w) * 0.5f + 0.5f);
+        }
+        nearest -= DEPTH_BIAS;
+
+        // every pixel the box touches, not only those whose centers it covers
+        int x0 = std::max(0, static_cast<int>(std::floor(low.x))), x1 = std::min(static_cast<int>(bufferWidth) - 1, static_cast<int>(std::floor(high.x)));
+        int y0 = std::max(0, static_cast<int>(std::floor(low.y))), y1 = std::min(static_cast<int>(bufferHeight) - 1, static_cast<int>(std::floor(high.y)));
+        if (x0 > x1 || y0 > y1 || nearest > 1.0f)
+        {
+            frameStats.occluded++;
+            return false;
+        }
+        for (int ty = y0 / static_cast<int>(TILE_HEIGHT); ty <= y1 / static_cast<int>(TILE_HEIGHT); ty++)
+        {
+            for (int tx = x0 / static_cast<int>(TILE_WIDTH); tx <= x1 / static_cast<int>(TILE_WIDTH); tx++)
+            {
+                if (tileMax[static_cast<size_t>(ty) * tilesX + tx] < nearest)
+                    continue;
+                // a tile the box covers completely has a pixel behind it; otherwise only the covered part counts
+                int px0 = std::max(x0, tx * static_cast<int>(TILE_WIDTH)), px1 = std::min(x1, (tx + 1) * static_cast<int>(TILE_WIDTH) - 1);
+                int py0 = std::max(y0, ty * static_cast<int>(TILE_HEIGHT)), py1 = std::min(y1, (ty + 1) * static_cast<int>(TILE_HEIGHT) - 1);
+                if (px1 - px0 == TILE_WIDTH - 1 && py1 - py0 == TILE_HEIGHT - 1)
+                    return true;
+                for (int y = py0; y <= py1; y++)
+                {
+                    const float* row = &depthBuffer[static_cast<size_t>(y) * bufferWidth];
+                    for (int x = px0; x <= px1; x++)
+                        if (row[x] >= nearest)
+                            return true;
+                }
+            }
+        }
+        frameStats.occluded++;
+        return false;
+    }
+
+private:
+    // a projected triangle: three edge functions a * x + b * y + c that are >= 0 inside, its depth plane and the pixels
+    // (inclusive) whose centers its box covers
+    struct ScreenTriangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthA, depthB, depthC;
+        int x0, y0, x1, y1;
+    };
+
+    unsigned int bufferWidth = 0, bufferHeight = 0;
+    unsigned int tilesX = 0, tilesY = 0;
+    std::vector<float> depthBuffer;
+    std::vector<float> tileMax;   // farthest depth in each tile
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<ScreenTriangle> triangles;
+    std::vector<std::vector<uint32_t>> bins;   // triangles touching each row of tiles
+    OcclusionStats frameStats;
+
+    glm::vec2 toScreen(const glm::vec4& clip) const
+    {
+        return glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * bufferWidth, (clip.y / clip.w * 0.5f + 0.5f) * bufferHeight);
+    }
+
+    // clips against the near plane (z >= -w), which keeps w positive for the divide; the other planes are left to the
+    // pixel bounds
+    void addClipTriangle(const glm::vec4* clip)
+    {
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            const glm::vec4& a = clip[k];
+            const glm::vec4& b = clip[(k + 1) % 3];
+            float da = a.z + a.w, db = b.z + b.w;
+            if (da >= 0.0f)
+                polygon[count++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                polygon[count++] = a + (b - a) * (da / (da - db));
+        }
+        for (int k = 1; k + 1 < count; k++)
+            addScreenTriangle(polygon[0], polygon[k], polygon[k + 1]);
+    }
+
+    void addScreenTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2)
+    {
+        glm::vec2 p[3] = { toScreen(c0), toScreen(c1), toScreen(c2) };
+        float z[3] = { c0.z / c0.w * 0.5f + 0.5f, c1.z / c1.w * 0.5f + 0.5f, c2.z / c2.w * 0.5f + 0.5f };
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (std::fabs(area) < 1e-8f)
+            return;
+        // both sides are drawn: clockwise triangles are flipped to counter-clockwise
+        if (area < 0.0f)
+        {
+            std::swap(p[1], p[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        ScreenTriangle triangle;
+        glm::vec2 low = glm::min(p[0], glm::min(p[1], p[2])), high = glm::max(p[0], glm::max(p[1], p[2]));
+        triangle.x0 = std::max(0, static_cast<int>(std::ceil(low.x - 0.5f)));
+        triangle.x1 = std::min(static_cast<int>(bufferWidth) - 1, static_cast<int>(std::floor(high.x - 0.5f)));
+        triangle.y0 = std::max(0, static_cast<int>(std::ceil(low.y - 0.5f)));
+        triangle.y1 = std::min(static_cast<int>(bufferHeight) - 1, static_cast<int>(std::floor(high.y - 0.5f)));
+        if (triangle.x0 > triangle.x1 || triangle.y0 > triangle.y1)
+            return;
+        for (int k = 0; k < 3; k++)
+        {
+            const glm::vec2& a = p[k];
+            const glm::vec2& b = p[(k + 1) % 3];
+            triangle.edgeA[k] = a.y - b.y;
+            triangle.edgeB[k] = b.x - a.x;
+            triangle.edgeC[k] = a.x * b.y - b.x * a.y;
+        }
+        triangle.depthA = ((z[1] - z[0]) * (p[2].y - p[0].y) - (z[2] - z[0]) * (p[1].y - p[0].y)) / area;
+        triangle.depthB = ((z[2] - z[0]) * (p[1].x - p[0].x) - (z[1] - z[0]) * (p[2].x - p[0].x)) / area;
+        triangle.depthC = z[0] - triangle.depthA * p[0].x - triangle.depthB * p[0].y;
+        triangles.push_back(triangle);
+        frameStats.rasterizedTriangles++;
+    }
+
+    // the pixels of row py that may have their centers inside triangle, a pixel wider on both sides than the edge
+    // equations say so rounding can't lose any; the per pixel test decides. False if there are none.
+    static bool span(const ScreenTriangle& triangle, float py, int& start, int& end)
+    {
+        float low = static_cast<float>(triangle.x0), high = static_cast<float>(triangle.x1);
+        for (int k = 0; k < 3; k++)
+        {
+            float rowEdge = triangle.edgeB[k] * py + triangle.edgeC[k];
+            if (triangle.edgeA[k] > 0.0f)
+                low = std::max(low, -rowEdge / triangle.edgeA[k] - 1.5f);
+            else if (triangle.edgeA[k] < 0.0f)
+                high = std::min(high, -rowEdge / triangle.edgeA[k] + 0.5f);
+            else if (rowEdge < 0.0f)
+                return false;
+        }
+        start = std::max(triangle.x0, static_cast<int>(std::ceil(low)));
+        end = std::min(triangle.x1, static_cast<int>(std::floor(high)));
+        return start <= end;
+    }
+
+    // clears one row of tiles, draws the triangles binned to it and updates its tiles' farthest depth. Rows share
+    // nothing, so they can run in parallel.
+    void rasterizeTileRow(unsigned int tileRow)
+    {
+        int rowStart = static_cast<int>(tileRow * TILE_HEIGHT), rowEnd = rowStart + static_cast<int>(TILE_HEIGHT) - 1;
+        std::fill(depthBuffer.begin() + static_cast<size_t>(rowStart) * bufferWidth, depthBuffer.begin() + static_cast<size_t>(rowEnd + 1) * bufferWidth, 1.0f);
+        for (uint32_t index : bins[tileRow])
+        {
+            const ScreenTriangle& triangle = triangles[index];
+            for (int y = std::max(triangle.y0, rowStart); y <= std::min(triangle.y1, rowEnd); y++)
+            {
+                float* row = &depthBuffer[static_cast<size_t>(y) * bufferWidth];
+                float py = y + 0.5f;
+                int spanStart, spanEnd;
+                if (!span(triangle, py, spanStart, spanEnd))
+                    continue;
+#if defined(OCCLUSIONCULLER_SSE)
+                // rows are whole tiles wide, so a group of 4 never runs past the end; pixels outside the triangle fail
+                // an edge test
+                __m128 steps = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                __m128 rowEdge[3], stepEdge[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    rowEdge[k] = _mm_set1_ps(triangle.edgeB[k] * py + triangle.edgeC[k]);
+                    stepEdge[k] = _mm_set1_ps(triangle.edgeA[k]);
+                }
+                __m128 rowDepth = _mm_set1_ps(triangle.depthB * py + triangle.depthC), stepDepth = _mm_set1_ps(triangle.depthA);
+                __m128 zero = _mm_setzero_ps();
+                for (int x = spanStart & ~3; x <= spanEnd; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), steps);
+                    __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepEdge[0], px), rowEdge[0]), zero);
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepEdge[1], px), rowEdge[1]), zero));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepEdge[2], px), rowEdge[2]), zero));
+                    if (_mm_movemask_ps(inside) == 0)
+                        continue;
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(old, _mm_add_ps(_mm_mul_ps(stepDepth, px), rowDepth));
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                }
+#else
+                for (int x = spanStart; x <= spanEnd; x++)
+                {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int k = 0; k < 3; k++)
+                        inside = inside && triangle.edgeA[k] * px + triangle.edgeB[k] * py + triangle.edgeC[k] >= 0.0f;
+                    if (inside)
+                        row[x] = std::min(row[x], triangle.depthA * px + triangle.depthB * py + triangle.depthC);
+                }
+#endif
+            }
+        }
+        for (unsigned int tx = 0; tx < tilesX; tx++)
+        {
+            float farthest = 0.0f;
+            for (int y = rowStart; y <= rowEnd; y++)
+            {
+                const float* row = &depthBuffer[static_cast<size_t>(y) * bufferWidth + tx * TILE_WIDTH];
+                for (unsigned int x = 0; x < TILE_WIDTH; x++)
+                    farthest = std::max(farthest, row[x]);
+            }
+            tileMax[static_cast<size_t>(tileRow) * tilesX + tx] = farthest;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define PRIMITIVEREGISTRY_IMPLEMENTATION
+#include "PrimitiveRegistry.h"
\ No newline at end of file
@@ -0,0 +1,333 @@
+#ifndef PRIMITIVEREGISTRY_H
+#define PRIMITIVEREGISTRY_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+#include "GLHandles.h"
+#include "GLState.h"
+#include "VertexFormat.h"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+enum class PrimitiveShape : uint32_t {
+    Cube,       // 1x1x1, centered on the origin
+    Plane,      // 1x1 in XZ at y = 0, facing +Y
+    Sphere,     // radius 0.5
+    Cylinder,   // radius 0.5, height 1 along Y, capped
+    Capsule,    // radius 0.25, height 1 along Y
+    Count
+};
+
+// a primitive's piece of the registry's buffers; cheap to copy, valid until PrimitiveRegistry::clear()
+struct Primitive {
+    GLint   baseVertex = 0;
+    size_t  indexOffset = 0;   // in indices
+    GLsizei indexCount = 0;
+    GLsizei vertexCount = 0;
+    Bounds  bounds;            // in the shape's own space
+
+    const void* indexPointer() const { return (const void*)(indexOffset * sizeof(unsigned short)); }
+};
+
+// one unpacked primitive vertex, packed into a StaticVertex on upload
+struct PrimitiveVertex {
+    float position[3];
+    float normal[3];
+    float texCoords[2];
+};
+
+// The cube and the plane are built at compile time: 4 vertices per face, so each face keeps its own normal and texture
+// coordinates, and two triangles per face through the index buffer.
+namespace primitive_tables {
+
+struct Face {
+    float normal[3], u[3], v[3];   // u x v = normal
+};
+
+constexpr Face CUBE_FACES[6] = {
+    { { 1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },
+    { { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+    { { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },
+    { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+    { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+    { { 0, 0, -1 }, { -1, 0, 0 }, { 0, 1, 0 } },
+};
+
+// the four corners of face, counter-clockwise seen from the front, offset by distance along the normal
+constexpr void faceVertices(const Face& face, float distance, PrimitiveVertex* out)
+{
+    constexpr float corners[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+    for (int c = 0; c < 4; c++)
+    {
+        PrimitiveVertex vertex{};
+        for (int k = 0; k < 3; k++)
+        {
+            vertex.position[k] = face.normal[k] * distance + (corners[c][0] - 0.5f) * face.u[k] + (corners[c][1] - 0.5f) * face.v[k];
+            vertex.normal[k] = face.normal[k];
+        }
+        vertex.texCoords[0] = corners[c][0];
+        vertex.texCoords[1] = corners[c][1];
+        out[c] = vertex;
+    }
+}
+
+constexpr void faceIndices(unsigned short first, unsigned short* out)
+{
+    constexpr unsigned short quad[6] = { 0, 1, 2, 2, 3, 0 };
+    for (int i = 0; i < 6; i++)
+        out[i] = static_cast<unsigned short>(first + quad[i]);
+}
+
+constexpr std::array<PrimitiveVertex, 24> cubeVertices()
+{
+    std::array<PrimitiveVertex, 24> vertices{};
+    for (int f = 0; f < 6; f++)
+        faceVertices(CUBE_FACES[f], 0.5f, &vertices[f * 4]);
+    return vertices;
+}
+
+constexpr std::array<unsigned short, 36> cubeIndices()
+{
+    std::array<unsigned short, 36> indices{};
+    for (int f = 0; f < 6; f++)
+        faceIndices(static_cast<unsigned short>(f * 4), &indices[f * 6]);
+    return indices;
+}
+
+constexpr std::array<PrimitiveVertex, 4> planeVertices()
+{
+    std::array<PrimitiveVertex, 4> vertices{};
+    faceVertices(CUBE_FACES[2], 0.0f, vertices.data());
+    return vertices;
+}
+
+constexpr std::array<unsigned short, 6> planeIndices()
+{
+    std::array<unsigned short, 6> indices{};
+    faceIndices(0, indices.data());
+    return indices;
+}
+
+constexpr std::array<PrimitiveVertex, 24> CUBE_VERTICES = cubeVertices();
+constexpr std::array<unsigned short, 36> CUBE_INDICES = cubeIndices();
+constexpr std::array<PrimitiveVertex, 4> PLANE_VERTICES = planeVertices();
+constexpr std::array<unsigned short, 6> PLANE_INDICES = planeIndices();
+
+static_assert(CUBE_INDICES[35] == 20, "cube indices");
+static_assert(CUBE_VERTICES[0].normal[0] == 1.0f && CUBE_VERTICES[0].position[0] == 0.5f, "cube vertices");
+
+}
+
+// The built-in primitive shapes, generated once and stored back to back in one vertex buffer (packed StaticVertex) and
+// one 16-bit index buffer behind a single VAO. Every user shares that storage through Primitive handles, so drawing a
+// thousand cubes costs no geometry of its own. Built on first use; GL thread only.
+class PrimitiveRegistry
+{
+public:
+    static const int SEGMENTS = 32;   // around the Y axis, for the round shapes
+    static const int RINGS = 16;      // pole to pole on the sphere; half of it per capsule end
+
+    static PrimitiveRegistry& instance()
+    {
+        static PrimitiveRegistry registry;
+        return registry;
+    }
+
+    PrimitiveRegistry(const PrimitiveRegistry&) = delete;
+    PrimitiveRegistry& operator=(const PrimitiveRegistry&) = delete;
+
+    const Primitive& get(PrimitiveShape shape)
+    {
+        if (!vao)
+            build();
+        return primitives[static_cast<size_t>(shape)];
+    }
+
+    // binds the VAO every primitive draws from
+    void bind()
+    {
+        if (!vao)
+            build();
+        GLState::instance().bindVertexArray(vao.get());
+    }
+
+    void draw(const Primitive& primitive)
+    {
+        bind();
+        glDrawElementsBaseVertex(GL_TRIANGLES, primitive.indexCount, GL_UNSIGNED_SHORT, primitive.indexPointer(), primitive.baseVertex);
+    }
+
+    GLuint vertexArray() { if (!vao) build(); return vao.get(); }
+
+    // sets up the primitive vertex attributes (0 position, 1 normal, 2 texture coords) and index buffer on the currently
+    // bound VAO, for VAOs that add attributes of their own (instancing)
+    void setupAttributes()
+    {
+        if (!vao)
+            build();
+        GLState& state = GLState::instance();
+        state.bindBuffer(GL_ARRAY_BUFFER, vbo.get());
+        StaticVertex::Layout::setupAttributes();
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo.get());
+    }
+
+    // bytes of vertex and index data of all primitives together
+    size_t bytes() const { return vertexBytes + indexBytes; }
+
+    void printStats() const
+    {
+        std::cout << "primitives: " << static_cast<size_t>(PrimitiveShape::Count) << " shapes, " << vertexBytes / sizeof(StaticVertex) << " vertices, "
+                  << indexBytes / sizeof(unsigned short) << " indices, " << bytes() / 1024.0f << " KiB in one vertex and one index buffer" << std::endl;
+    }
+
+    // deletes the buffers; call while the context is still current. Handles taken before are invalid afterwards.
+    void clear()
+    {
+        vao.reset();
+        vbo.reset();
+        ebo.reset();
+        vertexBytes = indexBytes = 0;
+    }
+
+private:
+    GLVertexArray vao;
+    GLBuffer vbo, ebo;
+    Primitive primitives[static_cast<size_t>(PrimitiveShape::Count)];
+    size_t vertexBytes = 0, indexBytes = 0;
+
+    // a point of a lathe profile: distance from the Y axis, height, and the normal in that plane
+    struct ProfilePoint {
+        float radius, y;
+        float normalRadius, normalY;
+        bool joinNext;   // false where the next point only starts a new normal (the rim of a cap)
+    };
+
+    PrimitiveRegistry() {}
+
+    ~PrimitiveRegistry()
+    {
+        // never touches GL here: the context is usually gone by the time statics are destroyed (see clear())
+        vao.release();
+        vbo.release();
+        ebo.release();
+    }
+
+    void build()
+    {
+        std::vector<StaticVertex> vertices;
+        std::vector<unsigned short> indices;
+        auto add = [&](PrimitiveShape shape, const PrimitiveVertex* shapeVertices, size_t vertexCount, const unsigned short* shapeIndices, size_t indexCount) {
+            Primitive& primitive = primitives[static_cast<size_t>(shape)];
+            primitive.baseVertex = static_cast<GLint>(vertices.size());
+            primitive.indexOffset = indices.size();
+            primitive.vertexCount = static_cast<GLsizei>(vertexCount);
+            primitive.indexCount = static_cast<GLsizei>(indexCount);
+            primitive.bounds = Bounds::fromPositions(shapeVertices, vertexCount, sizeof(PrimitiveVertex));
+            for (size_t i = 0; i < vertexCount; i++)
+                vertices.push_back(pack(shapeVertices[i]));
+            indices.insert(indices.end(), shapeIndices, shapeIndices + indexCount);
+        };
+
+        add(PrimitiveShape::Cube, primitive_tables::CUBE_VERTICES.data(), primitive_tables::CUBE_VERTICES.size(),
+            primitive_tables::CUBE_INDICES.data(), primitive_tables::CUBE_INDICES.size());
+        add(PrimitiveShape::Plane, primitive_tables::PLANE_VERTICES.data(), primitive_tables::PLANE_VERTICES.size(),
+            primitive_tables::PLANE_INDICES.data(), primitive_tables::PLANE_INDICES.size());
+
+        const float pi = 3.14159265358979f;
+        std::vector<ProfilePoint> profile;
+        for (int i = 0; i <= RINGS; i++)
+        {
+            float angle = pi * i / RINGS;
+            profile.push_back({ 0.5f * std::sin(angle), 0.5f * std::cos(angle), std::sin(angle), std::cos(angle), true });
+        }
+        addLathe(PrimitiveShape::Sphere, profile, add);
+
+        profile = {
+            { 0.0f, 0.5f, 0.0f, 1.0f, true },  { 0.5f, 0.5f, 0.0f, 1.0f, false },
+            { 0.5f, 0.5f, 1.0f, 0.0f, true },  { 0.5f, -0.5f, 1.0f, 0.0f, false },
+            { 0.5f, -0.5f, 0.0f, -1.0f, true }, { 0.0f, -0.5f, 0.0f, -1.0f, true },
+        };
+        addLathe(PrimitiveShape::Cylinder, profile, add);
+
+        // two hemispheres of radius 0.25 joined by a 0.5 high body
+        profile.clear();
+        for (int i = 0; i <= RINGS; i++)
+        {
+            float angle = pi * i / RINGS;
+            float center = i <= RINGS / 2 ? 0.25f : -0.25f;
+            profile.push_back({ 0.25f * std::sin(angle), center + 0.25f * std::cos(angle), std::sin(angle), std::cos(angle), true });
+            if (i == RINGS / 2)
+                profile.push_back({ 0.25f, -0.25f, 1.0f, 0.0f, true });
+        }
+        addLathe(PrimitiveShape::Capsule, profile, add);
+
+        GLState& state = GLState::instance();
+        vao = GLVertexArray::create();
+        vbo = GLBuffer::create();
+        ebo = GLBuffer::create();
+        state.bindVertexArray(vao.get());
+        state.bindBuffer(GL_ARRAY_BUFFER, vbo.get());
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(StaticVertex), vertices.data(), GL_STATIC_DRAW);
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo.get());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+        StaticVertex::Layout::setupAttributes();
+        vertexBytes = vertices.size() * sizeof(StaticVertex);
+        indexBytes = indices.size() * sizeof(unsigned short);
+    }
+
+    // revolves profile (top to bottom) around the Y axis; faces point outwards. Triangles that collapse onto the axis
+    // are left out.
+    template<typename Add>
+    static void addLathe(PrimitiveShape shape, const std::vector<ProfilePoint>& profile, Add& add)
+    {
+        const float pi = 3.14159265358979f;
+        std::vector<PrimitiveVertex> vertices;
+        std::vector<unsigned short> indices;
+        for (size_t i = 0; i < profile.size(); i++)
+        {
+            const ProfilePoint& point = profile[i];
+            for (int j = 0; j <= SEGMENTS; j++)
+            {
+                float angle = 2.0f * pi * j / SEGMENTS;
+                float c = std::cos(angle), s = std::sin(angle);
+                vertices.push_back({ { point.radius * c, point.y, point.radius * s }, { point.normalRadius * c, point.normalY, point.normalRadius * s },
+                                     { static_cast<float>(j) / SEGMENTS, 1.0f - static_cast<float>(i) / (profile.size() - 1) } });
+            }
+        }
+        for (size_t i = 0; i + 1 < profile.size(); i++)
+        {
+            if (!profile[i].joinNext)
+                continue;
+            for (int j = 0; j < SEGMENTS; j++)
+            {
+                unsigned short a = static_cast<unsigned short>(i * (SEGMENTS + 1) + j), c = static_cast<unsigned short>(a + 1);
+                unsigned short b = static_cast<unsigned short>(a + SEGMENTS + 1), d = static_cast<unsigned short>(b + 1);
+                if (profile[i].radius > 0.0f)
+                    indices.insert(indices.end(), { a, c, b });
+                if (profile[i + 1].radius > 0.0f)
+                    indices.insert(indices.end(), { c, d, b });
+            }
+        }
+        add(shape, vertices.data(), vertices.size(), indices.data(), indices.size());
+    }
+
+    static StaticVertex pack(const PrimitiveVertex& vertex)
+    {
+        StaticVertex packed;
+        for (int k = 0; k < 3; k++)
+            packed.position[k] = vertex.position[k];
+        packed.normal = packNormal(glm::vec3(vertex.normal[0], vertex.normal[1], vertex.normal[2]));
+        packed.texCoords = packTexCoords(glm::vec2(vertex.texCoords[0], vertex.texCoords[1]));
+        return packed;
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define PROCESSMEMORY_IMPLEMENTATION
+#include "ProcessMemory.h"
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef PROCESSMEMORY_H
+#define PROCESSMEMORY_H
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Resident memory of this process, for the memory benchmarks. Returns 0 where the platform can't tell.
+struct ProcessMemory
+{
+    // bytes currently resident (working set on Windows)
+    static size_t currentResident()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.WorkingSetSize;
+        return 0;
+#else
+        // second field of statm is the resident page count
+        FILE* statm = fopen("/proc/self/statm", "r");
+        if (!statm)
+            return 0;
+        long pages = 0, resident = 0;
+        int read = fscanf(statm, "%ld %ld", &pages, &resident);
+        fclose(statm);
+        return read == 2 ? static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+#endif
+    }
+
+    // most bytes ever resident since the process started
+    static size_t peakResident()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.PeakWorkingSetSize;
+        return 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+#ifdef __APPLE__
+        return static_cast<size_t>(usage.ru_maxrss);          // bytes on macOS
+#else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;   // kilobytes on Linux
+#endif
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define PROGRAMBUILD_IMPLEMENTATION
+#include "ProgramBuild.h"
\ No newline at end of file
@@ -0,0 +1,180 @@
+#ifndef PROGRAMBUILD_H
+#define PROGRAMBUILD_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "GLHandles.h"
+#include "ProgramCache.h"
+#include "ShaderPreprocessor.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Builds one program from preprocessed sources: restored from the program binary cache if possible, otherwise compiled
+// and linked. begin() only issues the work; with KHR_parallel_shader_compile enabled the driver compiles on its own
+// threads and done() can be polled without blocking, so many programs can be started before any is waited for.
+// finish() waits, prints the logs and caches the binary.
+class ProgramBuild
+{
+public:
+    GLProgram program;
+
+    ProgramBuild() {}
+
+    ~ProgramBuild()
+    {
+        deleteShaders();
+    }
+
+    ProgramBuild(ProgramBuild&& other) noexcept
+        : program(std::move(other.program)), vertex(other.vertex), fragment(other.fragment), cacheKey(other.cacheKey),
+          cached(other.cached), start(other.start)
+    {
+        other.vertex = other.fragment = 0;
+    }
+
+    ProgramBuild& operator=(ProgramBuild&& other) noexcept
+    {
+        if (this != &other)
+        {
+            deleteShaders();
+            program = std::move(other.program);
+            vertex = other.vertex;
+            fragment = other.fragment;
+            cacheKey = other.cacheKey;
+            cached = other.cached;
+            start = other.start;
+            other.vertex = other.fragment = 0;
+        }
+        return *this;
+    }
+
+    ProgramBuild(const ProgramBuild&) = delete;
+    ProgramBuild& operator=(const ProgramBuild&) = delete;
+
+    // lets the driver compile on as many threads as it likes, if it supports KHR_parallel_shader_compile. Once is enough.
+    static bool enableParallelCompile()
+    {
+        static bool enabled = false;
+        GLExtensions& extensions = GLExtensions::instance();
+        if (!enabled && extensions.hasParallelShaderCompile)
+            extensions.maxShaderCompilerThreads(0xffffffffu);
+        enabled = true;
+        return extensions.hasParallelShaderCompile;
+    }
+
+    // loads the cached binary or issues compile and link of the sources
+    void begin(const ShaderSources& sources)
+    {
+        ProgramCache& cache = ProgramCache::instance();
+        cacheKey = cache.key(sources.vertexCode, sources.fragmentCode, sources.defines.text());
+        program = GLProgram::create();
+        cached = cache.load(program.get(), cacheKey);
+        if (cached)
+            return;
+        start = std::chrono::steady_clock::now();
+        vertex = compile(GL_VERTEX_SHADER, sources.vertexCode);
+        fragment = compile(GL_FRAGMENT_SHADER, sources.fragmentCode);
+        glAttachShader(program.get(), vertex);
+        glAttachShader(program.get(), fragment);
+        cache.prepare(program.get());
+        glLinkProgram(program.get());
+    }
+
+    // true once finish() won't block (always true without parallel compile, where finish() is where the driver works)
+    bool done() const
+    {
+        if (cached || !GLExtensions::instance().hasParallelShaderCompile)
+            return true;
+        GLint complete = GL_FALSE;
+        glGetProgramiv(program.get(), GL_COMPLETION_STATUS_KHR, &complete);
+        return complete == GL_TRUE;
+    }
+
+    // waits for the build, prints compile/link errors and stores the binary of a fresh link. False if it didn't link, in
+    // which case the source files are listed too, so the source string numbers in the messages can be told apart.
+    bool finish(const ShaderSources& sources)
+    {
+        if (cached)
+            return true;
+        bool compiled = checkCompileErrors(vertex, "VERTEX");
+        compiled = checkCompileErrors(fragment, "FRAGMENT") && compiled;
+        bool linked = compiled && checkCompileErrors(program.get(), "PROGRAM");
+        glDetachShader(program.get(), vertex);
+        glDetachShader(program.get(), fragment);
+        deleteShaders();
+        if (!linked)
+        {
+            for (size_t i = 0; i < sources.files.size(); i++)
+                std::cout << "  source " << i << ": " << sources.files[i] << std::endl;
+            return false;
+        }
+        ProgramCache& cache = ProgramCache::instance();
+        cache.recordCompile(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        cache.store(program.get(), cacheKey);
+        return true;
+    }
+
+    // gives up the program and shader objects without deleting them, for when the context is already gone
+    void release()
+    {
+        program.release();
+        vertex = fragment = 0;
+    }
+
+    // utility function for checking shader compilation/linking errors; false (after printing the log) on failure.
+    // ------------------------------------------------------------------------
+    static bool checkCompileErrors(GLuint shader, std::string type)
+    {
+        GLint success;
+        GLchar infoLog[1024];
+        if (type != "PROGRAM")
+        {
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+        else
+        {
+            glGetProgramiv(shader, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+        return success == GL_TRUE;
+    }
+
+private:
+    GLuint vertex = 0, fragment = 0;
+    uint64_t cacheKey = 0;
+    bool cached = false;
+    std::chrono::steady_clock::time_point start;
+
+    static GLuint compile(GLenum type, const std::string& code)
+    {
+        GLuint shader = glCreateShader(type);
+        const char* source = code.c_str();
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    void deleteShaders()
+    {
+        if (vertex)
+            glDeleteShader(vertex);
+        if (fragment)
+            glDeleteShader(fragment);
+        vertex = fragment = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define PROGRAMCACHE_IMPLEMENTATION
+#include "ProgramCache.h"
\ No newline at end of file
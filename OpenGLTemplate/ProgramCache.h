@@ -0,0 +1,253 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "Hash.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// shader programs built during startup, and where they came from
+struct ProgramCacheStats {
+    unsigned int loaded = 0;     // programs restored from a cached binary
+    unsigned int compiled = 0;   // programs compiled and linked from source
+    unsigned int rejected = 0;   // cached binaries the driver refused (new driver, different GPU...), compiled instead
+    double loadMs = 0.0;
+    double compileMs = 0.0;
+};
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary, GL 4.1 or ARB_get_program_binary,
+// loaded through GLExtensions).
+// Each program is stored as <directory>/<key>.bin, the key hashing the shader sources, the defines they were built with
+// and the driver's GL_VENDOR/GL_RENDERER/GL_VERSION, so a driver update or another GPU simply misses. A binary the
+// driver still rejects is deleted and the program is compiled from source again. Without driver support every program
+// is compiled from source. GL thread only.
+class ProgramCache
+{
+public:
+    // bump whenever the file layout changes
+    static const uint32_t VERSION = 1;
+
+    static ProgramCache& instance()
+    {
+        static ProgramCache cache;
+        return cache;
+    }
+
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+
+    // where the binaries go, relative to the working directory unless absolute
+    void setDirectory(const std::string& path)
+    {
+        directory = path;
+    }
+
+    const std::string& cacheDirectory() const { return directory; }
+
+    // true if the driver can save and restore program binaries
+    bool supported()
+    {
+        if (support < 0)
+        {
+            GLint formats = 0;
+            if (GLExtensions::instance().hasProgramBinary)
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            support = formats > 0 ? 1 : 0;
+        }
+        return support == 1;
+    }
+
+    // identifies a program built from these (fully preprocessed) sources and defines on the current driver
+    uint64_t key(const std::string& vertexSource, const std::string& fragmentSource, const std::string& defines = std::string())
+    {
+        if (driver.empty())
+        {
+            for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+            {
+                const GLubyte* value = glGetString(name);
+                driver += value ? reinterpret_cast<const char*>(value) : "";
+                driver += '\n';
+            }
+        }
+        uint64_t hash = fnv1a(driver);
+        hash = fnv1a(&VERSION, sizeof(VERSION), hash);
+        // lengths go in too, so moving text between the stages changes the key
+        for (const std::string* part : { &vertexSource, &fragmentSource, &defines })
+        {
+            uint64_t length = part->size();
+            hash = fnv1a(&length, sizeof(length), hash);
+            hash = fnv1a(*part, hash);
+        }
+        return hash;
+    }
+
+    // call before glLinkProgram on a program that is going to be stored
+    void prepare(GLuint program)
+    {
+        if (supported())
+            GLExtensions::instance().programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // restores the program from its cached binary; false if there is none or the driver rejected it, in which case
+    // the program has to be built from source (and stored)
+    bool load(GLuint program, uint64_t key)
+    {
+        if (!supported())
+            return false;
+        auto start = std::chrono::steady_clock::now();
+        std::string path = filePath(key);
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+
+        FileHeader header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != VERSION || header.key != key)
+        {
+            in.close();
+            std::remove(path.c_str());
+            return false;
+        }
+        std::vector<char> binary(header.length);
+        if (!in.read(binary.data(), static_cast<std::streamsize>(binary.size())))
+        {
+            in.close();
+            std::remove(path.c_str());
+            return false;
+        }
+        in.close();
+
+        GLExtensions::instance().programBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            totals.rejected++;
+            std::remove(path.c_str());
+            return false;
+        }
+        totals.loaded++;
+        totals.loadMs += millisecondsSince(start);
+        return true;
+    }
+
+    // writes the binary of a successfully linked program
+    void store(GLuint program, uint64_t key)
+    {
+        if (!supported())
+            return;
+        GLint linked = GL_FALSE, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!linked || length <= 0)
+            return;
+
+        FileHeader header = {};
+        memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.key = key;
+        std::vector<char> binary(static_cast<size_t>(length));
+        GLsizei written = 0;
+        GLExtensions::instance().getProgramBinary(program, length, &written, &header.format, binary.data());
+        header.length = static_cast<uint32_t>(written);
+
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        std::string path = filePath(key);
+        // through a temporary file so a crash never leaves a half-written binary behind
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                std::cout << "ERROR::PROGRAM_CACHE:: could not write " << temporary << std::endl;
+                return;
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(binary.data(), written);
+            if (!out)
+            {
+                std::cout << "ERROR::PROGRAM_CACHE:: failed writing " << temporary << std::endl;
+                return;
+            }
+        }
+        std::remove(path.c_str());
+        if (std::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            std::cout << "ERROR::PROGRAM_CACHE:: could not replace " << path << std::endl;
+            std::remove(temporary.c_str());
+        }
+    }
+
+    // counts a program built from source, timed by the caller from first compile to link
+    void recordCompile(double milliseconds)
+    {
+        totals.compiled++;
+        totals.compileMs += milliseconds;
+    }
+
+    // deletes every cached binary, e.g. to measure a cold start
+    void purge()
+    {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+            if (entry.path().extension() == ".bin")
+                std::filesystem::remove(entry.path(), error);
+    }
+
+    ProgramCacheStats stats() const { return totals; }
+
+    void resetStats() { totals = ProgramCacheStats(); }
+
+    void printStats() const
+    {
+        std::cout << "shader programs: " << totals.loaded << " loaded from the binary cache in " << totals.loadMs << " ms, "
+                  << totals.compiled << " compiled from source in " << totals.compileMs << " ms";
+        if (totals.rejected > 0)
+            std::cout << " (" << totals.rejected << " cached binaries rejected by the driver)";
+        std::cout << std::endl;
+    }
+
+private:
+    static constexpr char MAGIC[8] = { 'O', 'G', 'L', 'T', 'P', 'R', 'G', '\0' };
+
+    struct FileHeader {
+        char     magic[8];
+        uint32_t version;
+        GLenum   format;    // driver specific binary format
+        uint64_t key;
+        uint32_t length;    // bytes of binary following the header
+        uint32_t padding;
+    };
+
+    std::string directory = "shader_cache";
+    std::string driver;     // GL_VENDOR, GL_RENDERER and GL_VERSION
+    int support = -1;       // unknown until there is a context
+    ProgramCacheStats totals;   // since startup or resetStats()
+
+    ProgramCache() {}
+
+    std::string filePath(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+#endif
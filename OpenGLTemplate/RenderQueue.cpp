@@ -0,0 +1,2 @@
+#define RENDERQUEUE_IMPLEMENTATION
+#include "RenderQueue.h"
\ No newline at end of file
@@ -0,0 +1,249 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "FrameUniforms.h"
+#include "GeometryArena.h"
+#include "GLState.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "PrimitiveRegistry.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+enum class RenderPass : uint32_t {
+    Opaque = 0,        // drawn first, front to back so early depth testing rejects hidden fragments
+    Transparent = 1    // drawn last, back to front with blending and without depth writes
+};
+
+// one deferred draw: every range of an arena mesh, a registry primitive, or glDrawArrays on a vertex array
+struct DrawPacket {
+    Shader*     shader = nullptr;
+    Material*   material = nullptr;   // may be null
+    const Mesh* mesh = nullptr;
+    const Primitive* primitive = nullptr;
+    GLuint      vertexArray = 0;      // for glDrawArrays packets
+    GLint       first = 0;
+    GLsizei     count = 0;
+    glm::mat4   model = glm::mat4(1.0f);
+};
+
+// Deferred draw submission. Draws are queued with a 64-bit key built from pass, program, material, geometry and
+// quantized depth, radix sorted, and then executed in key order so that draws sharing state run back to back:
+//
+//   opaque:       pass(2) | program(10) | material(14) | geometry(12) | depth(24, near first) | unused(2)
+//   transparent:  pass(2) | depth(24, far first) | program(10) | material(14) | geometry(12) | unused(2)
+//
+// Program, material and geometry fields are serials/names masked to their width; a collision only costs a state
+// change, never correctness, since every packet carries the objects it draws with.
+class RenderQueue
+{
+public:
+    // starts a frame; depths are the distance from cameraPosition, quantized over [near, far]
+    void begin(const glm::vec3& cameraPosition, float near, float far)
+    {
+        camera = cameraPosition;
+        nearPlane = near;
+        farPlane = far;
+        packets.clear();
+        items.clear();
+    }
+
+    // queues every range of mesh, positioned by model
+    void submit(Shader& shader, const Mesh& mesh, const glm::mat4& model, RenderPass pass = RenderPass::Opaque)
+    {
+        DrawPacket packet;
+        packet.shader = &shader;
+        packet.material = mesh.material.get();
+        packet.mesh = &mesh;
+        packet.vertexArray = GeometryArena::instance().vertexArray(mesh.format);
+        packet.model = model;
+        push(packet, pass);
+    }
+
+    // queues a primitive from the PrimitiveRegistry
+    void submitPrimitive(Shader& shader, const Primitive& primitive, const glm::mat4& model, Material* material = nullptr,
+                         RenderPass pass = RenderPass::Opaque)
+    {
+        DrawPacket packet;
+        packet.shader = &shader;
+        packet.material = material;
+        packet.primitive = &primitive;
+        packet.vertexArray = PrimitiveRegistry::instance().vertexArray();
+        packet.model = model;
+        push(packet, pass);
+    }
+
+    // queues a non-indexed draw of count vertices from vertexArray
+    void submitArrays(Shader& shader, GLuint vertexArray, GLint first, GLsizei count, const glm::mat4& model,
+                      Material* material = nullptr, RenderPass pass = RenderPass::Opaque)
+    {
+        DrawPacket packet;
+        packet.shader = &shader;
+        packet.material = material;
+        packet.vertexArray = vertexArray;
+        packet.first = first;
+        packet.count = count;
+        packet.model = model;
+        push(packet, pass);
+    }
+
+    size_t size() const { return packets.size(); }
+
+    // sorts the queued draws and issues them; the queue is empty afterwards. Model matrices for programs with a PerDraw
+    // block are written to the FrameUniforms ring in one upload per maxDraws() packets, the others set the 'model' uniform.
+    void execute()
+    {
+        sortItems();
+
+        GLState& state = GLState::instance();
+        FrameUniforms& uniforms = FrameUniforms::instance();
+        Shader* shader = nullptr;
+        Material* material = nullptr;
+        UniformLocation modelLocation{ -1 };
+        bool transparent = false;
+        size_t chunkStart = 0, chunkEnd = 0;
+        GLintptr chunkOffset = 0;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            const SortItem& item = items[i];
+            const DrawPacket& packet = packets[item.index];
+            bool transparentPacket = (item.key >> PASS_SHIFT) == static_cast<uint64_t>(RenderPass::Transparent);
+            if (transparentPacket != transparent)
+            {
+                setTransparent(transparentPacket);
+                transparent = transparentPacket;
+            }
+            if (packet.shader != shader)
+            {
+                shader = packet.shader;
+                shader->use();
+                modelLocation = shader->location("model");
+                material = nullptr; // sampler units differ between shaders
+            }
+            if (packet.material != material)
+            {
+                material = packet.material;
+                if (material)
+                    material->bind(*shader);
+            }
+            if (shader->hasPerDrawBlock())
+            {
+                if (i >= chunkEnd)
+                {
+                    chunkStart = i;
+                    chunkEnd = std::min(items.size(), i + uniforms.maxDraws());
+                    chunkOffset = writeDraws(chunkStart, chunkEnd);
+                }
+                uniforms.bindDraw(chunkOffset + static_cast<GLintptr>((i - chunkStart) * uniforms.drawStride()));
+            }
+            else
+                shader->setMat4(modelLocation, packet.model);
+            state.bindVertexArray(packet.vertexArray);
+            if (packet.mesh)
+            {
+                for (const MeshRange& range : packet.mesh->ranges)
+                    glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_SHORT, packet.mesh->indexOffset(range), packet.mesh->baseVertex(range));
+            }
+            else if (packet.primitive)
+                glDrawElementsBaseVertex(GL_TRIANGLES, packet.primitive->indexCount, GL_UNSIGNED_SHORT, packet.primitive->indexPointer(), packet.primitive->baseVertex);
+            else
+                glDrawArrays(GL_TRIANGLES, packet.first, packet.count);
+        }
+        if (transparent)
+            setTransparent(false);
+        packets.clear();
+        items.clear();
+    }
+
+private:
+    static const int PASS_SHIFT = 62;
+    static const uint64_t DEPTH_MAX = (1u << 24) - 1;
+
+    struct SortItem {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    vector<DrawPacket> packets;
+    vector<SortItem> items, scratch;
+    vector<PerDrawData> drawData;
+    glm::vec3 camera = glm::vec3(0.0f);
+    float nearPlane = 0.1f, farPlane = 100.0f;
+
+    void push(const DrawPacket& packet, RenderPass pass)
+    {
+        glm::vec3 position(packet.model[3]);
+        float t = (glm::length(position - camera) - nearPlane) / (farPlane - nearPlane);
+        uint64_t depth = static_cast<uint64_t>(glm::clamp(t, 0.0f, 1.0f) * DEPTH_MAX);
+        uint64_t program = packet.shader->serial & 0x3ff;
+        uint64_t material = (packet.material ? packet.material->serial : 0) & 0x3fff;
+        uint64_t geometry = packet.vertexArray & 0xfff;
+
+        uint64_t key = static_cast<uint64_t>(pass) << PASS_SHIFT;
+        if (pass == RenderPass::Opaque)
+            key |= program << 52 | material << 38 | geometry << 26 | depth << 2;
+        else
+            key |= (DEPTH_MAX - depth) << 38 | program << 28 | material << 14 | geometry << 2;
+
+        items.push_back({ key, static_cast<uint32_t>(packets.size()) });
+        packets.push_back(packet);
+    }
+
+    // uploads the per-draw data of sorted items [first, last) in one go, returns the offset of the first
+    GLintptr writeDraws(size_t first, size_t last)
+    {
+        drawData.clear();
+        for (size_t i = first; i < last; i++)
+            drawData.push_back(FrameUniforms::perDraw(packets[items[i].index].model));
+        return FrameUniforms::instance().writeDraws(drawData.data(), drawData.size());
+    }
+
+    // LSD radix sort on the keys, 8 bits per pass; passes where every key has the same byte are skipped
+    void sortItems()
+    {
+        scratch.resize(items.size());
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            size_t counts[256] = {};
+            for (const SortItem& item : items)
+                counts[(item.key >> shift) & 0xff]++;
+            if (items.empty() || counts[(items[0].key >> shift) & 0xff] == items.size())
+                continue;
+            size_t offsets[256];
+            size_t sum = 0;
+            for (int b = 0; b < 256; b++)
+            {
+                offsets[b] = sum;
+                sum += counts[b];
+            }
+            for (const SortItem& item : items)
+                scratch[offsets[(item.key >> shift) & 0xff]++] = item;
+            items.swap(scratch);
+        }
+    }
+
+    static void setTransparent(bool transparent)
+    {
+        if (transparent)
+        {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glDepthMask(GL_FALSE);
+        }
+        else
+        {
+            glDisable(GL_BLEND);
+            glDepthMask(GL_TRUE);
+        }
+    }
+};
+
+#endif
@@ -9,161 +9,414 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "FrameUniforms.h"
+#include "GLHandles.h"
+#include "GLState.h"
+#include "Hash.h"
+#include "ProgramBuild.h"
+#include "ShaderPreprocessor.h"
+
+#include <algorithm>
+#include <cstdint>
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <string_view>
 #include <iostream>
+#include <type_traits>
+#include <vector>
+
+// a uniform (or uniform block) name, identified by its FNV-1a hash. String literals are hashed at compile time;
+// runtime strings (std::string, string_view or a C string) are hashed without copying.
+struct UniformId
+{
+    uint64_t hash;
+
+    template<size_t N>
+    consteval UniformId(const char (&name)[N]) : hash(fnv1a(name, N - 1)) {}
+    UniformId(const std::string& name) : hash(fnv1a(name)) {}
+    UniformId(std::string_view name) : hash(fnv1a(name.data(), name.size())) {}
+    // only taken for actual pointers, so a literal still goes to the consteval constructor instead of decaying
+    template<typename T> requires std::is_pointer_v<std::remove_reference_t<T>> && std::is_convertible_v<T, const char*>
+    UniformId(T&& name) : hash(fnv1a(static_cast<const char*>(name), std::char_traits<char>::length(name))) {}
+    // a writable buffer (e.g. filled by snprintf) holds a runtime name, up to its terminator
+    template<size_t N>
+    UniformId(char (&name)[N]) : hash(fnv1a(name, std::find(name, name + N, '\0') - name)) {}
+};
+
+// a location looked up once through Shader::location, for the hottest setters
+struct UniformLocation
+{
+    GLint value;
+};
 
 class Shader
 {
 public:
-    unsigned int ID;
-    // constructor generates the shader on the fly
+    // the program object, deleted with the Shader (so a Shader can be moved but not copied)
+    GLProgram ID;
+    // unique per linked program (program names get reused), for caches keyed by shader
+    uint64_t serial = 0;
+    // the sources and permutation the program was built from, and every file they include, for hot reload
+    std::string vertexPath;
+    std::string fragmentPath;
+    ShaderDefines defines;
+    std::vector<std::string> sourceFiles;
+    // constructor generates the shader on the fly: the sources are preprocessed (#include, defines) and the program is
+    // loaded from the binary cache or compiled
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
-    {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-
+    Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines = ShaderDefines())
+    {
+        ShaderSources sources;
+        sources.vertexPath = vertexPath;
+        sources.fragmentPath = fragmentPath;
+        sources.defines = defines;
+        sources.load();
+        ProgramBuild build;
+        build.begin(sources);
+        build.finish(sources);
+        adopt(sources, std::move(build.program));
+    }
+    // takes a program that was built from sources elsewhere (ShaderLibrary::warm builds several at once)
+    Shader(const ShaderSources& sources, GLProgram&& program)
+    {
+        adopt(sources, std::move(program));
+    }
+    // swaps in a newly linked program built from the same (edited) sources. Values of plain uniforms that exist with the
+    // same type in both programs are carried over; sampler units and the shared uniform blocks are set up as at link time.
+    void replaceProgram(const ShaderSources& sources, GLProgram&& program)
+    {
+        copyUniforms(ID.get(), program.get());
+        adopt(sources, std::move(program));
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     {
-        glUseProgram(ID);
+        GLState::instance().useProgram(ID.get());
+    }
+    // uniform lookup
+    // ------------------------------------------------------------------------
+    // location of a uniform, from the table built at link time (-1 if the program has no such active uniform)
+    UniformLocation location(UniformId id) const
+    {
+        auto found = std::lower_bound(uniforms.begin(), uniforms.end(), id.hash,
+                                      [](const ReflectedUniform& uniform, uint64_t hash) { return uniform.hash < hash; });
+        if (found == uniforms.end() || found->hash != id.hash)
+            return UniformLocation{ -1 };
+        return UniformLocation{ found->location };
+    }
+    // texture unit assigned to a sampler uniform at link time, -1 if there's no such sampler
+    GLint samplerUnit(UniformId id) const
+    {
+        auto found = std::lower_bound(uniforms.begin(), uniforms.end(), id.hash,
+                                      [](const ReflectedUniform& uniform, uint64_t hash) { return uniform.hash < hash; });
+        if (found == uniforms.end() || found->hash != id.hash)
+            return -1;
+        return found->unit;
+    }
+    // index of a uniform block, GL_INVALID_INDEX if the program has no such active block
+    GLuint blockIndex(UniformId id) const
+    {
+        for (const ReflectedBlock& block : blocks)
+            if (block.hash == id.hash)
+                return block.index;
+        return GL_INVALID_INDEX;
     }
-    // utility uniform functions
+    // model matrix of the next draw: through the PerDraw ring if the program declares the block, else the 'model' uniform
+    void setModel(const glm::mat4& model) const
+    {
+        if (usesPerDraw)
+            FrameUniforms::instance().pushDraw(model);
+        else
+            setMat4("model", model);
+    }
+    // true if the program reads its model matrix from the PerDraw block
+    bool hasPerDrawBlock() const { return usesPerDraw; }
+    // utility uniform functions. Each takes a hashed name (string literals are hashed at compile time) or a location
+    // looked up once with location(); neither allocates or asks the driver for anything but the glUniform call itself.
     // ------------------------------------------------------------------------
-    void setBool(const std::string& name, bool value) const
+    void setBool(UniformId name, bool value) const { setBool(location(name), value); }
+    void setBool(UniformLocation location, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(location.value, (int)value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string& name, int value) const
+    void setInt(UniformId name, int value) const { setInt(location(name), value); }
+    void setInt(UniformLocation location, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(location.value, value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string& name, float value) const
+    void setFloat(UniformId name, float value) const { setFloat(location(name), value); }
+    void setFloat(UniformLocation location, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(location.value, value);
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
+    void setVec2(UniformId name, const glm::vec2& value) const { setVec2(location(name), value); }
+    void setVec2(UniformLocation location, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(location.value, 1, &value[0]);
     }
-    void setVec2(const std::string& name, float x, float y) const
+    void setVec2(UniformId name, float x, float y) const { setVec2(location(name), x, y); }
+    void setVec2(UniformLocation location, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(location.value, x, y);
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string& name, const glm::vec3& value) const
+    void setVec3(UniformId name, const glm::vec3& value) const { setVec3(location(name), value); }
+    void setVec3(UniformLocation location, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(location.value, 1, &value[0]);
     }
-    void setVec3(const std::string& name, float x, float y, float z) const
+    void setVec3(UniformId name, float x, float y, float z) const { setVec3(location(name), x, y, z); }
+    void setVec3(UniformLocation location, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(location.value, x, y, z);
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string& name, const glm::vec4& value) const
+    void setVec4(UniformId name, const glm::vec4& value) const { setVec4(location(name), value); }
+    void setVec4(UniformLocation location, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(location.value, 1, &value[0]);
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w) const
+    void setVec4(UniformId name, float x, float y, float z, float w) const { setVec4(location(name), x, y, z, w); }
+    void setVec4(UniformLocation location, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(location.value, x, y, z, w);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string& name, const glm::mat2& mat) const
+    void setMat2(UniformId name, const glm::mat2& mat) const { setMat2(location(name), mat); }
+    void setMat2(UniformLocation location, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location.value, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string& name, const glm::mat3& mat) const
+    void setMat3(UniformId name, const glm::mat3& mat) const { setMat3(location(name), mat); }
+    void setMat3(UniformLocation location, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location.value, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string& name, const glm::mat4& mat) const
+    void setMat4(UniformId name, const glm::mat4& mat) const { setMat4(location(name), mat); }
+    void setMat4(UniformLocation location, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location.value, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
-    // utility function for checking shader compilation/linking errors.
-    // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    struct ReflectedUniform {
+        uint64_t hash;
+        GLint location;
+        GLint unit;   // texture unit for samplers, -1 otherwise
+    };
+    struct ReflectedBlock {
+        uint64_t hash;
+        GLuint index;
+    };
+    // active uniforms sorted by name hash, and the uniform blocks
+    std::vector<ReflectedUniform> uniforms;
+    std::vector<ReflectedBlock> blocks;
+    bool usesPerDraw = false;
+
+    // builds the lookup tables from the linked program. Arrays are entered under their plain name, "name[0]" and
+    // every "name[i]", since shader code and callers use all three.
+    void reflect()
     {
-        GLint success;
-        GLchar infoLog[1024];
-        if (type != "PROGRAM")
+        static uint64_t nextSerial = 0;
+        serial = ++nextSerial;
+        uniforms.clear();
+        blocks.clear();
+        GLint nextUnit = 0;
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID.get(), GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID.get(), GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++)
         {
-            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-            if (!success)
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID.get(), static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &size, &type, name.data());
+            std::string uniformName(name.data(), length);
+            GLint location = glGetUniformLocation(ID.get(), uniformName.c_str());
+            if (location < 0)
+                continue; // member of a uniform block
+            // samplers get consecutive texture units, one per array element
+            GLint unit = isSampler(type) ? nextUnit : -1;
+            if (unit >= 0)
+                nextUnit += size;
+            uniforms.push_back({ fnv1a(uniformName), location, unit });
+            size_t bracket = uniformName.find('[');
+            if (bracket != std::string::npos && uniformName.compare(bracket, std::string::npos, "[0]") == 0)
             {
-                glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                std::string base = uniformName.substr(0, bracket);
+                uniforms.push_back({ fnv1a(base), location, unit });
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    uniforms.push_back({ fnv1a(elementName), glGetUniformLocation(ID.get(), elementName.c_str()), unit < 0 ? -1 : unit + element });
+                }
             }
         }
-        else
+        std::sort(uniforms.begin(), uniforms.end(), [](const ReflectedUniform& a, const ReflectedUniform& b) { return a.hash < b.hash; });
+
+        glGetProgramiv(ID.get(), GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(ID.get(), GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+        name.resize(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(ID.get(), static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, name.data());
+            blocks.push_back({ fnv1a(name.data(), static_cast<size_t>(length)), static_cast<GLuint>(i) });
+        }
+    }
+
+    // points every sampler at the unit reflect() gave it. Done once here, so drawing only has to bind textures.
+    void assignSamplerUnits()
+    {
+        GLint maxUnits = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxUnits);
+        GLState& state = GLState::instance();
+        GLuint previous = state.program();
+        state.useProgram(ID.get());
+        for (ReflectedUniform& uniform : uniforms)
         {
-            glGetProgramiv(shader, GL_LINK_STATUS, &success);
-            if (!success)
+            if (uniform.unit < 0)
+                continue;
+            if (uniform.unit >= maxUnits)
             {
-                glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                std::cout << "ERROR::SHADER::TOO_MANY_SAMPLERS: only " << maxUnits << " texture units available" << std::endl;
+                uniform.unit = -1;
+                continue;
             }
+            glUniform1i(uniform.location, uniform.unit);
+        }
+        // the shadow starts out unknown, in which case there's nothing to go back to
+        if (previous != GLState::UNKNOWN)
+            state.useProgram(previous);
+    }
+
+    // attaches the PerFrame and PerDraw blocks, if the program has them, to the binding points FrameUniforms fills
+    void bindSharedBlocks()
+    {
+        GLuint perFrame = blockIndex("PerFrame");
+        if (perFrame != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID.get(), perFrame, FrameUniforms::PER_FRAME_BINDING);
+        GLuint perDraw = blockIndex("PerDraw");
+        usesPerDraw = perDraw != GL_INVALID_INDEX;
+        if (usesPerDraw)
+            glUniformBlockBinding(ID.get(), perDraw, FrameUniforms::PER_DRAW_BINDING);
+    }
+
+    // one active non-block uniform: name, type and array size
+    struct ActiveUniform {
+        std::string name;
+        GLenum type;
+        GLint size;
+    };
+
+    static std::vector<ActiveUniform> activeUniforms(GLuint program)
+    {
+        std::vector<ActiveUniform> result;
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            ActiveUniform uniform;
+            glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &uniform.size, &uniform.type, name.data());
+            uniform.name.assign(name.data(), length);
+            if (uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3, 3, "[0]") == 0)
+                uniform.name.resize(uniform.name.size() - 3);
+            if (glGetUniformLocation(program, uniform.name.c_str()) >= 0 && !isSampler(uniform.type))
+                result.push_back(uniform);
+        }
+        return result;
+    }
+
+    // copies the values of the uniforms of program from into program to, where to declares them with the same type and size
+    static void copyUniforms(GLuint from, GLuint to)
+    {
+        if (from == 0)
+            return;
+        std::vector<ActiveUniform> target = activeUniforms(to);
+        GLState& state = GLState::instance();
+        GLuint previous = state.program();
+        state.useProgram(to);
+        for (const ActiveUniform& uniform : activeUniforms(from))
+        {
+            auto match = std::find_if(target.begin(), target.end(), [&](const ActiveUniform& other) {
+                return other.name == uniform.name && other.type == uniform.type && other.size == uniform.size;
+            });
+            if (match == target.end())
+                continue;
+            for (GLint element = 0; element < uniform.size; element++)
+            {
+                std::string name = uniform.size > 1 ? uniform.name + "[" + std::to_string(element) + "]" : uniform.name;
+                GLint source = glGetUniformLocation(from, name.c_str());
+                GLint destination = glGetUniformLocation(to, name.c_str());
+                if (source >= 0 && destination >= 0)
+                    copyUniform(from, source, destination, uniform.type);
+            }
+        }
+        if (previous != GLState::UNKNOWN)
+            state.useProgram(previous);
+    }
+
+    // copies one uniform of the given type into the current program; types without a setter here are left alone
+    static void copyUniform(GLuint from, GLint source, GLint destination, GLenum type)
+    {
+        GLfloat f[16];
+        GLint i[4];
+        GLuint u[4];
+        switch (type)
+        {
+        case GL_FLOAT: glGetUniformfv(from, source, f); glUniform1fv(destination, 1, f); break;
+        case GL_FLOAT_VEC2: glGetUniformfv(from, source, f); glUniform2fv(destination, 1, f); break;
+        case GL_FLOAT_VEC3: glGetUniformfv(from, source, f); glUniform3fv(destination, 1, f); break;
+        case GL_FLOAT_VEC4: glGetUniformfv(from, source, f); glUniform4fv(destination, 1, f); break;
+        case GL_FLOAT_MAT2: glGetUniformfv(from, source, f); glUniformMatrix2fv(destination, 1, GL_FALSE, f); break;
+        case GL_FLOAT_MAT3: glGetUniformfv(from, source, f); glUniformMatrix3fv(destination, 1, GL_FALSE, f); break;
+        case GL_FLOAT_MAT4: glGetUniformfv(from, source, f); glUniformMatrix4fv(destination, 1, GL_FALSE, f); break;
+        case GL_INT: case GL_BOOL: glGetUniformiv(from, source, i); glUniform1iv(destination, 1, i); break;
+        case GL_INT_VEC2: case GL_BOOL_VEC2: glGetUniformiv(from, source, i); glUniform2iv(destination, 1, i); break;
+        case GL_INT_VEC3: case GL_BOOL_VEC3: glGetUniformiv(from, source, i); glUniform3iv(destination, 1, i); break;
+        case GL_INT_VEC4: case GL_BOOL_VEC4: glGetUniformiv(from, source, i); glUniform4iv(destination, 1, i); break;
+        case GL_UNSIGNED_INT: glGetUniformuiv(from, source, u); glUniform1uiv(destination, 1, u); break;
+        case GL_UNSIGNED_INT_VEC2: glGetUniformuiv(from, source, u); glUniform2uiv(destination, 1, u); break;
+        case GL_UNSIGNED_INT_VEC3: glGetUniformuiv(from, source, u); glUniform3uiv(destination, 1, u); break;
+        case GL_UNSIGNED_INT_VEC4: glGetUniformuiv(from, source, u); glUniform4uiv(destination, 1, u); break;
+        default: break;
+        }
+    }
+
+    void adopt(const ShaderSources& sources, GLProgram&& program)
+    {
+        vertexPath = sources.vertexPath;
+        fragmentPath = sources.fragmentPath;
+        defines = sources.defines;
+        sourceFiles = sources.files;
+        ID = std::move(program);
+        reflect();
+        assignSamplerUnits();
+        bindSharedBlocks();
+    }
+
+    static bool isSampler(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW:
+        case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_1D_ARRAY_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW:
+        case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_2D_MULTISAMPLE_ARRAY: case GL_SAMPLER_BUFFER: case GL_SAMPLER_2D_RECT:
+        case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_3D: case GL_INT_SAMPLER_CUBE: case GL_INT_SAMPLER_2D_ARRAY:
+        case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_3D: case GL_UNSIGNED_INT_SAMPLER_CUBE: case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+            return true;
+        default:
+            return false;
         }
     }
 };
@@ -0,0 +1,2 @@
+#define SHADERLIBRARY_IMPLEMENTATION
+#include "ShaderLibrary.h"
\ No newline at end of file
@@ -0,0 +1,136 @@
+#ifndef SHADERLIBRARY_H
+#define SHADERLIBRARY_H
+
+#include <glad/glad.h>
+
+#include "ProgramBuild.h"
+#include "Shader.h"
+#include "ShaderPreprocessor.h"
+#include "ShaderReloader.h"
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// one permutation of a shader pair
+struct ShaderVariant {
+    std::string vertexPath;
+    std::string fragmentPath;
+    ShaderDefines defines;
+};
+
+// Every program permutation the renderer uses, built once and shared. get() compiles a missing variant on the spot;
+// warm() builds a whole list up front with all compiles in flight at once, which KHR_parallel_shader_compile drivers
+// spread over their threads. Programs come from the binary cache when it has them. Shaders stay at the same address
+// for the library's lifetime and are registered for hot reload. GL thread only.
+class ShaderLibrary
+{
+public:
+    static ShaderLibrary& instance()
+    {
+        static ShaderLibrary library;
+        return library;
+    }
+
+    ShaderLibrary(const ShaderLibrary&) = delete;
+    ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+    // the program for this permutation, compiled now if it wasn't built yet
+    Shader& get(const std::string& vertexPath, const std::string& fragmentPath, const ShaderDefines& defines = ShaderDefines())
+    {
+        std::string name = key(vertexPath, fragmentPath, defines);
+        auto found = shaders.find(name);
+        if (found != shaders.end())
+            return *found->second;
+        ShaderSources sources;
+        sources.vertexPath = vertexPath;
+        sources.fragmentPath = fragmentPath;
+        sources.defines = defines;
+        sources.load();   // an unreadable file still gets a (broken) shader, which hot reload fixes once the file is there
+        ProgramBuild build;
+        build.begin(sources);
+        return add(name, sources, build);
+    }
+
+    Shader& get(const ShaderVariant& variant)
+    {
+        return get(variant.vertexPath, variant.fragmentPath, variant.defines);
+    }
+
+    // builds every variant that isn't built yet, starting all compiles before waiting for any of them. A variant whose
+    // files can't be read is skipped; get() retries it when it's asked for.
+    void warm(const std::vector<ShaderVariant>& variants)
+    {
+        ProgramBuild::enableParallelCompile();
+        struct Build {
+            std::string name;
+            ShaderSources sources;
+            ProgramBuild build;
+        };
+        std::vector<Build> builds;
+        for (const ShaderVariant& variant : variants)
+        {
+            std::string name = key(variant.vertexPath, variant.fragmentPath, variant.defines);
+            bool queued = shaders.count(name) > 0;
+            for (const Build& build : builds)
+                queued = queued || build.name == name;
+            if (queued)
+                continue;
+            Build build;
+            build.name = name;
+            build.sources.vertexPath = variant.vertexPath;
+            build.sources.fragmentPath = variant.fragmentPath;
+            build.sources.defines = variant.defines;
+            if (!build.sources.load())
+                continue;
+            build.build.begin(build.sources);
+            builds.push_back(std::move(build));
+        }
+        for (Build& build : builds)
+            add(build.name, build.sources, build.build);
+    }
+
+    size_t size() const { return shaders.size(); }
+
+    // deletes every program; call while the context is still current
+    void clear()
+    {
+        for (auto& shader : shaders)
+            ShaderReloader::instance().unwatch(*shader.second);
+        shaders.clear();
+    }
+
+private:
+    std::map<std::string, std::unique_ptr<Shader>> shaders;   // by key()
+
+    ShaderLibrary() {}
+
+    ~ShaderLibrary()
+    {
+        // never touches GL here: the context is usually gone by the time statics are destroyed (see clear())
+        for (auto& shader : shaders)
+            shader.second->ID.release();
+    }
+
+    static std::string key(const std::string& vertexPath, const std::string& fragmentPath, const ShaderDefines& defines)
+    {
+        return vertexPath + '\n' + fragmentPath + '\n' + defines.text();
+    }
+
+    // waits for the build and keeps the shader. One that didn't link is kept too, after its log, so the next get() doesn't
+    // compile it again and hot reload swaps in a fixed program.
+    Shader& add(const std::string& name, const ShaderSources& sources, ProgramBuild& build)
+    {
+        if (!build.finish(sources))
+            std::cout << "ERROR::SHADER_LIBRARY:: " << sources.vertexPath << " / " << sources.fragmentPath << " didn't link, waiting for an edit" << std::endl;
+        std::unique_ptr<Shader> shader(new Shader(sources, std::move(build.program)));
+        Shader& result = *shader;
+        shaders[name] = std::move(shader);
+        ShaderReloader::instance().watch(result);
+        return result;
+    }
+};
+
+#endif
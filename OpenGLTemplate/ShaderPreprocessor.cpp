@@ -0,0 +1,2 @@
+#define SHADERPREPROCESSOR_IMPLEMENTATION
+#include "ShaderPreprocessor.h"
\ No newline at end of file
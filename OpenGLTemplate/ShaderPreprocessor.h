@@ -0,0 +1,168 @@
+#ifndef SHADERPREPROCESSOR_H
+#define SHADERPREPROCESSOR_H
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// the #defines one permutation of a shader is compiled with, e.g. NR_POINT_LIGHTS 2 and HAS_SPECULAR_MAP. Kept sorted,
+// so the same set always gives the same text (and the same program cache key).
+struct ShaderDefines
+{
+    std::map<std::string, std::string> values;
+
+    ShaderDefines& set(const std::string& name, const std::string& value = "1")
+    {
+        values[name] = value;
+        return *this;
+    }
+
+    ShaderDefines& set(const std::string& name, int value)
+    {
+        return set(name, std::to_string(value));
+    }
+
+    bool empty() const { return values.empty(); }
+
+    // the defines as GLSL, one "#define NAME value" line each
+    std::string text() const
+    {
+        std::string result;
+        for (const auto& define : values)
+            result += "#define " + define.first + " " + define.second + "\n";
+        return result;
+    }
+
+    bool operator==(const ShaderDefines& other) const { return values == other.values; }
+};
+
+// Expands a shader file for the GLSL compiler: '#include "file"' lines are replaced by the file (resolved relative to
+// the including file, each file included at most once per stage) and the defines are inserted right after #version.
+// '#line <line> <file index>' directives keep compiler messages pointing at the right line; the index is the file's
+// position in the list of files read.
+class ShaderPreprocessor
+{
+public:
+    static const int MAX_INCLUDE_DEPTH = 16;
+
+    // false if a file couldn't be read (the error has been printed)
+    static bool process(const std::string& path, const ShaderDefines& defines, std::string& output, std::vector<std::string>& files)
+    {
+        output.clear();
+        std::vector<std::string> included;
+        if (!expand(path, output, files, included, 0))
+            return false;
+        insertDefines(output, defines, indexOf(files, std::filesystem::path(path).lexically_normal().string()));
+        return true;
+    }
+
+private:
+    static bool expand(const std::string& path, std::string& output, std::vector<std::string>& files, std::vector<std::string>& included, int depth)
+    {
+        std::string name = std::filesystem::path(path).lexically_normal().string();
+        for (const std::string& file : included)
+            if (file == name)
+                return true;
+        if (depth > MAX_INCLUDE_DEPTH)
+        {
+            std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP: " << name << std::endl;
+            return false;
+        }
+        std::ifstream in(name, std::ios::binary);
+        if (!in)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << name << std::endl;
+            return false;
+        }
+        included.push_back(name);
+        size_t index = indexOf(files, name);
+
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(in, line))
+        {
+            lineNumber++;
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            std::string target;
+            if (!includeTarget(line, target))
+            {
+                output += line;
+                output += '\n';
+                continue;
+            }
+            std::string includePath = (std::filesystem::path(name).parent_path() / target).string();
+            size_t includeIndex = indexOf(files, std::filesystem::path(includePath).lexically_normal().string());
+            output += "#line 1 " + std::to_string(includeIndex) + "\n";
+            if (!expand(includePath, output, files, included, depth + 1))
+                return false;
+            output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(index) + "\n";
+        }
+        return true;
+    }
+
+    // the file of an '#include "file"' line
+    static bool includeTarget(const std::string& line, std::string& target)
+    {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+            return false;
+        size_t open = line.find('"', start + 8);
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (close == std::string::npos)
+            return false;
+        target = line.substr(open + 1, close - open - 1);
+        return true;
+    }
+
+    // after the #version line, which has to stay first. Nothing may precede #version, so the #line that follows is
+    // also what numbers the file's own lines as file index instead of the default 0.
+    static void insertDefines(std::string& source, const ShaderDefines& defines, size_t index)
+    {
+        size_t version = source.find("#version");
+        size_t insertAt = 0;
+        int nextLine = 1;
+        if (version != std::string::npos)
+        {
+            size_t end = source.find('\n', version);
+            insertAt = end == std::string::npos ? source.size() : end + 1;
+            for (size_t i = 0; i < insertAt; i++)
+                nextLine += source[i] == '\n';
+        }
+        source.insert(insertAt, defines.text() + "#line " + std::to_string(nextLine) + " " + std::to_string(index) + "\n");
+    }
+
+    static size_t indexOf(std::vector<std::string>& files, const std::string& name)
+    {
+        for (size_t i = 0; i < files.size(); i++)
+            if (files[i] == name)
+                return i;
+        files.push_back(name);
+        return files.size() - 1;
+    }
+};
+
+// the preprocessed sources of one program permutation
+struct ShaderSources
+{
+    std::string vertexPath;
+    std::string fragmentPath;
+    ShaderDefines defines;
+    std::string vertexCode;
+    std::string fragmentCode;
+    std::vector<std::string> files;   // every file read, includes too; the source string numbers of #line index this
+
+    // preprocesses both stages; false if a file couldn't be read
+    bool load()
+    {
+        files.clear();
+        bool vertex = ShaderPreprocessor::process(vertexPath, defines, vertexCode, files);
+        bool fragment = ShaderPreprocessor::process(fragmentPath, defines, fragmentCode, files);
+        return vertex && fragment;
+    }
+};
+
+#endif
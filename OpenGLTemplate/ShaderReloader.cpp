@@ -0,0 +1,2 @@
+#define SHADERRELOADER_IMPLEMENTATION
+#include "ShaderReloader.h"
\ No newline at end of file
@@ -0,0 +1,170 @@
+#ifndef SHADERRELOADER_H
+#define SHADERRELOADER_H
+
+#include <glad/glad.h>
+
+#include "FileWatcher.h"
+#include "ProgramBuild.h"
+#include "Shader.h"
+#include "ShaderPreprocessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Rebuilds watched shaders when one of their source files (included ones too) changes, while the old program keeps
+// drawing. The new program is compiled and linked without waiting on the driver: with KHR_parallel_shader_compile the
+// work runs on the driver's threads and update() only polls GL_COMPLETION_STATUS_KHR; without it the status query of
+// the next update() is where the driver finishes (and may block). Only a program that linked replaces the old one
+// (Shader::replaceProgram); a broken edit prints its log and leaves the shader as it was. GL thread only.
+class ShaderReloader
+{
+public:
+    static ShaderReloader& instance()
+    {
+        static ShaderReloader reloader;
+        return reloader;
+    }
+
+    ShaderReloader(const ShaderReloader&) = delete;
+    ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+    // starts watching shader's source files. The shader must stay at the same address until unwatch() or clear().
+    void watch(Shader& shader)
+    {
+        parallel = ProgramBuild::enableParallelCompile();
+        for (const Watched& entry : watched)
+            if (entry.shader == &shader)
+                return;
+        watched.push_back({ &shader, watchFiles(shader) });
+    }
+
+    void unwatch(Shader& shader)
+    {
+        watched.erase(std::remove_if(watched.begin(), watched.end(), [&](const Watched& entry) { return entry.shader == &shader; }), watched.end());
+        for (Pending& pending : pendings)
+            if (pending.shader == &shader)
+                pending.shader = nullptr;
+    }
+
+    // call once per frame: starts rebuilds for edited files and swaps in the programs that finished linking
+    void update()
+    {
+        for (const std::string& file : files.changed())
+            for (const Watched& entry : watched)
+                if (std::find(entry.files.begin(), entry.files.end(), file) != entry.files.end())
+                    startRebuild(*entry.shader);
+
+        // a build started above is first polled next frame, so its compile overlaps with this frame's drawing
+        for (size_t i = 0; i < pendings.size();)
+        {
+            if (pendings[i].polls++ == 0 || !pendings[i].build.done())
+            {
+                i++;
+                continue;
+            }
+            complete(pendings[i]);
+            pendings.erase(pendings.begin() + i);
+        }
+    }
+
+    // true if the driver compiles on its own threads
+    bool parallelCompile() const { return parallel; }
+
+    // drops every watch and deletes the programs still being built; call while the context is still current
+    void clear()
+    {
+        pendings.clear();
+        watched.clear();
+    }
+
+private:
+    struct Watched {
+        Shader* shader;
+        std::vector<std::string> files;   // as FileWatcher reports them
+    };
+
+    // a program being built from edited sources
+    struct Pending {
+        Shader* shader;           // null if unwatched meanwhile
+        ShaderSources sources;
+        ProgramBuild build;
+        std::chrono::steady_clock::time_point changed;
+        unsigned int polls = 0;   // update() calls since the build started, including that one
+    };
+
+    FileWatcher files;
+    std::vector<Watched> watched;
+    std::vector<Pending> pendings;
+    bool parallel = false;
+
+    ShaderReloader() {}
+
+    ~ShaderReloader()
+    {
+        // never touches GL here: the context is usually gone by the time statics are destroyed (see clear())
+        for (Pending& pending : pendings)
+            pending.build.release();
+    }
+
+    std::vector<std::string> watchFiles(const Shader& shader)
+    {
+        std::vector<std::string> names;
+        for (const std::string& file : shader.sourceFiles)
+            names.push_back(files.add(file));
+        return names;
+    }
+
+    void startRebuild(Shader& shader)
+    {
+        // an edit while the last one is still compiling supersedes it
+        for (size_t i = 0; i < pendings.size(); i++)
+        {
+            if (pendings[i].shader == &shader)
+            {
+                pendings.erase(pendings.begin() + i);
+                break;
+            }
+        }
+
+        Pending pending;
+        pending.shader = &shader;
+        pending.changed = std::chrono::steady_clock::now();
+        pending.sources.vertexPath = shader.vertexPath;
+        pending.sources.fragmentPath = shader.fragmentPath;
+        pending.sources.defines = shader.defines;
+        if (!pending.sources.load())
+            return;
+        pending.build.begin(pending.sources);
+        pendings.push_back(std::move(pending));
+    }
+
+    void complete(Pending& pending)
+    {
+        bool linked = pending.build.finish(pending.sources);
+        if (!pending.shader)
+            return;
+        if (!linked)
+        {
+            std::cout << "shader reload: " << pending.shader->vertexPath << " / " << pending.shader->fragmentPath
+                      << " failed, keeping the previous program" << std::endl;
+            return;
+        }
+
+        pending.shader->replaceProgram(pending.sources, std::move(pending.build.program));
+        // the edit may have added includes
+        for (Watched& entry : watched)
+            if (entry.shader == pending.shader)
+                entry.files = watchFiles(*pending.shader);
+        double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pending.changed).count();
+        unsigned int frames = pending.polls - 1;
+        std::cout << "shader reload: " << pending.shader->vertexPath << " / " << pending.shader->fragmentPath << " swapped in "
+                  << latencyMs << " ms after the edit was seen (" << frames << (frames == 1 ? " frame" : " frames")
+                  << ", " << (parallel ? "parallel" : "blocking") << " compile)" << std::endl;
+    }
+};
+
+#endif
@@ -9,97 +9,106 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
-#include <array>
+#include <algorithm>
+#include <span>
+#include "GLHandles.h"
+#include "GLState.h"
+#include "InstanceStream.h"
+#include "PrimitiveRegistry.h"
+#include "RenderQueue.h"
 #include "Shader.h"
 
+// one cube of an instanced draw, as instanced.vs reads it (attributes 3 and 4)
+struct SquareInstance {
+    glm::vec4 offsetScale;   // position in xyz, scale in w
+    glm::vec4 color;
+};
+
 //draws a square
 class Square
 {
 
 private:
+    // the registry's cube; the geometry is shared by every Square
+    Primitive cube;
+    // the VAO set up by setupInstancedVAO and the stream its per-instance attributes come from
+    unsigned int instancedVao = 0;
+    InstanceStream* instances = nullptr;
 
 public:
-    float vertices[288] = {
-        // positions          // normals           // texture coords
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
-    };
-
-
-    Square() {
+    // needs a current context: the primitive registry is built on first use
+    Square() : cube(PrimitiveRegistry::instance().get(PrimitiveShape::Cube)) {
 
     }
 
     void drawShape(glm::vec3 position, float scale, Shader& shader) {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, position);
-        model = glm::scale(model, glm::vec3(scale)); 
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        shader.setModel(modelMatrix(position, scale));
+        PrimitiveRegistry::instance().draw(cube);
     }
 
-    void setupVBO(unsigned int& VBO) {
-        glGenBuffers(1, &VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    // draws one cube per position with a single instanced draw per batch that fits the instance stream, instead of
+    // a uniform upload and a draw call each. scales and colors may be empty (scale 1, white), otherwise they are read
+    // parallel to positions. Needs setupInstancedVAO, and a shader that reads the instance attributes (instanced.vs)
+    // has to be current; nothing is drawn without the VAO.
+    void drawInstanced(std::span<const glm::vec3> positions, std::span<const float> scales, std::span<const glm::vec4> colors) {
+        size_t batchSize = instances ? instances->size() / sizeof(SquareInstance) : 0;
+        if (batchSize == 0) {
+            std::cout << "ERROR::SQUARE:: drawInstanced needs setupInstancedVAO first" << std::endl;
+            return;
+        }
+        for (size_t first = 0; first < positions.size(); first += batchSize) {
+            size_t count = std::min(batchSize, positions.size() - first);
+            GLintptr offset = 0;
+            SquareInstance* data = static_cast<SquareInstance*>(instances->map(count * sizeof(SquareInstance), offset));
+            if (!data)
+                return;
+            for (size_t i = 0; i < count; i++) {
+                size_t index = first + i;
+                float scale = index < scales.size() ? scales[index] : 1.0f;
+                data[i].offsetScale = glm::vec4(positions[index], scale);
+                data[i].color = index < colors.size() ? colors[index] : glm::vec4(1.0f);
+            }
+            instances->unmap();
+
+            // the batch moves through the stream, so the instance attributes are pointed at it for every draw
+            GLState::instance().bindVertexArray(instancedVao);
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SquareInstance), (void*)offset);
+            glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(SquareInstance), (void*)(offset + sizeof(glm::vec4)));
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, cube.indexCount, GL_UNSIGNED_SHORT, cube.indexPointer(), static_cast<GLsizei>(count), cube.baseVertex);
+        }
     }
 
-    void setupVAO(unsigned int& VAO, unsigned int& VBO, bool setupNormals, bool setupTexture) {
-        glGenVertexArrays(1, &VAO);
-        
-
-        glBindVertexArray(VAO);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+    // queues the same draw for RenderQueue::execute
+    void submitShape(RenderQueue& queue, glm::vec3 position, float scale, Shader& shader, RenderPass pass = RenderPass::Opaque) {
+        queue.submitPrimitive(shader, cube, modelMatrix(position, scale), nullptr, pass);
+    }
 
-        if (setupNormals) {
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-            glEnableVertexAttribArray(1);
-        }
+    static glm::mat4 modelMatrix(glm::vec3 position, float scale) {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, position);
+        model = glm::scale(model, glm::vec3(scale));
+        return model;
+    }
 
-        if (setupTexture) {
-            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-            glEnableVertexAttribArray(2);
-        }
+    // a VAO over the registry's cube with per-instance position/scale (3) and color (4) from stream; the stream must
+    // outlive the draws and is created here if it wasn't yet
+    void setupInstancedVAO(GLVertexArray& VAO, InstanceStream& stream) {
+        if (!stream.get())
+            stream.create();
+        instances = &stream;
+        VAO = GLVertexArray::create();
+        instancedVao = VAO.get();
+
+        GLState::instance().bindVertexArray(instancedVao);
+        PrimitiveRegistry::instance().setupAttributes();
+
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, stream.get());
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SquareInstance), (void*)0);
+        glEnableVertexAttribArray(3);
+        glVertexAttribDivisor(3, 1);
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(SquareInstance), (void*)sizeof(glm::vec4));
+        glEnableVertexAttribArray(4);
+        glVertexAttribDivisor(4, 1);
     }
 };
 
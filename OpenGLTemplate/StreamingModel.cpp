@@ -0,0 +1,2 @@
+#define STREAMINGMODEL_IMPLEMENTATION
+#include "StreamingModel.h"
\ No newline at end of file
@@ -0,0 +1,455 @@
+#ifndef STREAMINGMODEL_H
+#define STREAMINGMODEL_H
+
+#include <glad/glad.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/config.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "Bvh.h"
+#include "FrustumCuller.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "Model.h"
+#include "ModelCache.h"
+#include "Shader.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+#include "TransformGraph.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// milestones of a streaming load, in milliseconds since construction (-1 until reached)
+struct StreamingStats {
+    double firstDrawableMs = -1.0;    // the first mesh, coarse or full, was uploaded
+    double coarseCompleteMs = -1.0;   // every mesh can be drawn, at least at its coarse LOD
+    double completeMs = -1.0;         // every mesh is at full detail
+    size_t uploadedBytes = 0;
+    unsigned int coarseMeshes = 0;    // meshes that got a coarse LOD before their full version
+};
+
+// Progressive model loader. Importing, converting and optimizing happen on a background thread, which first publishes a
+// vertex-clustered coarse version of every large mesh and then the full meshes as they finish. The GL thread picks them
+// up in update(), spending at most a byte budget per frame on uploads, and Draw() shows the best version of each mesh
+// that is resident. Textures go through the TextureCache asynchronously, so they show previews first as well.
+// Warm loads stream the full meshes straight out of the cooked cache.
+class StreamingModel
+{
+public:
+    static const size_t DEFAULT_UPLOAD_BUDGET = 4 * 1024 * 1024;
+    // the background thread stops producing while this much geometry is waiting for upload
+    static const size_t MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+    // meshes handed to the worker pool per worker between two checks of MAX_QUEUED_BYTES
+    static const size_t MESHES_PER_WORKER = 2;
+    // meshes below this many triangles aren't worth a coarse LOD, they stream at full detail directly
+    static const size_t COARSE_MIN_TRIANGLES = 1024;
+    static const unsigned int COARSE_GRID_SIZE = 24;
+
+    string directory;
+    bool gammaCorrection;
+    StreamingStats stats;
+    // the file's node hierarchy (see Model::nodes), empty until the import has got far enough for update() to pick it up
+    TransformGraph nodes;
+
+    explicit StreamingModel(string const& path, bool gamma = false)
+        : directory(path.substr(0, path.find_last_of('/'))), gammaCorrection(gamma), start(chrono::steady_clock::now())
+    {
+        loader = thread([this, path] { streamInBackground(path); });
+    }
+
+    ~StreamingModel()
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            cancelled = true;
+        }
+        queueChanged.notify_all();
+        if (loader.joinable())
+            loader.join();
+    }
+
+    // the background thread points at this object
+    StreamingModel(const StreamingModel&) = delete;
+    StreamingModel& operator=(const StreamingModel&) = delete;
+
+    // uploads published meshes until byteBudget is used up (at least one per call). Call once per frame on the GL thread.
+    void update(size_t byteBudget = DEFAULT_UPLOAD_BUDGET)
+    {
+        size_t bytes = 0;
+        while (bytes < byteBudget)
+        {
+            Piece piece;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                if (slots.size() != slotCount)
+                {
+                    slots.resize(slotCount);
+                    nodes = std::move(importedNodes);
+                    uploadMaterials = materials;
+                    loadedMaterials.resize(uploadMaterials.size());
+                }
+                if (pieces.empty())
+                {
+                    if (importDone && fullSlots == slots.size() && stats.completeMs < 0.0)
+                        stats.completeMs = millisecondsSinceStart();
+                    break;
+                }
+                piece = std::move(pieces.front());
+                pieces.pop_front();
+                queuedBytes -= piece.bytes();
+            }
+            queueChanged.notify_all();
+            bytes += piece.bytes();
+            uploadPiece(piece);
+        }
+    }
+
+    // true once every mesh is resident at full detail (or the import failed)
+    bool complete() const
+    {
+        return stats.completeMs >= 0.0;
+    }
+
+    // draws every mesh that is resident, at the best LOD uploaded so far, placed by model. Like Model::Draw this sets the
+    // shader's model matrix to model times each mesh's node transform.
+    void Draw(Shader& shader, const glm::mat4& model = glm::mat4(1.0f))
+    {
+        updateTransforms();
+        const glm::mat4* placed = nullptr;
+        for (Slot& slot : slots)
+            if (Mesh* mesh = resident(slot))
+                drawPlaced(shader, *mesh, slot, model, placed);
+    }
+
+    // the same, leaving out meshes whose bounds, placed by model, are outside frustum
+    void Draw(Shader& shader, const Frustum& frustum, const glm::mat4& model)
+    {
+        updateTransforms();
+        updateTree();
+        auto cullStart = chrono::steady_clock::now();
+        meshTree.cull(frustum.transformed(model), visible);
+        lastCull.tested = treeSlots.size();
+        lastCull.visible = visible.size();
+        lastCull.kernel = CullKernel::Bvh;
+        lastCull.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - cullStart).count();
+        const glm::mat4* placed = nullptr;
+        for (uint32_t i : visible)
+            drawPlaced(shader, *resident(slots[treeSlots[i]]), slots[treeSlots[i]], model, placed);
+    }
+
+    // the last frustum test of Draw
+    const CullStats& cullStats() const { return lastCull; }
+
+    // the closest resident mesh hit by worldRay, by its bounds (primitive is the mesh index in node order)
+    RayHit pick(const Ray& worldRay, const glm::mat4& model)
+    {
+        updateTransforms();
+        updateTree();
+        RayHit hit = meshTree.intersect(worldRay.transformed(glm::inverse(model)));
+        if (hit.hit())
+            hit.primitive = treeSlots[hit.primitive];
+        return hit;
+    }
+
+private:
+    // a converted mesh waiting for upload; slot is its position in node order
+    struct Piece {
+        size_t slot = 0;
+        bool coarse = false;
+        MeshData data;
+
+        size_t bytes() const { return data.packedVertices.size() + data.packedIndices.size() * sizeof(unsigned short); }
+    };
+
+    struct Slot {
+        optional<Mesh> coarse;
+        optional<Mesh> full;
+        uint32_t node = 0;
+    };
+
+    // what the mesh tree needs before its next use: a mesh replacing another only moves boxes, a new one changes the set
+    enum class TreeUpdate { None, Refit, Rebuild };
+
+    chrono::steady_clock::time_point start;
+
+    // shared with the background thread
+    mutex queueMutex;
+    condition_variable queueChanged;
+    deque<Piece> pieces;
+    size_t queuedBytes = 0;
+    size_t slotCount = 0;
+    vector<vector<TextureRef>> materials;
+    TransformGraph importedNodes;
+    bool importDone = false;
+    bool cancelled = false;
+
+    // GL thread only
+    vector<Slot> slots;
+    // BVH over the resident meshes' bounds; treeSlots maps its primitives to slots
+    Bvh meshTree;
+    vector<uint32_t> treeSlots;
+    TreeUpdate treeUpdate = TreeUpdate::None;
+    vector<uint32_t> visible;
+    CullStats lastCull;
+    vector<vector<TextureRef>> uploadMaterials;
+    vector<shared_ptr<Material>> loadedMaterials;
+    size_t drawableSlots = 0, fullSlots = 0;
+
+    // declared last so everything above exists while it runs
+    thread loader;
+
+    double millisecondsSinceStart() const
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // the best version of slot's mesh uploaded so far, null if none
+    static Mesh* resident(Slot& slot)
+    {
+        return slot.full ? &*slot.full : slot.coarse ? &*slot.coarse : nullptr;
+    }
+
+    // recomputes moved nodes; their meshes' boxes moved with them
+    void updateTransforms()
+    {
+        if (nodes.update() && treeUpdate == TreeUpdate::None)
+            treeUpdate = TreeUpdate::Refit;
+    }
+
+    // draws mesh with the shader's model matrix set to model times slot's node transform, unless placed already is it
+    void drawPlaced(Shader& shader, Mesh& mesh, const Slot& slot, const glm::mat4& model, const glm::mat4*& placed)
+    {
+        const glm::mat4& transform = nodes.world(slot.node);
+        if (!placed || *placed != transform)
+        {
+            shader.setModel(model * transform);
+            placed = &transform;
+        }
+        mesh.Draw(shader);
+    }
+
+    void updateTree()
+    {
+        if (treeUpdate == TreeUpdate::None)
+            return;
+        if (treeUpdate == TreeUpdate::Rebuild)
+        {
+            treeSlots.clear();
+            for (size_t i = 0; i < slots.size(); i++)
+                if (resident(slots[i]))
+                    treeSlots.push_back(static_cast<uint32_t>(i));
+        }
+        vector<Bounds> bounds;
+        bounds.reserve(treeSlots.size());
+        for (uint32_t i : treeSlots)
+            bounds.push_back(resident(slots[i])->bounds.transformed(nodes.world(slots[i].node)));
+        if (treeUpdate == TreeUpdate::Rebuild)
+            meshTree.build(bounds);
+        else
+            meshTree.refit(bounds);
+        treeUpdate = TreeUpdate::None;
+    }
+
+    void uploadPiece(Piece& piece)
+    {
+        Slot& slot = slots[piece.slot];
+        // a late coarse version of a mesh that's already complete is useless
+        if (piece.coarse && slot.full)
+            return;
+
+        shared_ptr<Material> material = loadMaterial(piece.data.materialIndex);
+        bool wasDrawable = slot.coarse || slot.full;
+        slot.node = piece.data.node;
+        stats.uploadedBytes += piece.bytes();
+        Mesh mesh(std::move(piece.data.packedVertices), piece.data.format, std::move(piece.data.packedIndices), std::move(piece.data.ranges), std::move(material));
+        if (piece.coarse)
+        {
+            slot.coarse.emplace(std::move(mesh));
+            stats.coarseMeshes++;
+        }
+        else
+        {
+            slot.full.emplace(std::move(mesh));
+            slot.coarse.reset();
+            fullSlots++;
+        }
+
+        if (!wasDrawable)
+            treeUpdate = TreeUpdate::Rebuild;
+        else if (treeUpdate == TreeUpdate::None)
+            treeUpdate = TreeUpdate::Refit;
+
+        if (!wasDrawable)
+        {
+            if (drawableSlots++ == 0)
+                stats.firstDrawableMs = millisecondsSinceStart();
+            if (drawableSlots == slots.size())
+                stats.coarseCompleteMs = millisecondsSinceStart();
+        }
+    }
+
+    // builds a material the first time a mesh uses it; its textures load in the background and show a preview first
+    shared_ptr<Material> loadMaterial(unsigned int index)
+    {
+        if (index >= uploadMaterials.size())
+            return nullptr;
+        if (!loadedMaterials[index])
+            loadedMaterials[index] = make_shared<Material>(uploadMaterials[index], directory, true);
+        return loadedMaterials[index];
+    }
+
+    // background thread: waits while too much is queued for upload already. Returns false once cancelled.
+    bool waitForRoom()
+    {
+        unique_lock<mutex> lock(queueMutex);
+        queueChanged.wait(lock, [this] { return cancelled || queuedBytes < MAX_QUEUED_BYTES; });
+        return !cancelled;
+    }
+
+    // hands a converted mesh to the GL thread. Never waits, so pool workers can't end up blocked on the GL thread (which
+    // may itself be waiting for the pool); the backpressure is waitForRoom() on the background thread.
+    void publish(Piece&& piece)
+    {
+        lock_guard<mutex> lock(queueMutex);
+        if (cancelled)
+            return;
+        queuedBytes += piece.bytes();
+        pieces.push_back(std::move(piece));
+    }
+
+    // background thread: work(i) for every i in [0, count) on the shared pool, a batch at a time with waitForRoom()
+    // before each, so the queue overshoots MAX_QUEUED_BYTES by at most one batch. Stops early once cancelled.
+    template<typename Work>
+    void forEachInBatches(size_t count, Work&& work)
+    {
+        ThreadPool& pool = ThreadPool::shared();
+        size_t batch = pool.size() * MESHES_PER_WORKER;
+        for (size_t first = 0; first < count && waitForRoom(); first += batch)
+            pool.parallelFor(min(batch, count - first), [&](size_t i) { work(first + i); });
+    }
+
+    void finishImport(size_t meshCount, vector<vector<TextureRef>>&& importedMaterials, TransformGraph&& graph)
+    {
+        lock_guard<mutex> lock(queueMutex);
+        slotCount = meshCount;
+        materials = std::move(importedMaterials);
+        importedNodes = std::move(graph);
+    }
+
+    bool isCancelled()
+    {
+        lock_guard<mutex> lock(queueMutex);
+        return cancelled;
+    }
+
+    // background thread: no GL calls in here
+    void streamInBackground(const string& path)
+    {
+        ModelCache::Source source(path);
+        if (!source.exists() || !streamFromCache(source))
+            streamFromSource(source);
+        lock_guard<mutex> lock(queueMutex);
+        importDone = true;
+    }
+
+    bool streamFromCache(ModelCache::Source& source)
+    {
+        ModelCache cache;
+        if (!cache.open(ModelCache::cachePath(source.path), source))
+            return false;
+        finishImport(cache.meshCount(), cache.materials(), cache.nodes());
+        for (size_t i = 0; i < cache.meshCount(); i++)
+        {
+            ModelCache::MeshView view = cache.mesh(i);
+            Piece piece;
+            piece.slot = i;
+            piece.data.format = view.format;
+            piece.data.materialIndex = view.materialIndex;
+            piece.data.node = view.node;
+            const unsigned char* vertexBytes = static_cast<const unsigned char*>(view.vertices);
+            piece.data.packedVertices.assign(vertexBytes, vertexBytes + static_cast<size_t>(view.vertexCount) * vertexStride(view.format));
+            piece.data.packedIndices.assign(view.indices, view.indices + view.indexCount);
+            piece.data.ranges.assign(view.ranges, view.ranges + view.rangeCount);
+            if (!waitForRoom())
+                break;
+            publish(std::move(piece));
+        }
+        return true;
+    }
+
+    void streamFromSource(ModelCache::Source& source)
+    {
+        const string& path = source.path;
+        // the same import as Model::loadModel: triangles only
+        Assimp::Importer importer;
+        importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_SortByPType | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices);
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        {
+            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            return;
+        }
+
+        vector<const aiMesh*> order;
+        TransformGraph graph;
+        vector<uint32_t> orderNodes;
+        Model::processNode(scene->mRootNode, scene, order, graph, orderNodes);
+        vector<vector<TextureRef>> importedMaterials(scene->mNumMaterials);
+        for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+            importedMaterials[i] = Model::processMaterial(scene->mMaterials[i]);
+        finishImport(order.size(), vector<vector<TextureRef>>(importedMaterials), TransformGraph(graph));
+
+        // pass 1: convert, and publish a clustered stand-in for every large mesh
+        vector<MeshData> converted(order.size());
+        forEachInBatches(order.size(), [&](size_t i) {
+            converted[i] = Model::processMesh(order[i], scene->mMaterials[order[i]->mMaterialIndex]);
+            converted[i].node = orderNodes[i];
+            if (converted[i].indices.size() / 3 < COARSE_MIN_TRIANGLES || isCancelled())
+                return;
+            Piece piece;
+            piece.slot = i;
+            piece.coarse = true;
+            piece.data = MeshOptimizer::simplifyClustered(converted[i], COARSE_GRID_SIZE);
+            piece.data.packIndices();
+            piece.data.packVertices();
+            publish(std::move(piece));
+        });
+
+        // pass 2: the real optimization, publishing each mesh as soon as it's done
+        forEachInBatches(order.size(), [&](size_t i) {
+            if (isCancelled())
+                return;
+            MeshOptimizer::optimize(converted[i]);
+            converted[i].packIndices();
+            converted[i].packVertices();
+            Piece piece;
+            piece.slot = i;
+            piece.data.format = converted[i].format;
+            piece.data.materialIndex = converted[i].materialIndex;
+            piece.data.node = converted[i].node;
+            piece.data.packedVertices = converted[i].packedVertices;
+            piece.data.packedIndices = converted[i].packedIndices;
+            piece.data.ranges = converted[i].ranges;
+            publish(std::move(piece));
+        });
+
+        if (!isCancelled() && source.exists())
+            ModelCache::write(ModelCache::cachePath(path), source, converted, importedMaterials, graph);
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define TEXTURECACHE_IMPLEMENTATION
+#include "TextureCache.h"
\ No newline at end of file
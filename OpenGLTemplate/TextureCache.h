@@ -0,0 +1,283 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <glad/glad.h>
+
+#include "GLHandles.h"
+#include "Hash.h"
+#include "TextureLoader.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TextureCacheStats {
+    uint64_t hits = 0;          // acquires served by an already loaded texture
+    uint64_t misses = 0;        // acquires that had to decode and upload
+    uint64_t evictions = 0;     // unused textures deleted to stay within the budget
+    size_t residentBytes = 0;   // approximate video memory held by uploaded textures
+    size_t textureCount = 0;
+};
+
+// Process-wide texture cache shared by Model and Main's loadTexture. Textures are looked up by canonical path and by a
+// hash of the file contents, so the same image is only kept once even when two models reference it under different
+// names. A load in place catches the copy before uploading it; an async load only knows its contents once loaded, and is
+// then merged into the texture already holding them (see resolve()). Textures are reference counted; once unused they stay
+// resident until the video memory budget is exceeded, then the least recently released ones are deleted first.
+// Textures that failed to load count as their placeholder and are evicted like any other.
+class TextureCache
+{
+public:
+    static const size_t DEFAULT_BUDGET = 512 * 1024 * 1024;
+
+    static TextureCache& instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    // returns a texture for the image at path and takes a reference on it. See TextureLoader::load for async.
+    unsigned int acquire(const std::string& path, bool async = true)
+    {
+        std::string key = canonicalPath(path);
+        auto byPath = pathIndex.find(key);
+        if (byPath != pathIndex.end())
+            return addReference(byPath->second);
+
+        // first time we see this path: the file may still be a copy of something already resident. Loading in place
+        // reads it right here, so a copy is caught before anything is uploaded. Async loads read it on a worker, after
+        // the name has been handed out, and are merged once loaded.
+        std::vector<unsigned char> encoded;
+        uint64_t contentKey = 0;
+        if (!async)
+        {
+            encoded = TextureLoader::readFile(path);
+            contentKey = encoded.empty() ? 0 : fnv1a(encoded.data(), encoded.size());
+            auto byContent = contentIndex.find(contentKey);
+            if (contentKey != 0 && byContent != contentIndex.end())
+            {
+                pathIndex[key] = byContent->second;
+                entries[byContent->second].paths.push_back(key);
+                return addReference(byContent->second);
+            }
+        }
+
+        statistics.misses++;
+        unsigned int textureID = TextureLoader::instance().load(path, std::move(encoded), contentKey, async);
+        Entry& entry = entries[textureID];
+        entry.texture.reset(textureID);
+        entry.paths.push_back(key);
+        entry.refCount = 1;
+        entry.unused = lru.end();
+        pathIndex[key] = textureID;
+        return textureID;
+    }
+
+    // drops a reference taken by acquire. Unused textures become candidates for eviction.
+    void release(unsigned int textureID)
+    {
+        resolve(textureID);
+        auto found = entries.find(textureID);
+        if (found == entries.end() || found->second.refCount == 0)
+            return;
+        if (--found->second.refCount == 0)
+            found->second.unused = lru.insert(lru.end(), textureID);
+        trim();
+    }
+
+    // an async acquire whose image turned out to be resident already under another path is merged into that texture
+    // once loaded; its own name keeps only a placeholder. Holders swap it for the merged texture here, which moves their
+    // reference along, and should do so before binding. Returns true if textureID changed.
+    bool resolve(unsigned int& textureID)
+    {
+        if (aliases.empty())
+            return false;
+        auto alias = aliases.find(textureID);
+        if (alias == aliases.end())
+            return false;
+        textureID = alias->second.texture;
+        // the last holder gone deletes the name
+        if (--alias->second.refCount == 0)
+            aliases.erase(alias);
+        return true;
+    }
+
+    // video memory budget for resident textures; unused textures are evicted LRU-first while it's exceeded
+    void setBudget(size_t bytes)
+    {
+        budget = bytes;
+        trim();
+    }
+
+    // deletes every resident texture nobody holds a reference to
+    void purgeUnused()
+    {
+        size_t saved = budget;
+        budget = 0;
+        trim();
+        budget = saved;
+    }
+
+    TextureCacheStats stats() const
+    {
+        TextureCacheStats result = statistics;
+        result.textureCount = entries.size();
+        return result;
+    }
+
+    void printStats() const
+    {
+        TextureCacheStats s = stats();
+        uint64_t total = s.hits + s.misses;
+        std::cout << "texture cache: " << s.textureCount << " textures, " << s.residentBytes / (1024.0 * 1024.0) << " MiB resident, "
+                  << s.hits << " hits / " << s.misses << " misses (" << (total ? 100.0 * s.hits / total : 0.0) << "% hit rate), "
+                  << s.evictions << " evictions" << std::endl;
+    }
+
+private:
+    struct Entry {
+        GLTexture texture;                            // the cache owns every texture it hands out
+        std::vector<std::string> paths;
+        uint64_t contentKey = 0;                      // 0 unless contentIndex points here
+        unsigned int refCount = 0;
+        size_t bytes = 0;
+        bool loading = true;                          // until the loader reports it, uploaded or failed
+        std::list<unsigned int>::iterator unused;     // position in lru while refCount is 0
+    };
+
+    // the name of a merged duplicate, kept until every reference taken on it has been resolved or released
+    struct Alias {
+        GLTexture name;
+        unsigned int texture = 0;                     // the texture it was merged into, which holds these references too
+        unsigned int refCount = 0;
+    };
+
+    std::unordered_map<unsigned int, Entry> entries;
+    std::unordered_map<unsigned int, Alias> aliases;
+    std::unordered_map<std::string, unsigned int> pathIndex;
+    std::unordered_map<uint64_t, unsigned int> contentIndex;
+    std::list<unsigned int> lru;                      // unused textures, least recently released first
+    size_t budget = DEFAULT_BUDGET;
+    TextureCacheStats statistics;
+
+    TextureCache()
+    {
+        TextureLoader::instance().onUploaded = [this](unsigned int textureID, size_t bytes, uint64_t contentKey) {
+            // a load in place reports before acquire() has made its entry, so it may start here
+            Entry& entry = entries[textureID];
+            entry.loading = false;
+            // failed loads come with no key
+            if (contentKey != 0)
+            {
+                // only async acquires have their paths by now; loads in place were checked against the index up front
+                auto indexed = contentIndex.emplace(contentKey, textureID);
+                if (!indexed.second && indexed.first->second != textureID && !entry.paths.empty())
+                {
+                    merge(textureID, indexed.first->second);
+                    trim();
+                    return;
+                }
+                entry.contentKey = contentKey;
+            }
+            statistics.residentBytes += bytes - entry.bytes;
+            entry.bytes = bytes;
+            trim();
+        };
+    }
+
+    ~TextureCache()
+    {
+        // never touches GL here: the context is usually gone by the time statics are destroyed (see purgeUnused())
+        for (auto& entry : entries)
+            entry.second.texture.release();
+        for (auto& alias : aliases)
+            alias.second.name.release();
+    }
+
+    unsigned int addReference(unsigned int textureID)
+    {
+        statistics.hits++;
+        Entry& entry = entries[textureID];
+        if (entry.refCount++ == 0)
+            lru.erase(entry.unused);
+        return textureID;
+    }
+
+    // hands the paths and references of a just loaded duplicate to the texture already holding its image and frees
+    // the duplicate's image. Its name lives on as an alias while references taken on it are outstanding.
+    void merge(unsigned int duplicate, unsigned int textureID)
+    {
+        Entry& from = entries[duplicate];
+        Entry& into = entries[textureID];
+        for (const std::string& path : from.paths)
+        {
+            pathIndex[path] = textureID;
+            into.paths.push_back(path);
+        }
+        // nothing was uploaded for good after all
+        statistics.misses--;
+        statistics.hits++;
+
+        if (from.refCount == 0)
+            lru.erase(from.unused);
+        else
+        {
+            if (into.refCount == 0)
+                lru.erase(into.unused);
+            into.refCount += from.refCount;
+            TextureLoader::dropImage(duplicate);
+            Alias& alias = aliases[duplicate];
+            alias.name = std::move(from.texture);
+            alias.texture = textureID;
+            alias.refCount = from.refCount;
+        }
+        // deletes the texture unless the alias took it
+        entries.erase(duplicate);
+    }
+
+    void trim()
+    {
+        // textures still loading are skipped, their name is in use by the loader
+        for (auto it = lru.begin(); it != lru.end() && statistics.residentBytes > budget;)
+        {
+            Entry& entry = entries[*it];
+            if (entry.loading)
+            {
+                ++it;
+                continue;
+            }
+            unsigned int textureID = *it;
+            it = lru.erase(it);
+            evict(textureID);
+        }
+    }
+
+    void evict(unsigned int textureID)
+    {
+        Entry& entry = entries[textureID];
+        for (const std::string& path : entry.paths)
+            pathIndex.erase(path);
+        if (entry.contentKey != 0)
+            contentIndex.erase(entry.contentKey);
+        statistics.residentBytes -= entry.bytes;
+        statistics.evictions++;
+        // deletes the texture
+        entries.erase(textureID);
+    }
+
+    static std::string canonicalPath(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+        return error ? path : canonical.generic_string();
+    }
+};
+
+#endif
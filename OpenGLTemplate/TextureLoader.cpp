@@ -0,0 +1,2 @@
+#define TEXTURELOADER_IMPLEMENTATION
+#include "TextureLoader.h"
\ No newline at end of file
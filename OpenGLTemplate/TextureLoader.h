@@ -0,0 +1,381 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+#include "Hash.h"
+#include "stb_image.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Pipelined texture loading: the shared worker pool decodes images, a bounded queue hands the pixels back to the GL
+// thread, and update() uploads them through a pixel buffer object. load() returns a texture name right away which holds a
+// 1x1 placeholder until the real image is resident, so meshes can be drawn while their textures are still in flight.
+// Large images are also shrunk to a small preview right after decoding; previews skip ahead of full images in the
+// upload queue, so under a tight per-frame budget every texture shows something close to right within a frame or two.
+class TextureLoader
+{
+public:
+    // maximum number of images being decoded or waiting for upload. Further loads wait in line without a worker, so
+    // pool workers never block on the GL thread.
+    static const size_t QUEUE_CAPACITY = 8;
+    // largest dimension of the preview uploaded ahead of a big image
+    static const int PREVIEW_SIZE = 64;
+
+    TextureLoader()
+    {
+        // the decode tasks point at this loader, so the pool has to outlive it: statics are destroyed in reverse order
+        // of construction
+        ThreadPool::shared();
+    }
+
+    ~TextureLoader()
+    {
+        // never touches GL here: the context is usually gone by the time statics are destroyed.
+        // once stopping is set decode tasks drop what they decode; the ones already running are waited for.
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+        waiting.clear();
+        queueChanged.wait(lock, [this] { return decoding == 0; });
+        for (DecodedImage& image : ready)
+            freePixels(image);
+        for (DecodedImage& image : previews)
+            freePixels(image);
+    }
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // process-wide loader used by Model and Main
+    static TextureLoader& instance()
+    {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    // called on the GL thread once a texture is done loading, with its approximate size in video memory and the FNV-1a
+    // hash of the file. A texture that failed to load keeps its placeholder, reported as PLACEHOLDER_BYTES and hash 0.
+    std::function<void(unsigned int textureID, size_t bytes, uint64_t contentKey)> onUploaded;
+
+    static const size_t PLACEHOLDER_BYTES = 4;
+
+    // returns a texture name for the image at filename. With async set, reading and decoding happen on the worker
+    // pool and the name holds a placeholder until update() uploads the pixels; otherwise it loads in place.
+    unsigned int load(const std::string& filename, bool async = true)
+    {
+        return load(filename, std::vector<unsigned char>(), 0, async);
+    }
+
+    // frees the image of a loaded texture whose name has to stay valid, leaving the 1x1 placeholder in its place
+    static void dropImage(unsigned int textureID)
+    {
+        GLState::instance().bindTexture(0, GL_TEXTURE_2D, textureID);
+        // zero-sized mip levels hold no storage
+        GLint width = 0;
+        for (GLint level = 1;; level++)
+        {
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+            if (width == 0)
+                break;
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        uploadPlaceholder(textureID);
+    }
+
+    // same, but decodes from an already read file whose hash is contentKey (encoded may be empty, in which case
+    // filename is read and hashed)
+    unsigned int load(const std::string& filename, std::vector<unsigned char> encoded, uint64_t contentKey, bool async = true)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        uploadPlaceholder(textureID);
+
+        if (!async)
+        {
+            DecodedImage image = decode(textureID, filename, encoded, contentKey);
+            upload(image);
+            return textureID;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight++;
+        waiting.push_back({ textureID, filename, std::make_shared<std::vector<unsigned char>>(std::move(encoded)), contentKey });
+        startDecodes();
+        return textureID;
+    }
+
+    // uploads decoded images on the GL thread until byteBudget is used up (at least one image per call), previews first.
+    // call once per frame; returns the number of textures whose full image became resident.
+    unsigned int update(size_t byteBudget = 16 * 1024 * 1024)
+    {
+        unsigned int uploaded = 0;
+        size_t bytes = 0;
+        while (bytes < byteBudget)
+        {
+            DecodedImage image;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!previews.empty())
+                {
+                    image = previews.front();
+                    previews.pop_front();
+                }
+                else if (!ready.empty())
+                {
+                    image = ready.front();
+                    ready.pop_front();
+                    inFlight--;
+                    startDecodes();
+                }
+                else
+                    break;
+            }
+            queueChanged.notify_all();
+            bytes += image.byteSize();
+            if (!image.preview)
+                uploaded++;
+            upload(image);
+        }
+        return uploaded;
+    }
+
+    // blocks until every queued texture is resident
+    void finish()
+    {
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (inFlight == 0)
+                    return;
+                queueChanged.wait(lock, [this] { return !ready.empty() || !previews.empty(); });
+            }
+            update(SIZE_MAX);
+        }
+    }
+
+    // number of textures still being decoded or waiting for upload
+    size_t pending()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return inFlight;
+    }
+
+    // the whole file, empty if it can't be read
+    static std::vector<unsigned char> readFile(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+private:
+    struct DecodedImage {
+        unsigned int textureID = 0;
+        int width = 0, height = 0, nrComponents = 0;
+        unsigned char* pixels = nullptr;   // from stbi_load, or malloc for previews
+        std::string path;
+        uint64_t contentKey = 0;
+        bool preview = false;
+
+        size_t byteSize() const { return static_cast<size_t>(width) * height * nrComponents; }
+    };
+
+    // an async load that hasn't got a decode task yet
+    struct Request {
+        unsigned int textureID;
+        std::string filename;
+        std::shared_ptr<std::vector<unsigned char>> encoded;
+        uint64_t contentKey;
+    };
+
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<Request> waiting;
+    std::deque<DecodedImage> ready;
+    std::deque<DecodedImage> previews;   // uploaded before anything in ready
+    size_t decoding = 0;                 // decode tasks handed to the pool and not finished yet
+    size_t inFlight = 0;
+    bool stopping = false;
+    unsigned int pbo = 0;
+
+    // hands waiting loads to the pool while there's room for their results. Called with mutex held.
+    void startDecodes()
+    {
+        while (!stopping && !waiting.empty() && decoding + ready.size() < QUEUE_CAPACITY)
+        {
+            Request request = std::move(waiting.front());
+            waiting.pop_front();
+            decoding++;
+            ThreadPool::shared().submit([this, request] {
+                DecodedImage image = decode(request.textureID, request.filename, *request.encoded, request.contentKey);
+                request.encoded->clear();
+                request.encoded->shrink_to_fit();
+                DecodedImage preview = makePreview(image);
+                std::lock_guard<std::mutex> lock(mutex);
+                decoding--;
+                if (stopping)
+                {
+                    freePixels(image);
+                    freePixels(preview);
+                }
+                else
+                {
+                    // previews are small, they don't count against the queue
+                    if (preview.pixels)
+                        previews.push_back(preview);
+                    ready.push_back(image);
+                }
+                queueChanged.notify_all();
+            });
+        }
+    }
+
+    // runs on a worker thread: read and decode only, no GL calls
+    static DecodedImage decode(unsigned int textureID, const std::string& filename, const std::vector<unsigned char>& encoded, uint64_t contentKey)
+    {
+        DecodedImage image;
+        image.textureID = textureID;
+        image.path = filename;
+        std::vector<unsigned char> read;
+        const std::vector<unsigned char>* file = &encoded;
+        if (encoded.empty())
+        {
+            read = readFile(filename);
+            file = &read;
+            contentKey = read.empty() ? 0 : fnv1a(read.data(), read.size());
+        }
+        if (!file->empty())
+            image.pixels = stbi_load_from_memory(file->data(), static_cast<int>(file->size()), &image.width, &image.height, &image.nrComponents, 0);
+        if (image.pixels)
+            image.contentKey = contentKey;
+        return image;
+    }
+
+    // box filtered copy of image no larger than PREVIEW_SIZE, or an empty image if it's small already
+    static DecodedImage makePreview(const DecodedImage& image)
+    {
+        DecodedImage preview;
+        if (!image.pixels || std::max(image.width, image.height) <= PREVIEW_SIZE)
+            return preview;
+        int factor = 2;
+        while (std::max(image.width, image.height) / factor > PREVIEW_SIZE)
+            factor *= 2;
+        preview.textureID = image.textureID;
+        preview.path = image.path;
+        preview.preview = true;
+        preview.nrComponents = image.nrComponents;
+        preview.width = std::max(1, image.width / factor);
+        preview.height = std::max(1, image.height / factor);
+        preview.pixels = static_cast<unsigned char*>(malloc(preview.byteSize()));
+        if (!preview.pixels)
+            return DecodedImage();
+        for (int y = 0; y < preview.height; y++)
+        {
+            for (int x = 0; x < preview.width; x++)
+            {
+                for (int c = 0; c < image.nrComponents; c++)
+                {
+                    unsigned int sum = 0, count = 0;
+                    for (int sy = y * factor; sy < std::min(image.height, (y + 1) * factor); sy++)
+                        for (int sx = x * factor; sx < std::min(image.width, (x + 1) * factor); sx++, count++)
+                            sum += image.pixels[(static_cast<size_t>(sy) * image.width + sx) * image.nrComponents + c];
+                    preview.pixels[(static_cast<size_t>(y) * preview.width + x) * image.nrComponents + c] = static_cast<unsigned char>(sum / count);
+                }
+            }
+        }
+        return preview;
+    }
+
+    static void freePixels(DecodedImage& image)
+    {
+        if (image.preview)
+            free(image.pixels);
+        else
+            stbi_image_free(image.pixels);
+        image.pixels = nullptr;
+    }
+
+    // neutral grey 1x1 texture shown until the real image arrives
+    static void uploadPlaceholder(unsigned int textureID)
+    {
+        const unsigned char grey[4] = { 128, 128, 128, 255 };
+        GLState::instance().bindTexture(0, GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    // copies the pixels into the PBO and lets the driver pull them into the texture from there
+    void upload(DecodedImage& image)
+    {
+        if (!image.pixels)
+        {
+            std::cout << "Texture failed to load at path: " << image.path << std::endl;
+            if (onUploaded && !image.preview)
+                onUploaded(image.textureID, PLACEHOLDER_BYTES, 0);
+            return;
+        }
+
+        GLenum format = GL_RGBA;
+        if (image.nrComponents == 1)
+            format = GL_RED;
+        else if (image.nrComponents == 3)
+            format = GL_RGB;
+
+        size_t size = image.byteSize();
+        GLState& state = GLState::instance();
+        if (pbo == 0)
+            glGenBuffers(1, &pbo);
+        state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        // orphan the previous storage so we never wait for the last upload to finish reading it
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        const void* source = 0; // offset into the PBO
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped)
+        {
+            memcpy(mapped, image.pixels, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        else
+        {
+            // mapping failed, fall back to a plain client memory upload
+            state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            source = image.pixels;
+        }
+
+        // rows of 1 and 3 component images aren't necessarily 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        state.bindTexture(0, GL_TEXTURE_2D, image.textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, source);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // client memory uploads elsewhere would otherwise read from the PBO
+        state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        freePixels(image);
+
+        // the mip chain adds about a third on top of the base level. previews aren't reported: the texture is only
+        // counted as resident (and thus evictable) once its full image is in
+        if (onUploaded && !image.preview)
+            onUploaded(image.textureID, size + size / 3, image.contentKey);
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define THREADPOOL_IMPLEMENTATION
+#include "ThreadPool.h"
\ No newline at end of file
@@ -0,0 +1,169 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A small fixed-size pool of worker threads used for CPU-side work (mesh conversion, image decoding, ...).
+// Workers never touch OpenGL: anything that needs the context has to be handed back to the GL thread.
+class ThreadPool
+{
+public:
+    // constructor, spins up the requested number of workers (defaults to one per hardware thread)
+    explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency())
+    {
+        threadCount = std::max(1u, threadCount);
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // process-wide pool shared by the loaders
+    static ThreadPool& shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(workers.size());
+    }
+
+    // queues a task and returns a future for its result
+    template<typename F>
+    auto submit(F&& task) -> std::future<decltype(task())>
+    {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([packaged] { (*packaged)(); });
+        }
+        wakeup.notify_one();
+        return result;
+    }
+
+    // calls body(i) for every i in [0, count) spread over the workers and blocks until all are done.
+    // indices are handed out one at a time so a few large items don't leave the other workers idle. The calling thread
+    // takes indices as well, so this finishes even when every worker is busy, e.g. when called from inside a task.
+    // If body throws, the indices not started yet are skipped and the first exception is rethrown here, once no
+    // thread is inside body anymore.
+    template<typename F>
+    void parallelFor(size_t count, F&& body)
+    {
+        if (count == 0)
+            return;
+        // helpers that only get a worker after the loop is over must not touch this stack frame, so what they check
+        // first lives on the heap
+        auto loop = std::make_shared<ParallelLoop>();
+        loop->count = count;
+        auto* work = &body;
+        size_t helpers = std::min<size_t>(count - 1, workers.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t j = 0; j < helpers; j++)
+            {
+                tasks.emplace([loop, work] {
+                    {
+                        std::lock_guard<std::mutex> lock(loop->mutex);
+                        if (loop->closed)
+                            return;
+                        loop->running++;
+                    }
+                    runIndices(*loop, *work);
+                    {
+                        std::lock_guard<std::mutex> lock(loop->mutex);
+                        loop->running--;
+                    }
+                    loop->idle.notify_all();
+                });
+            }
+        }
+        wakeup.notify_all();
+
+        runIndices(*loop, body);
+        std::unique_lock<std::mutex> lock(loop->mutex);
+        loop->closed = true;
+        loop->idle.wait(lock, [&loop] { return loop->running == 0; });
+        if (loop->error)
+            std::rethrow_exception(loop->error);
+    }
+
+private:
+    // shared by the threads working on one parallelFor
+    struct ParallelLoop {
+        std::atomic<size_t> next{ 0 };
+        size_t count = 0;
+        std::mutex mutex;
+        std::condition_variable idle;
+        unsigned int running = 0;    // helpers inside body
+        bool closed = false;         // the caller is done; helpers starting now return right away
+        std::exception_ptr error;    // the first exception body threw
+    };
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    template<typename F>
+    static void runIndices(ParallelLoop& loop, F& body)
+    {
+        try
+        {
+            for (size_t i = loop.next++; i < loop.count; i = loop.next++)
+                body(i);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(loop.mutex);
+            if (!loop.error)
+                loop.error = std::current_exception();
+            loop.next = loop.count;
+        }
+    }
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,2 @@
+#define TRANSFORMGRAPH_IMPLEMENTATION
+#include "TransformGraph.h"
\ No newline at end of file
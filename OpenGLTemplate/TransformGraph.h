@@ -0,0 +1,241 @@
+#ifndef TRANSFORMGRAPH_H
+#define TRANSFORMGRAPH_H
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// what the last update() recomputed
+struct TransformUpdateStats {
+    size_t updated = 0;    // nodes whose world matrix was recomputed
+    size_t subtrees = 0;   // independent ranges that work was split into
+    bool parallel = false;
+    double ms = 0.0;
+};
+
+// Node hierarchy (e.g. ASSIMP's aiNode tree) stored flat, one array per field. Nodes are kept in depth-first order, so
+// a parent always comes before its children and every subtree is the contiguous range [node, subtreeEnd(node)).
+// setLocal() only flags the node; update() finds the topmost flagged nodes and recomputes world = parent's world *
+// local for their subtrees and nothing else. Disjoint subtrees don't read each other's results, so large updates are
+// split into them and spread over the worker pool.
+class TransformGraph
+{
+public:
+    static const uint32_t NONE = 0xffffffffu;
+    // below this many nodes to recompute, update() doesn't bother the worker pool
+    static const size_t PARALLEL_THRESHOLD = 4096;
+    // a parallel update is split into about this many subtrees per worker, so uneven ones still balance
+    static const size_t SUBTREES_PER_WORKER = 4;
+    // update() sorts its flagged nodes unless more than one in this many nodes is flagged
+    static const size_t LINEAR_SCAN_RATIO = 64;
+
+    // appends a node under parent (NONE for a root) and returns its index. Nodes have to be added in depth-first order,
+    // i.e. parent is the last node added or one of its ancestors; anything else is refused with NONE.
+    uint32_t add(uint32_t parent, const glm::mat4& local, const std::string& name = std::string())
+    {
+        uint32_t node = static_cast<uint32_t>(parents.size());
+        if (parent != NONE && (parent >= node || ends[parent] != node))
+        {
+            std::cout << "ERROR::TRANSFORM_GRAPH:: node " << name << " added out of depth-first order" << std::endl;
+            return NONE;
+        }
+        parents.push_back(parent);
+        ends.push_back(node + 1);
+        locals.push_back(local);
+        worlds.push_back(local);
+        names.push_back(name);
+        dirty.push_back(1);
+        flagged.push_back(node);
+        // the new node extends the subtree of every ancestor
+        for (uint32_t ancestor = parent; ancestor != NONE; ancestor = parents[ancestor])
+            ends[ancestor] = node + 1;
+        return node;
+    }
+
+    void reserve(size_t count)
+    {
+        parents.reserve(count);
+        ends.reserve(count);
+        locals.reserve(count);
+        worlds.reserve(count);
+        names.reserve(count);
+        dirty.reserve(count);
+    }
+
+    void clear()
+    {
+        parents.clear();
+        ends.clear();
+        locals.clear();
+        worlds.clear();
+        names.clear();
+        dirty.clear();
+        flagged.clear();
+    }
+
+    size_t size() const { return parents.size(); }
+    bool empty() const { return parents.empty(); }
+
+    uint32_t parent(uint32_t node) const { return parents[node]; }
+    // one past the last node of node's subtree
+    uint32_t subtreeEnd(uint32_t node) const { return ends[node]; }
+    const std::string& name(uint32_t node) const { return names[node]; }
+    const glm::mat4& local(uint32_t node) const { return locals[node]; }
+    // the node's transform relative to the roots' space, as of the last update()
+    const glm::mat4& world(uint32_t node) const { return worlds[node]; }
+    const std::vector<glm::mat4>& worldMatrices() const { return worlds; }
+
+    // the first node called name, NONE if there is none
+    uint32_t find(const std::string& name) const
+    {
+        auto found = std::find(names.begin(), names.end(), name);
+        return found == names.end() ? NONE : static_cast<uint32_t>(found - names.begin());
+    }
+
+    // replaces node's transform relative to its parent; its subtree's world matrices follow on the next update()
+    void setLocal(uint32_t node, const glm::mat4& local)
+    {
+        locals[node] = local;
+        if (!dirty[node])
+        {
+            dirty[node] = 1;
+            flagged.push_back(node);
+        }
+    }
+
+    // true if some world matrix is out of date
+    bool needsUpdate() const { return !flagged.empty(); }
+
+    // brings the world matrices of every flagged subtree up to date. With a pool, updates of at least
+    // PARALLEL_THRESHOLD nodes are spread over its workers. Returns false if nothing was flagged.
+    bool update(ThreadPool* pool = &ThreadPool::shared())
+    {
+        lastUpdate = TransformUpdateStats();
+        if (flagged.empty())
+            return false;
+        auto start = std::chrono::steady_clock::now();
+
+        // the topmost flagged nodes; everything below one of them is recomputed with it, flagged or not. In depth-first
+        // order a flagged node is inside the subtree of an earlier one exactly when it comes before that one's end.
+        pending.clear();
+        size_t total = 0;
+        uint32_t covered = 0;
+        auto take = [&](uint32_t node) {
+            if (node < covered)
+                return;
+            covered = ends[node];
+            pending.push_back({ node, covered });
+            total += covered - node;
+        };
+        // a few moved nodes are sorted, when many moved walking all the flags is cheaper
+        if (flagged.size() * LINEAR_SCAN_RATIO < parents.size())
+        {
+            std::sort(flagged.begin(), flagged.end());
+            for (uint32_t node : flagged)
+                take(node);
+        }
+        else
+            for (uint32_t node = 0; node < parents.size(); node++)
+                if (dirty[node])
+                    take(node);
+        flagged.clear();
+
+        lastUpdate.updated = total;
+        lastUpdate.parallel = pool && pool->size() > 1 && total >= PARALLEL_THRESHOLD;
+        if (lastUpdate.parallel)
+        {
+            size_t grain = std::max<size_t>(1, total / (pool->size() * SUBTREES_PER_WORKER));
+            splitPending(grain, pool->size() * SUBTREES_PER_WORKER);
+            // the ranges are independent, so any of them can share a job; small ones are batched to about grain nodes
+            batchStarts.clear();
+            size_t batchSize = grain;
+            for (size_t i = 0; i < pending.size(); i++)
+            {
+                if (batchSize >= grain)
+                {
+                    batchStarts.push_back(i);
+                    batchSize = 0;
+                }
+                batchSize += pending[i].second - pending[i].first;
+            }
+            batchStarts.push_back(pending.size());
+            pool->parallelFor(batchStarts.size() - 1, [this](size_t batch) {
+                for (size_t i = batchStarts[batch]; i < batchStarts[batch + 1]; i++)
+                    updateRange(pending[i].first, pending[i].second);
+            });
+        }
+        else
+            for (const std::pair<uint32_t, uint32_t>& range : pending)
+                updateRange(range.first, range.second);
+
+        lastUpdate.subtrees = pending.size();
+        lastUpdate.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    const TransformUpdateStats& stats() const { return lastUpdate; }
+
+private:
+    // one entry per node, in depth-first order
+    std::vector<uint32_t> parents;      // NONE for roots
+    std::vector<uint32_t> ends;         // subtree ends
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<std::string> names;
+    std::vector<uint8_t> dirty;         // bytes, not bits, so workers can clear their own nodes' flags
+    // nodes flagged since the last update(), each once
+    std::vector<uint32_t> flagged;
+
+    // node ranges left for the current update(), and where each parallel job's share of them starts
+    std::vector<std::pair<uint32_t, uint32_t>> pending;
+    std::vector<size_t> batchStarts;
+    TransformUpdateStats lastUpdate;
+
+    // recomputes [first, last), a whole subtree or a run of sibling subtrees whose parent is up to date. Depth-first
+    // order means every parent in the range is done before its children.
+    void updateRange(uint32_t first, uint32_t last)
+    {
+        for (uint32_t node = first; node < last; node++)
+        {
+            uint32_t parent = parents[node];
+            worlds[node] = parent == NONE ? locals[node] : worlds[parent] * locals[node];
+            dirty[node] = 0;
+        }
+    }
+
+    // a single flagged root would leave every worker but one idle, so the largest pending subtrees are broken up until
+    // there are about target ranges: the head node is updated right here, and its children's subtrees, which only
+    // depend on it, become ranges of their own (small siblings grouped into runs of about grain nodes)
+    void splitPending(size_t grain, size_t target)
+    {
+        for (size_t split = 0; pending.size() < target && split < 4 * target; split++)
+        {
+            auto largest = std::max_element(pending.begin(), pending.end(), [](const auto& a, const auto& b) { return a.second - a.first < b.second - b.first; });
+            uint32_t head = largest->first, last = largest->second;
+            if (last - head <= grain || ends[head] != last)
+                break;
+            *largest = pending.back();
+            pending.pop_back();
+            updateRange(head, head + 1);
+            for (uint32_t first = head + 1; first < last;)
+            {
+                uint32_t end = ends[first];
+                while (end < last && end - first < grain)
+                    end = ends[end];
+                pending.push_back({ first, end });
+                first = end;
+            }
+        }
+    }
+};
+
+#endif
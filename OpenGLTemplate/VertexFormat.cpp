@@ -0,0 +1,2 @@
+#define VERTEXFORMAT_IMPLEMENTATION
+#include "VertexFormat.h"
\ No newline at end of file
@@ -0,0 +1,166 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Compact GPU vertex formats. Import still works on the full precision Vertex (see Mesh.h); right before upload each
+// mesh is packed into the smallest of these formats its material needs. Attribute locations match the full Vertex:
+//   0 position (vec3)      1 normal (vec3)      2 texture coords (vec2)
+//   3 tangent (vec4, w = bitangent sign, so bitangent = cross(normal, tangent.xyz) * tangent.w)
+//   5 bone ids (ivec4)     6 bone weights (vec4)
+// Normals and tangents are stored as normalized 10_10_10_2 integers, texture coordinates as half floats and bone
+// weights as normalized bytes. Position is always three floats at offset 0 in every format.
+
+// one vertex attribute, described at compile time
+template<GLuint Location, GLint Components, GLenum Type, GLboolean Normalized, GLsizei Size, bool Integer = false>
+struct VertexAttribute {
+    static constexpr GLuint location = Location;
+    static constexpr GLsizei size = Size;
+
+    static void setup(GLsizei stride, size_t offset)
+    {
+        glEnableVertexAttribArray(Location);
+        if (Integer)
+            glVertexAttribIPointer(Location, Components, Type, stride, (void*)offset);
+        else
+            glVertexAttribPointer(Location, Components, Type, Normalized, stride, (void*)offset);
+    }
+};
+
+using PositionAttribute = VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, 12>;
+using PackedNormalAttribute = VertexAttribute<1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 4>;
+using HalfTexCoordAttribute = VertexAttribute<2, 2, GL_HALF_FLOAT, GL_FALSE, 4>;
+using PackedTangentAttribute = VertexAttribute<3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 4>;
+using BoneIdAttribute = VertexAttribute<5, 4, GL_UNSIGNED_SHORT, GL_FALSE, 8, true>;
+using BoneWeightAttribute = VertexAttribute<6, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4>;
+
+// a list of attributes stored back to back; generates the stride and the glVertexAttribPointer calls
+template<typename... Attributes>
+struct VertexLayout {
+    static constexpr GLsizei stride = (Attributes::size + ...);
+
+    // sets up the attribute pointers of the currently bound VAO, relative to baseOffset in the bound GL_ARRAY_BUFFER
+    static void setupAttributes(size_t baseOffset = 0)
+    {
+        size_t offset = baseOffset;
+        ((Attributes::setup(stride, offset), offset += Attributes::size), ...);
+    }
+};
+
+// the packed vertex structs, each matching its layout byte for byte
+struct StaticVertex {
+    float    position[3];
+    uint32_t normal;
+    uint32_t texCoords;
+    static constexpr bool hasTangent = false, hasBones = false;
+    using Layout = VertexLayout<PositionAttribute, PackedNormalAttribute, HalfTexCoordAttribute>;
+};
+
+struct NormalMappedVertex {
+    float    position[3];
+    uint32_t normal;
+    uint32_t texCoords;
+    uint32_t tangent;
+    static constexpr bool hasTangent = true, hasBones = false;
+    using Layout = VertexLayout<PositionAttribute, PackedNormalAttribute, HalfTexCoordAttribute, PackedTangentAttribute>;
+};
+
+struct SkinnedVertex {
+    float    position[3];
+    uint32_t normal;
+    uint32_t texCoords;
+    uint16_t boneIDs[4];
+    uint8_t  weights[4];
+    static constexpr bool hasTangent = false, hasBones = true;
+    using Layout = VertexLayout<PositionAttribute, PackedNormalAttribute, HalfTexCoordAttribute, BoneIdAttribute, BoneWeightAttribute>;
+};
+
+struct SkinnedNormalMappedVertex {
+    float    position[3];
+    uint32_t normal;
+    uint32_t texCoords;
+    uint32_t tangent;
+    uint16_t boneIDs[4];
+    uint8_t  weights[4];
+    static constexpr bool hasTangent = true, hasBones = true;
+    using Layout = VertexLayout<PositionAttribute, PackedNormalAttribute, HalfTexCoordAttribute, PackedTangentAttribute, BoneIdAttribute, BoneWeightAttribute>;
+};
+
+static_assert(StaticVertex::Layout::stride == sizeof(StaticVertex), "StaticVertex doesn't match its layout");
+static_assert(NormalMappedVertex::Layout::stride == sizeof(NormalMappedVertex), "NormalMappedVertex doesn't match its layout");
+static_assert(SkinnedVertex::Layout::stride == sizeof(SkinnedVertex), "SkinnedVertex doesn't match its layout");
+static_assert(SkinnedNormalMappedVertex::Layout::stride == sizeof(SkinnedNormalMappedVertex), "SkinnedNormalMappedVertex doesn't match its layout");
+
+enum class VertexFormat : uint32_t {
+    Static = 0,
+    NormalMapped = 1,
+    Skinned = 2,
+    SkinnedNormalMapped = 3,
+    Count
+};
+
+// the smallest format that carries what a mesh needs
+inline VertexFormat chooseVertexFormat(bool normalMapped, bool skinned)
+{
+    return static_cast<VertexFormat>((normalMapped ? 1 : 0) | (skinned ? 2 : 0));
+}
+
+inline GLsizei vertexStride(VertexFormat format)
+{
+    switch (format)
+    {
+    case VertexFormat::NormalMapped: return NormalMappedVertex::Layout::stride;
+    case VertexFormat::Skinned: return SkinnedVertex::Layout::stride;
+    case VertexFormat::SkinnedNormalMapped: return SkinnedNormalMappedVertex::Layout::stride;
+    default: return StaticVertex::Layout::stride;
+    }
+}
+
+// sets up the attribute pointers for format on the currently bound VAO and GL_ARRAY_BUFFER
+inline void setupVertexAttributes(VertexFormat format, size_t baseOffset = 0)
+{
+    switch (format)
+    {
+    case VertexFormat::NormalMapped: NormalMappedVertex::Layout::setupAttributes(baseOffset); break;
+    case VertexFormat::Skinned: SkinnedVertex::Layout::setupAttributes(baseOffset); break;
+    case VertexFormat::SkinnedNormalMapped: SkinnedNormalMappedVertex::Layout::setupAttributes(baseOffset); break;
+    default: StaticVertex::Layout::setupAttributes(baseOffset); break;
+    }
+}
+
+// packing helpers
+inline uint32_t packNormal(const glm::vec3& normal, float w = 0.0f)
+{
+    return glm::packSnorm3x10_1x2(glm::vec4(normal, w));
+}
+
+inline uint32_t packTexCoords(const glm::vec2& texCoords)
+{
+    return glm::packHalf2x16(texCoords);
+}
+
+// tangent with the handedness of the tangent frame in w
+inline uint32_t packTangent(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent)
+{
+    float sign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+    return packNormal(tangent, sign);
+}
+
+inline void packBones(const int* ids, const float* weights, uint16_t* packedIDs, uint8_t* packedWeights)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        packedIDs[i] = static_cast<uint16_t>(ids[i] < 0 ? 0 : ids[i]);
+        packedWeights[i] = static_cast<uint8_t>(glm::clamp(weights[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+#endif
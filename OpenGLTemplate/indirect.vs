@@ -0,0 +1,39 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per instance: which object this draw is. The indirect commands' base instance is the object index, and instanced
+// attributes honor it (gl_InstanceID doesn't), so this reads GpuCuller's 0, 1, 2, ... buffer at that index.
+layout (location = 5) in uint aObjectIndex;
+
+out vec3 Normal;
+out vec4 Color;
+
+// shared by every program, uploaded once per frame (FrameUniforms)
+layout (std140) uniform PerFrame
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 cameraPosition;
+    float time;
+};
+
+struct Object
+{
+    mat4 model;
+    vec4 color;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uvec4 draw;
+};
+
+layout (std430, binding = 0) readonly buffer Objects { Object objects[]; };
+
+void main()
+{
+    Object object = objects[aObjectIndex];
+    Normal = mat3(transpose(inverse(object.model))) * aNormal;
+    Color = object.color;
+    gl_Position = viewProjection * object.model * vec4(aPos, 1.0);
+}
\ No newline at end of file
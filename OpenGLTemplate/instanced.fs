@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 Normal;
+in vec4 Color;
+
+void main()
+{
+    // fixed directional light, enough to tell the faces apart
+    vec3 lightDir = normalize(vec3(0.3, 1.0, 0.5));
+    float diffuse = max(dot(normalize(Normal), lightDir), 0.0);
+    FragColor = vec4(Color.rgb * (0.3 + 0.7 * diffuse), Color.a);
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per instance, streamed by Square::drawInstanced: position in xyz, uniform scale in w
+layout (location = 3) in vec4 aOffsetScale;
+layout (location = 4) in vec4 aColor;
+
+out vec3 Normal;
+out vec4 Color;
+
+// shared by every program, uploaded once per frame (FrameUniforms)
+layout (std140) uniform PerFrame
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 cameraPosition;
+    float time;
+};
+
+void main()
+{
+    // translate + uniform scale needs no normal matrix
+    Normal = aNormal;
+    Color = aColor;
+    gl_Position = viewProjection * vec4(aPos * aOffsetScale.w + aOffsetScale.xyz, 1.0);
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
 #version 330 core
 out vec4 FragColor;
 
+#include "lights.glsl"
+
 struct Material {
     sampler2D diffuse;
     sampler2D specular;    
@@ -8,46 +10,27 @@ struct Material {
     float shininess;
 }; 
 
-struct Light {
-    //vec3 position;
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
 in vec3 FragPos;  
 in vec3 Normal;  
 in vec2 TexCoords;
   
 uniform vec3 viewPos;
 uniform Material material;
-uniform Light light;
+uniform DirLight light;
 
 void main()
 {
+    Surface surface;
+    surface.position = FragPos;
+    surface.normal = normalize(Normal);
+    surface.viewDir = normalize(viewPos - FragPos);
+    surface.diffuse = texture(material.diffuse, TexCoords).rgb;
+    surface.specular = texture(material.specular, TexCoords).rgb;
+    surface.shininess = material.shininess;
 
-    
-    // ambient
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-  	
-    // diffuse 
-    vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(-light.direction);
-    //vec3 lightDir = normalize(light.position - FragPos);
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;  
-    
-    // specular
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, norm);  
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;  
-        
       // emission
     //vec3 emission = texture(material.emission, TexCoords).rgb;
         
-    vec3 result = ambient + diffuse + specular;// + emission;
+    vec3 result = CalcDirLight(light, surface);// + emission;
     FragColor = vec4(result, 1.0);
-} 
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,137 @@
+// light types and the Calc*Light functions shared by the lighting fragment shaders: #include "lights.glsl"
+//
+// permutation keys (ShaderDefines), with the defaults used when a shader is built without them:
+//   NR_POINT_LIGHTS    size of the point light array (4); 0 leaves the point light loop out entirely
+//   HAS_SPECULAR_MAP   1 if the material has a specular texture (1); with 0 no specular term is computed
+//   HAS_NORMAL_MAP     1 to perturb the normal by the material's normal map (0)
+
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 4
+#endif
+#ifndef HAS_SPECULAR_MAP
+#define HAS_SPECULAR_MAP 1
+#endif
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 0
+#endif
+
+struct DirLight {
+    vec3 direction;
+	
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    
+    float constant;
+    float linear;
+    float quadratic;
+	
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+  
+    float constant;
+    float linear;
+    float quadratic;
+  
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;       
+};
+
+// the fragment being lit, with its material already sampled
+struct Surface {
+    vec3 position;
+    vec3 normal;      // normalized
+    vec3 viewDir;     // normalized, from the fragment towards the camera
+    vec3 diffuse;     // diffuse map color
+    vec3 specular;    // specular map color
+    float shininess;
+};
+
+// phong diffuse and specular factors for light coming from lightDir
+vec2 CalcShading(vec3 lightDir, Surface surface)
+{
+    float diff = max(dot(surface.normal, lightDir), 0.0);
+#if HAS_SPECULAR_MAP
+    vec3 reflectDir = reflect(-lightDir, surface.normal);
+    float spec = pow(max(dot(surface.viewDir, reflectDir), 0.0), surface.shininess);
+#else
+    float spec = 0.0;
+#endif
+    return vec2(diff, spec);
+}
+
+float CalcAttenuation(float constant, float linear, float quadratic, vec3 lightPosition, vec3 fragPos)
+{
+    float distance = length(lightPosition - fragPos);
+    return 1.0 / (constant + linear * distance + quadratic * (distance * distance));
+}
+
+// calculates the color when using a directional light.
+vec3 CalcDirLight(DirLight light, Surface surface)
+{
+    vec3 lightDir = normalize(-light.direction);
+    vec2 shading = CalcShading(lightDir, surface);
+    vec3 ambient = light.ambient * surface.diffuse;
+    vec3 diffuse = light.diffuse * shading.x * surface.diffuse;
+    vec3 specular = light.specular * shading.y * surface.specular;
+    return (ambient + diffuse + specular);
+}
+
+// calculates the color when using a point light.
+vec3 CalcPointLight(PointLight light, Surface surface)
+{
+    vec3 lightDir = normalize(light.position - surface.position);
+    vec2 shading = CalcShading(lightDir, surface);
+    float attenuation = CalcAttenuation(light.constant, light.linear, light.quadratic, light.position, surface.position);
+    vec3 ambient = light.ambient * surface.diffuse;
+    vec3 diffuse = light.diffuse * shading.x * surface.diffuse;
+    vec3 specular = light.specular * shading.y * surface.specular;
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+// calculates the color when using a spot light (soft edges between cutOff and outerCutOff).
+vec3 CalcSpotLight(SpotLight light, Surface surface)
+{
+    vec3 lightDir = normalize(light.position - surface.position);
+    vec2 shading = CalcShading(lightDir, surface);
+    float attenuation = CalcAttenuation(light.constant, light.linear, light.quadratic, light.position, surface.position);
+    float theta = dot(lightDir, normalize(-light.direction)); 
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    vec3 ambient = light.ambient * surface.diffuse;
+    vec3 diffuse = light.diffuse * shading.x * surface.diffuse;
+    vec3 specular = light.specular * shading.y * surface.specular;
+    return (ambient + diffuse + specular) * intensity * attenuation;
+}
+
+#if HAS_NORMAL_MAP
+// bends normal by a tangent-space normal map sample (in [0, 1]). The tangent frame comes from screen-space derivatives
+// of position and uv, so meshes don't need tangent attributes.
+vec3 PerturbNormal(vec3 normal, vec3 position, vec2 uv, vec3 mapSample)
+{
+    vec3 dp1 = dFdx(position);
+    vec3 dp2 = dFdy(position);
+    vec2 duv1 = dFdx(uv);
+    vec2 duv2 = dFdy(uv);
+    vec3 dp2perp = cross(dp2, normal);
+    vec3 dp1perp = cross(normal, dp1);
+    vec3 tangent = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 bitangent = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(dot(tangent, tangent), dot(bitangent, bitangent)));
+    mat3 tbn = mat3(tangent * invmax, bitangent * invmax, normal);
+    return normalize(tbn * (mapSample * 2.0 - 1.0));
+}
+#endif
\ No newline at end of file